@@ -0,0 +1,115 @@
+#include <stm32f0xx.h>
+#include <stm32f0xx_gpio.h>
+#include <stm32f0xx_rcc.h>
+#include "adc.h"
+
+//ADC_INn is on PAn for the inputs used here
+#define ADC_GPIO	GPIOA
+
+//Sampling time code, 41.5 ADC clocks (3.5us at 12MHz) for buffered sources. A conversion
+//takes 54 ADC clocks, 4.5us.
+#define ADC_SMP		4
+
+uint16_t adcbuf[ADC_BUFSIZ];
+
+volatile uint32_t adcoverruns = 0;
+uint32_t adcrate = 0;
+
+//Half the buffer in use, in samples
+static uint16_t adchalf;
+
+//Set up to convert inputs (ADC_INn bits) every period HCLK cycles into the first len
+//samples of adcbuf, a whole number of sequences per half. TIM3 counts HCLK as APB isn't
+//divided, so period is at most 65536. Nothing is converted until AdcTrigger().
+void AdcStart(uint32_t period, uint8_t inputs, uint16_t len){
+	GPIO_InitTypeDef g;
+
+	AdcStop();
+	if(period>65536) period = 65536;
+	if(len>ADC_BUFSIZ) len = ADC_BUFSIZ;
+	adchalf = len/2;
+
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_GPIOA | RCC_AHBPeriph_DMA1, ENABLE);
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1, ENABLE);
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);
+
+	g.GPIO_Pin = inputs;
+	g.GPIO_Mode = GPIO_Mode_AN;
+	g.GPIO_OType = GPIO_OType_PP;
+	g.GPIO_PuPd = GPIO_PuPd_NOPULL;
+	g.GPIO_Speed = GPIO_Speed_2MHz;
+	GPIO_Init(ADC_GPIO, &g);
+
+	//Update event on TRGO. The update that loads the prescaler and period is forced before
+	//TRGO is selected, so it doesn't start a conversion.
+	TIM3->CR1 = 0;
+	TIM3->CR2 = 0;
+	TIM3->PSC = 0;
+	TIM3->ARR = period - 1;
+	TIM3->EGR = TIM_EGR_UG;
+	TIM3->CNT = 0;
+	TIM3->CR2 = TIM_CR2_MMS_1;
+
+	//Synchronous clock at PCLK/4 so the sampling instant is a fixed time after the trigger
+	//(CKMODE = 10, the header only names the bit JITOFFDIV4), then calibrate while disabled
+	ADC1->CFGR2 = ADC_CFGR2_JITOFFDIV4;
+	ADC1->CR = ADC_CR_ADCAL;
+	while(ADC1->CR & ADC_CR_ADCAL);
+
+	//Scan the inputs lowest first on each TIM3 TRGO rising edge, circular DMA, 12 bit right
+	//aligned
+	ADC1->CFGR1 = ADC_CFGR1_EXTEN_0 | ADC_CFGR1_EXTSEL_0 | ADC_CFGR1_EXTSEL_1 | ADC_CFGR1_DMACFG |
+			ADC_CFGR1_DMAEN;
+	ADC1->CHSELR = inputs;
+	ADC1->SMPR = ADC_SMP;
+	ADC1->CR = ADC_CR_ADEN;
+	while(!(ADC1->ISR & ADC_ISR_ADRDY));
+
+	//Lowest priority, I2S wins any contention. No interrupts, AdcBlock() polls the flags.
+	DMA1_Channel1->CPAR = (uint32_t)&ADC1->DR;
+	DMA1_Channel1->CMAR = (uint32_t)adcbuf;
+	DMA1_Channel1->CNDTR = 2*adchalf;
+	DMA1->IFCR = DMA_IFCR_CHTIF1 | DMA_IFCR_CTCIF1;
+	DMA1_Channel1->CCR = DMA_CCR_MINC | DMA_CCR_PSIZE_0 | DMA_CCR_MSIZE_0 | DMA_CCR_CIRC | DMA_CCR_EN;
+
+	ADC1->CR |= ADC_CR_ADSTART;
+	adcrate = SystemCoreClock/period;
+	adcoverruns = 0;
+}
+
+//Start the timer, the first conversion is one period from now. Cheap enough for an
+//interrupt.
+void AdcTrigger(void){
+	TIM3->CR1 = TIM_CR1_CEN;
+}
+
+//Stop the trigger, the conversion sequence and DMA, and power the ADC down
+void AdcStop(void){
+	if(!(RCC->APB2ENR & RCC_APB2ENR_ADC1EN)) return;
+
+	TIM3->CR1 = 0;
+	if(ADC1->CR & ADC_CR_ADSTART){
+		ADC1->CR |= ADC_CR_ADSTP;
+		while(ADC1->CR & ADC_CR_ADSTP);
+	}
+	if(ADC1->CR & ADC_CR_ADEN){
+		ADC1->CR |= ADC_CR_ADDIS;
+		while(ADC1->CR & ADC_CR_ADEN);
+	}
+	DMA1_Channel1->CCR = 0;
+	adcrate = 0;
+}
+
+//The half buffer that has just been filled, or 0 if neither has since the last call. It
+//stays valid for one half's time, until the DMA comes round to it again. If both halves
+//filled since the last call the older one is already gone and an overrun is counted.
+const uint16_t *AdcBlock(void){
+	uint32_t isr = DMA1->ISR & (DMA_ISR_HTIF1 | DMA_ISR_TCIF1);
+
+	if(!isr) return 0;
+	DMA1->IFCR = isr;
+	if(isr == (DMA_ISR_HTIF1 | DMA_ISR_TCIF1)) adcoverruns++;
+
+	//CNDTR counts down over the whole buffer, the DMA is in the other half
+	return DMA1_Channel1->CNDTR>adchalf ? adcbuf + adchalf : adcbuf;
+}
@@ -0,0 +1,46 @@
+#ifndef ADC_H
+#define ADC_H
+
+#include <stdint.h>
+
+/*
+ * Analog capture on ADC1, for loops that measure the output (or an input) at a low rate.
+ * TIM3 triggers a conversion of each selected input (ADC_INn is PAn) every period HCLK
+ * cycles, and DMA1_Channel1 stores the 12 bit results in a circular buffer of len samples
+ * in two halves. There's no interrupt: the level loop polls AdcBlock() from a background
+ * task and the tracking loop reads the buffer from the refill interrupt at fixed points, so
+ * capture never adds an interrupt of its own. The channel has the lowest DMA priority,
+ * below I2S.
+ *
+ * AdcStart() sets everything up and AdcTrigger() starts the timer, separately so that a
+ * caller that needs the samples on a known frame can start it from the refill interrupt.
+ *
+ * There is no StdPeriph ADC or TIM driver in the tree, the registers are set up directly.
+ */
+
+//Samples in the whole buffer
+#define ADC_BUFSIZ		1024
+
+//Inputs, as CHSELR bits
+#define ADC_IN1			(1U<<1)
+#define ADC_IN2			(1U<<2)
+#define ADC_IN3			(1U<<3)
+
+//Full scale and mid scale of a 12 bit conversion
+#define ADC_FULL		4095
+#define ADC_MID			2048
+
+extern uint16_t adcbuf[ADC_BUFSIZ];
+
+//Halves that were overwritten before they were read
+extern volatile uint32_t adcoverruns;
+
+//Conversion sequences per second, once started
+extern uint32_t adcrate;
+
+void AdcStart(uint32_t period, uint8_t inputs, uint16_t len);
+void AdcTrigger(void);
+void AdcStop(void);
+const uint16_t *AdcBlock(void);
+
+#endif
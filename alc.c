@@ -0,0 +1,129 @@
+#include "alc.h"
+#include "generator.h"
+#include "cmd.h"
+
+volatile uint8_t alcstate = ALC_OFF;
+uint32_t alcgain, alctarget, alcpower, alcblocks;
+int32_t alcerr;
+
+//Detector sums for the block so far, per channel
+static uint64_t alcsq[2];
+static uint32_t alcsum[2], alcn;
+
+//Amplitude last submitted, and blocks in a row within the lock tolerance
+static uint16_t alcampl;
+static uint8_t alcgood;
+
+//Level channel 0 to rms ADC counts on each input, or if rms is 0 to whatever the first
+//block measures. Starts from the amplitude the generator has now.
+void AlcStart(uint16_t rms){
+	alcstate = ALC_OFF;
+	alcsq[0] = alcsq[1] = 0;
+	alcsum[0] = alcsum[1] = 0;
+	alcn = 0;
+	alcgood = 0;
+	alcblocks = 0;
+	alcerr = 0;
+	alcampl = ampltarget[0];
+	alcgain = (uint32_t)alcampl<<16;
+	alctarget = ((uint32_t)rms*rms)<<9;
+	alcstate = ALC_ACQUIRE;
+}
+
+//Stop levelling, the amplitude stays where the loop left it
+void AlcStop(void){
+	alcstate = ALC_OFF;
+}
+
+//Close a block: measure, step the gain and work out the state
+static void AlcUpdate(void){
+	uint64_t v;
+	int64_t step;
+	int32_t e;
+	uint16_t a;
+	uint8_t ch;
+
+	//Variance times ALC_FRAMES^2 per channel, N*sum(x^2) - sum(x)^2, then down to Q8
+	v = 0;
+	for(ch = 0; ch<2; ch++){
+		v += (alcsq[ch]<<ALC_LOG2FRAMES) - (uint64_t)alcsum[ch]*alcsum[ch];
+		alcsq[ch] = 0;
+		alcsum[ch] = 0;
+	}
+	alcn = 0;
+	alcpower = v>>(2*ALC_LOG2FRAMES - 8);
+	alcblocks++;
+
+	if(alcpower<((uint32_t)ALC_MINRMS*ALC_MINRMS<<9)){
+		alcstate = ALC_NOSIGNAL;
+		alcgood = 0;
+		return;
+	}
+	if(!alctarget) alctarget = alcpower;
+
+	//Relative power error. Amplitude goes as its square root, so correcting e/2 of the
+	//gain takes out the whole error to first order.
+	e = (((int64_t)alctarget - alcpower)<<16)/alcpower;
+	alcerr = e;
+	step = ((int64_t)alcgain*(e/2))>>(16 + ALC_SHIFT);
+	if(step>(int64_t)(alcgain>>ALC_MAXSTEP)) step = alcgain>>ALC_MAXSTEP;
+	if(step<-(int64_t)(alcgain>>ALC_MAXSTEP)) step = -(int64_t)(alcgain>>ALC_MAXSTEP);
+	step += alcgain;
+
+	//Keep the gain inside the generator's amplitude range
+	if(step>(int64_t)32767<<16) step = (int64_t)32767<<16;
+	if(step<1L<<16) step = 1L<<16;
+	alcgain = step;
+
+	//Once locked, only an error past twice the tolerance unlocks
+	if(e<ALC_LOCKTOL && e>-ALC_LOCKTOL){
+		if(alcgood<ALC_LOCKBLOCKS) alcgood++;
+	}
+	else if(alcstate != ALC_LOCKED || e>=2*ALC_LOCKTOL || e<=-2*ALC_LOCKTOL){
+		alcgood = 0;
+	}
+
+	if(alcgood == ALC_LOCKBLOCKS) alcstate = ALC_LOCKED;
+	else if((alcgain == (uint32_t)32767<<16 && e>0) || (alcgain == 1UL<<16 && e<0)) alcstate = ALC_RAIL;
+	else alcstate = ALC_ACQUIRE;
+
+	//Only whole amplitude steps reach the generator, if the queue is full it goes next block
+	a = (alcgain + 0x8000)>>16;
+	if(a>32767) a = 32767;
+	if(a != alcampl && CmdSubmit(CMD_AMPL | CMD_TRIM, 0, 0, a, 0)) alcampl = a;
+}
+
+//Feed frames of ADC I/Q pairs (x[2k] I, x[2k+1] Q, 12 bit), at most 256 at a time so the
+//squares add up in 32 bits. Returns 1 if a block was completed and the gain updated.
+uint8_t AlcFeed(const uint16_t *x, uint32_t frames){
+	uint32_t s0 = 0, s1 = 0, q0 = 0, q1 = 0, n, take;
+	uint8_t done = 0;
+
+	if(alcstate == ALC_OFF) return 0;
+
+	while(frames){
+		take = ALC_FRAMES - alcn;
+		if(take>frames) take = frames;
+
+		for(n = 0; n<take; n++){
+			s0 += x[0];
+			q0 += (uint32_t)x[0]*x[0];
+			s1 += x[1];
+			q1 += (uint32_t)x[1]*x[1];
+			x += 2;
+		}
+		alcsum[0] += s0;
+		alcsum[1] += s1;
+		alcsq[0] += q0;
+		alcsq[1] += q1;
+		s0 = s1 = q0 = q1 = 0;
+
+		alcn += take;
+		frames -= take;
+		if(alcn == ALC_FRAMES){
+			AlcUpdate();
+			done = 1;
+		}
+	}
+	return done;
+}
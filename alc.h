@@ -0,0 +1,64 @@
+#ifndef ALC_H
+#define ALC_H
+
+#include <stdint.h>
+
+/*
+ * Automatic level control. The conditioned I/Q outputs are fed back to ADC1 (adc.c) at a
+ * low rate and a block detector measures their combined mean square with the DC taken out.
+ * For a quadrature pair I^2 + Q^2 is constant, so the detector has no ripple at twice the
+ * tone frequency to average away. Once a block the error against the target trims channel
+ * 0's amplitude, a fraction of the way there and never more than 1/2^ALC_MAXSTEP at once,
+ * through CMD_AMPL so the change lands on a block boundary. It's submitted as a trim (see
+ * cmd.h) so the session record isn't filled with them.
+ *
+ * All of it runs in thread context, TaskAlc() in main.c feeds the ADC halves in slices, and
+ * is target independent so the host simulator runs the same loop against a model of the
+ * analog chain ("sim alc").
+ *
+ * The ADC samples far below the tone, which is fine as long as the tone doesn't alias to
+ * (near) DC: keep it clear of multiples of the ADC rate by a few times FS/ALC_FRAMES. While
+ * the loop runs it owns channel 0's amplitude.
+ */
+
+//ADC pairs per detector block and its log2, a power of two
+#define ALC_FRAMES		4096
+#define ALC_LOG2FRAMES	12
+
+//ADC rate, not a round number so round number tones don't land on its multiples
+#define ALC_RATE		10007
+
+//Loop gain, 1/2^ALC_SHIFT of the error is corrected each block
+#define ALC_SHIFT		2
+
+//Largest correction per block, 1/2^ALC_MAXSTEP of the gain (0.034dB)
+#define ALC_MAXSTEP		8
+
+//Locked once the power error has been within ALC_LOCKTOL (Q16, 0.02dB of amplitude) for
+//ALC_LOCKBLOCKS blocks running, unlocked again at twice that
+#define ALC_LOCKTOL		606
+#define ALC_LOCKBLOCKS	4
+
+//Below this RMS (ADC counts, each channel) there's nothing to level and the gain is held
+#define ALC_MINRMS		16
+
+//Loop states
+#define ALC_OFF			0
+#define ALC_ACQUIRE		1	//Converging on the target
+#define ALC_LOCKED		2
+#define ALC_NOSIGNAL	3	//Level under ALC_MINRMS, gain held
+#define ALC_RAIL		4	//Gain at full scale or zero and still short of the target
+
+//For reading out with the debugger
+extern volatile uint8_t alcstate;
+extern uint32_t alcgain;		//Amplitude, Q16.16 of the Q15 generator amplitude
+extern uint32_t alctarget;		//Target mean square, I plus Q, counts^2 Q8
+extern uint32_t alcpower;		//Last block's mean square, counts^2 Q8
+extern int32_t alcerr;			//Last block's power error, (target - power)/power Q16
+extern uint32_t alcblocks;		//Blocks measured since AlcStart()
+
+void AlcStart(uint16_t rms);
+void AlcStop(void);
+uint8_t AlcFeed(const uint16_t *x, uint32_t frames);
+
+#endif
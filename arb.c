@@ -0,0 +1,97 @@
+#include <stm32f0xx_dma.h>
+#include "arb.h"
+#include "generator.h"
+
+#define ARB_DMA		DMA1_Channel3
+
+volatile uint16_t arbseq = ARB_END;
+volatile uint16_t arbleft = 0;
+volatile uint32_t arbpasses = 0;
+
+//Segment to start at the generator's next buffer wrap, ARB_END if none
+static volatile uint16_t arbreq = ARB_END;
+
+//Set to finish the sequence at the end of the current pass
+static volatile uint8_t arbstop = 0;
+
+//Point the channel at a segment. The channel must have finished (or not be streaming).
+void ArbLoad(uint16_t seg){
+	const ArbSeg *s = &arbseg[seg];
+
+	ARB_DMA->CCR &= ~DMA_CCR_EN;
+	ARB_DMA->CMAR = (uint32_t)s->data;
+	ARB_DMA->CNDTR = s->frames*2;
+	if(s->loops == 1) ARB_DMA->CCR &= ~DMA_CCR_CIRC;
+	else ARB_DMA->CCR |= DMA_CCR_CIRC;
+	ARB_DMA->CCR |= DMA_CCR_EN;
+
+	arbseq = seg;
+	arbleft = s->loops;
+}
+
+//Back to the generator's buffer, which the last half transfer interrupt filled
+static void ArbToGenerator(void){
+	ARB_DMA->CCR &= ~DMA_CCR_EN;
+	ARB_DMA->CMAR = (uint32_t)dmabuf;
+	ARB_DMA->CNDTR = DMA_BUFSIZ*2;
+	ARB_DMA->CCR |= DMA_CCR_CIRC | DMA_CCR_EN;
+
+	arbseq = ARB_END;
+}
+
+//Play the sequence from segment seg. Takes over at the end of the generator's buffer so
+//the switch is seamless.
+void ArbStart(uint16_t seg){
+	if(seg<arbsegn) arbreq = seg;
+}
+
+//Finish at the end of the current pass and return to the generator
+void ArbStop(void){
+	arbreq = ARB_END;
+	if(arbseq != ARB_END) arbstop = 1;
+}
+
+//Called first by the DMA interrupt. Returns 1 if the interrupt belonged to flash playback,
+//ARB_PREFILL if it did and the generator's whole buffer needs filling before the
+//transfer complete, 0 if the generator should refill as usual.
+uint8_t ArbIrq(void){
+	uint8_t ret = 1;
+	uint16_t next;
+
+	if(arbseq == ARB_END){
+		//Start when the generator's buffer wraps
+		if(arbreq == ARB_END || !DMA_GetITStatus(DMA1_IT_TC3)) return 0;
+		DMA_ClearITPendingBit(DMA1_IT_TC3);
+		ArbLoad(arbreq);
+		arbreq = ARB_END;
+		return 1;
+	}
+
+	if(DMA_GetITStatus(DMA1_IT_HT3)){
+		DMA_ClearITPendingBit(DMA1_IT_HT3);
+
+		//Last pass, let the channel stop at the end. If the sequence finishes here the
+		//generator's buffer has to be full by then, the switch back has to be quick.
+		if(arbleft == 1 || arbstop){
+			ARB_DMA->CCR &= ~DMA_CCR_CIRC;
+			if(arbstop || arbseg[arbseq].next == ARB_END) ret = ARB_PREFILL;
+		}
+	}
+	else if(DMA_GetITStatus(DMA1_IT_TC3)){
+		DMA_ClearITPendingBit(DMA1_IT_TC3);
+		arbpasses++;
+
+		//Still looping, count the pass unless it loops forever
+		if(ARB_DMA->CCR & DMA_CCR_CIRC){
+			if(arbleft>1) arbleft--;
+			return 1;
+		}
+
+		next = arbstop ? ARB_END : arbseg[arbseq].next;
+		arbstop = 0;
+		if(next == ARB_END) ArbToGenerator();
+		else ArbLoad(next);
+	}
+
+	return ret;
+}
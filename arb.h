@@ -0,0 +1,55 @@
+#ifndef ARB_H
+#define ARB_H
+
+#include <stdint.h>
+
+/*
+ * Arbitrary waveform playback straight from flash. DMA1_Channel3 is pointed at a sequence
+ * of interleaved 16 bit stereo frames in flash and feeds SPI1->DR directly, so the CPU
+ * only sees the half transfer and transfer complete interrupts of each pass through a
+ * segment. Segments loop in circular mode without any gap. On the last pass the half
+ * transfer interrupt clears circular mode (and has the refill stage prefill the
+ * generator's buffer if the sequence ends there), then the transfer complete interrupt
+ * repoints the channel at the next segment. The SPI transmit buffer covers that, one
+ * sample is 10.7us.
+ *
+ * The sequence is built by tools/arbpack.py from WAV files, which are embedded with
+ * .incbin into the .rodata.arb section of the generated arbseq.s.
+ *
+ * While a sequence plays the generator and the command queue are paused, queued commands
+ * are applied once it ends.
+ */
+
+//next value that ends the sequence and returns to the generator
+#define ARB_END		0xFFFF
+
+//ArbIrq() return when the generator's buffer needs filling for the end of the sequence
+#define ARB_PREFILL	2
+
+//Longest segment, CNDTR counts 16 bit transfers
+#define ARB_MAXFRAMES	32767
+
+//Layout matches the table arbpack.py writes
+typedef struct {
+	const int16_t *data;
+	uint32_t frames;
+	uint16_t loops;		//Passes before moving on, 0 loops forever
+	uint16_t next;		//Segment to chain to, or ARB_END
+} ArbSeg;
+
+extern const ArbSeg arbseg[];
+extern const uint32_t arbsegn;
+
+//Segment playing and passes left including this one, arbseq is ARB_END when idle
+extern volatile uint16_t arbseq;
+extern volatile uint16_t arbleft;
+
+//Segment passes completed since start up
+extern volatile uint32_t arbpasses;
+
+void ArbStart(uint16_t seg);
+void ArbStop(void);
+uint8_t ArbIrq(void);
+void ArbLoad(uint16_t seg);
+
+#endif
@@ -0,0 +1,24 @@
+@Generated by tools/arbpack.py, do not edit
+
+	.section .rodata.arb,"a",%progbits
+
+@Segment table, see ArbSeg in arb.h
+	.balign 4
+	.global arbseg
+arbseg:
+	.word arbdata0, 2048
+	.hword 2, 0x0001	@arb/chirp.wav
+	.word arbdata1, 1024
+	.hword 4, 0xFFFF	@arb/burst.wav
+
+	.global arbsegn
+arbsegn:
+	.word 2
+
+	.balign 4
+arbdata0:
+	.incbin "arb/chirp.wav", 44, 8192
+
+	.balign 4
+arbdata1:
+	.incbin "arb/burst.wav", 44, 4096
@@ -0,0 +1,120 @@
+#include "asrc.h"
+#include "cmd.h"
+
+volatile uint8_t asrcstate = ASRC_OFF;
+int32_t asrcdrift, asrcfill, asrctarget;
+uint32_t asrcupdates;
+
+//Link rate and the sample rate the nominal step and gains are for
+static uint32_t asrclink, asrcfs, asrcnom;
+
+//Gains acquiring and locked, 2^-32 of the step per 1/256 sample of fill error, the
+//integral's in 1/256 of that
+static int32_t asrckp[2], asrcki[2];
+
+//Integral (drift) in 2^-40, step last submitted, updates in a row within the tolerance,
+//and whether there is a target yet and the underrun count it was set at
+static int32_t asrcint;
+static uint32_t asrcstep, asrcdone, asrcprimed;
+static uint16_t asrcgood;
+static uint8_t asrcset;
+
+//Nominal step and gains for the current sample rate. With r the link rate, T the update
+//period and the fill error in 1/256 samples: kp = 2*zeta*wn/r, ki = wn^2*T/r.
+static void AsrcGains(void){
+	static const uint16_t wn[2] = {ASRC_WN, ASRC_TRACKWN};
+	uint8_t g;
+
+	asrcfs = genfs;
+	asrcnom = UpconvStep(asrclink);
+	for(g = 0; g<2; g++){
+		asrckp[g] = ((uint64_t)1414*wn[g]<<24)/(1000000ULL*asrclink);
+		asrcki[g] = ((uint64_t)wn[g]*wn[g]*BB_FILLFRAMES<<32)/(1000000ULL*asrcfs*asrclink);
+	}
+}
+
+//Start upconverting the stream from the control link to ifreq Hz at a nominal linkrate
+//Hz, and tracking its clock. Returns 0 without starting if the command queue is full.
+uint8_t AsrcStart(uint32_t ifreq, uint32_t linkrate){
+	if(!linkrate || !CmdSpace()) return 0;
+	AsrcStop();
+
+	asrclink = linkrate>genfs ? genfs : linkrate;
+	AsrcGains();
+	asrcstep = asrcnom;
+	asrcint = 0;
+	asrcdrift = 0;
+	asrcfill = asrctarget = 0;
+	asrcset = 0;
+	asrcgood = 0;
+	asrcupdates = 0;
+	asrcdone = bbfillseq;
+
+	CmdSubmit(CMD_UPCONV, 0, 0, ifreq, asrcnom);
+	asrcstate = ASRC_ACQUIRE;
+	return 1;
+}
+
+//Stop tracking, the step stays where the loop left it
+void AsrcStop(void){
+	asrcstate = ASRC_OFF;
+}
+
+//Loop filter, for a background task. Returns 1 if there was an update to process.
+uint8_t AsrcUpdate(void){
+	uint32_t seq, step;
+	int32_t e, d;
+	uint8_t g = asrcstate == ASRC_LOCKED;
+
+	if(asrcstate == ASRC_OFF || bbfillseq == asrcdone) return 0;
+	do{
+		seq = bbfillseq;
+		asrcfill = bbfill;
+	}while(seq != bbfillseq);
+	asrcdone = seq;
+	asrcupdates++;
+
+	//GenRetune() scaled the step for a new sample rate, carry on from there
+	if(genfs != asrcfs) AsrcGains();
+
+	//The first average since the ring was last primed is the target
+	if(!asrcset || bbunderruns != asrcprimed){
+		asrcset = 1;
+		asrcprimed = bbunderruns;
+		asrctarget = asrcfill;
+		asrcgood = 0;
+		return 1;
+	}
+
+	//A fuller ring than the target wants the step up, the link is running fast
+	e = asrcfill - asrctarget;
+	asrcint += e*asrcki[g];
+	if(asrcint>ASRC_MAXADJ<<8) asrcint = ASRC_MAXADJ<<8;
+	if(asrcint<-(ASRC_MAXADJ<<8)) asrcint = -(ASRC_MAXADJ<<8);
+	d = e*asrckp[g] + (asrcint>>8);
+	if(d>ASRC_MAXADJ) d = ASRC_MAXADJ;
+	if(d<-ASRC_MAXADJ) d = -ASRC_MAXADJ;
+	asrcdrift = asrcint>>8;
+
+	step = asrcnom + (int32_t)(((int64_t)asrcnom*d)>>32);
+	if(d>0 && step<asrcnom) step = 0xFFFFFFFF;
+	if(step != asrcstep && CmdSpace()){
+		CmdSubmit(CMD_RATIO | CMD_TRIM, 0, 0, step, 0);
+		asrcstep = step;
+	}
+
+	if(asrcint == ASRC_MAXADJ<<8 || asrcint == -(ASRC_MAXADJ<<8)){
+		asrcstate = ASRC_RAIL;
+		asrcgood = 0;
+	}
+	else if(e>2*ASRC_LOCKTOL || e<-2*ASRC_LOCKTOL){
+		asrcstate = ASRC_ACQUIRE;
+		asrcgood = 0;
+	}
+	else if(e<=ASRC_LOCKTOL && e>=-ASRC_LOCKTOL){
+		if(asrcgood<ASRC_LOCKUPDATES) asrcgood++;
+		if(asrcgood == ASRC_LOCKUPDATES) asrcstate = ASRC_LOCKED;
+	}
+	else if(asrcstate != ASRC_LOCKED) asrcgood = 0;
+	return 1;
+}
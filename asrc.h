@@ -0,0 +1,60 @@
+#ifndef ASRC_H
+#define ASRC_H
+
+#include <stdint.h>
+#include "generator.h"
+
+/*
+ * Drift tracking for streamed upconversion. Baseband arrives over the control link on the
+ * sender's clock and is played out on the I2S clock, and no two crystals agree: left alone
+ * the ring slowly fills or empties until it drops or repeats samples. The refill interrupt
+ * averages the ring's fill level, interpolator position included, over BB_FILLFRAMES
+ * frames (bbfill), and AsrcUpdate() runs a proportional plus integral loop on its error
+ * that trims the interpolator's step through CMD_RATIO, submitted as a trim (cmd.h) so the
+ * updates stay out of the session record. The integrator is then the drift between the
+ * two clocks. The target is the first average after the ring is primed to half full, so
+ * the loop starts without an error whatever the packets do to the average.
+ *
+ * The plant is an integrator, the fill moves at the link rate times the step's error, so
+ * the loop is second order (zeta 0.707). It acquires at ASRC_WN, quick enough to take up a
+ * step of ASRC_RANGE ppm within half the ring, and narrows to ASRC_TRACKWN once locked.
+ * The ring is only seen once a refill, so packets arriving every few refills alias to a
+ * slow wander of the average fill as the two clocks slide past each other; the narrow loop
+ * leaves that be rather than frequency modulating the output with it. The packets only need
+ * to be well under half the ring. It runs in thread context and is target independent,
+ * "sim asrc" runs it against a sender with a drifting clock.
+ */
+
+//Loop natural frequency while acquiring and once locked, mrad/s
+#define ASRC_WN			500
+#define ASRC_TRACKWN	100
+
+//Largest drift the step is trimmed by either way, ppm, and as 2^-32 of the step
+#define ASRC_RANGE		1000
+#define ASRC_MAXADJ		((int32_t)(ASRC_RANGE*4294967296ULL/1000000))
+
+//Locked once the average fill has been within ASRC_LOCKTOL (1/256 samples) of the target
+//for ASRC_LOCKUPDATES updates running (5.6s, two time constants of the acquiring loop so
+//the drift is mostly found before the loop narrows), unlocked again at twice that
+#define ASRC_LOCKTOL		512
+#define ASRC_LOCKUPDATES	256
+
+//Loop states
+#define ASRC_OFF		0
+#define ASRC_ACQUIRE	1
+#define ASRC_LOCKED		2
+#define ASRC_RAIL		3	//Drift beyond ASRC_RANGE, the step is at its limit
+
+//For reading out with the debugger
+extern volatile uint8_t asrcstate;
+extern int32_t asrcdrift;		//Step trim, 2^-32 of the nominal step (4295 per ppm), the
+								//link's clock fast positive
+extern int32_t asrcfill;		//Last average fill, 1/256 samples
+extern int32_t asrctarget;		//and the fill it is held at
+extern uint32_t asrcupdates;	//Loop updates since AsrcStart()
+
+uint8_t AsrcStart(uint32_t ifreq, uint32_t linkrate);
+void AsrcStop(void);
+uint8_t AsrcUpdate(void);
+
+#endif
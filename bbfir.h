@@ -0,0 +1,134 @@
+//Generated by tools/bbfir.py, do not edit
+
+//8 taps, 128 phases, Kaiser windowed sinc, cutoff 0.42 of the link rate, beta 7
+static const int16_t bbfir[129][8] = {
+	{403, -1857, 4088, 27500, 4088, -1857, 403, 0},
+	{396, -1813, 3892, 27512, 4289, -1903, 410, -15},
+	{389, -1768, 3697, 27503, 4492, -1947, 417, -15},
+	{382, -1723, 3504, 27493, 4696, -1992, 424, -16},
+	{374, -1678, 3314, 27477, 4903, -2037, 431, -16},
+	{367, -1633, 3126, 27457, 5111, -2081, 438, -17},
+	{360, -1588, 2941, 27432, 5322, -2126, 444, -17},
+	{352, -1543, 2758, 27403, 5535, -2170, 451, -18},
+	{345, -1499, 2577, 27369, 5750, -2213, 457, -18},
+	{337, -1454, 2399, 27332, 5967, -2257, 463, -19},
+	{330, -1410, 2224, 27289, 6185, -2300, 469, -19},
+	{322, -1366, 2051, 27243, 6406, -2343, 475, -20},
+	{315, -1322, 1881, 27189, 6629, -2385, 481, -20},
+	{307, -1278, 1714, 27133, 6853, -2427, 487, -21},
+	{300, -1235, 1549, 27072, 7079, -2468, 492, -21},
+	{292, -1191, 1387, 27006, 7307, -2509, 497, -21},
+	{285, -1148, 1228, 26937, 7536, -2550, 502, -22},
+	{278, -1106, 1071, 26863, 7767, -2590, 507, -22},
+	{270, -1064, 917, 26787, 7999, -2629, 511, -23},
+	{263, -1022, 766, 26703, 8233, -2668, 516, -23},
+	{256, -980, 617, 26615, 8469, -2706, 520, -23},
+	{248, -939, 472, 26525, 8705, -2743, 523, -23},
+	{241, -898, 329, 26430, 8943, -2780, 527, -24},
+	{234, -858, 189, 26331, 9182, -2816, 530, -24},
+	{227, -818, 52, 26226, 9423, -2851, 533, -24},
+	{220, -779, -83, 26119, 9664, -2885, 536, -24},
+	{213, -740, -214, 26007, 9907, -2919, 538, -24},
+	{206, -701, -343, 25890, 10150, -2951, 541, -24},
+	{199, -663, -469, 25771, 10394, -2982, 542, -24},
+	{193, -626, -592, 25646, 10640, -3013, 544, -24},
+	{186, -589, -712, 25518, 10886, -3042, 545, -24},
+	{180, -552, -830, 25387, 11132, -3071, 546, -24},
+	{173, -516, -944, 25250, 11380, -3098, 546, -23},
+	{167, -481, -1056, 25111, 11628, -3124, 546, -23},
+	{160, -446, -1165, 24969, 11876, -3149, 546, -23},
+	{154, -411, -1271, 24821, 12125, -3173, 545, -22},
+	{148, -378, -1374, 24671, 12374, -3195, 544, -22},
+	{142, -345, -1475, 24519, 12624, -3217, 542, -22},
+	{136, -312, -1572, 24359, 12874, -3237, 541, -21},
+	{130, -280, -1667, 24198, 13124, -3255, 538, -20},
+	{125, -249, -1759, 24034, 13374, -3272, 535, -20},
+	{119, -218, -1848, 23866, 13624, -3288, 532, -19},
+	{114, -188, -1934, 23694, 13874, -3302, 528, -18},
+	{108, -158, -2018, 23520, 14124, -3315, 524, -17},
+	{103, -129, -2099, 23341, 14374, -3326, 520, -16},
+	{98, -101, -2177, 23160, 14623, -3335, 515, -15},
+	{93, -73, -2252, 22976, 14872, -3343, 509, -14},
+	{88, -46, -2325, 22789, 15121, -3349, 503, -13},
+	{83, -20, -2395, 22600, 15369, -3354, 496, -11},
+	{79, 6, -2462, 22406, 15617, -3357, 489, -10},
+	{74, 31, -2527, 22210, 15864, -3358, 482, -8},
+	{70, 56, -2589, 22011, 16110, -3357, 474, -7},
+	{65, 80, -2648, 21810, 16355, -3354, 465, -5},
+	{61, 103, -2705, 21607, 16600, -3350, 456, -4},
+	{57, 125, -2759, 21401, 16843, -3343, 446, -2},
+	{53, 147, -2811, 21193, 17086, -3335, 435, 0},
+	{49, 169, -2860, 20980, 17327, -3324, 425, 2},
+	{45, 189, -2907, 20768, 17568, -3312, 413, 4},
+	{42, 209, -2951, 20550, 17807, -3297, 401, 7},
+	{38, 229, -2992, 20332, 18045, -3281, 388, 9},
+	{35, 247, -3032, 20113, 18281, -3262, 375, 11},
+	{32, 266, -3069, 19889, 18516, -3241, 361, 14},
+	{28, 283, -3103, 19665, 18749, -3218, 347, 17},
+	{25, 300, -3135, 19439, 18981, -3193, 332, 19},
+	{22, 316, -3165, 19211, 19211, -3165, 316, 22},
+	{19, 332, -3193, 18981, 19439, -3135, 300, 25},
+	{17, 347, -3218, 18749, 19665, -3103, 283, 28},
+	{14, 361, -3241, 18516, 19889, -3069, 266, 32},
+	{11, 375, -3262, 18281, 20113, -3032, 247, 35},
+	{9, 388, -3281, 18045, 20332, -2992, 229, 38},
+	{7, 401, -3297, 17807, 20550, -2951, 209, 42},
+	{4, 413, -3312, 17568, 20768, -2907, 189, 45},
+	{2, 425, -3324, 17327, 20980, -2860, 169, 49},
+	{0, 435, -3335, 17086, 21193, -2811, 147, 53},
+	{-2, 446, -3343, 16843, 21401, -2759, 125, 57},
+	{-4, 456, -3350, 16600, 21607, -2705, 103, 61},
+	{-5, 465, -3354, 16355, 21810, -2648, 80, 65},
+	{-7, 474, -3357, 16110, 22011, -2589, 56, 70},
+	{-8, 482, -3358, 15864, 22210, -2527, 31, 74},
+	{-10, 489, -3357, 15617, 22406, -2462, 6, 79},
+	{-11, 496, -3354, 15369, 22600, -2395, -20, 83},
+	{-13, 503, -3349, 15121, 22789, -2325, -46, 88},
+	{-14, 509, -3343, 14872, 22976, -2252, -73, 93},
+	{-15, 515, -3335, 14623, 23160, -2177, -101, 98},
+	{-16, 520, -3326, 14374, 23341, -2099, -129, 103},
+	{-17, 524, -3315, 14124, 23520, -2018, -158, 108},
+	{-18, 528, -3302, 13874, 23694, -1934, -188, 114},
+	{-19, 532, -3288, 13624, 23866, -1848, -218, 119},
+	{-20, 535, -3272, 13374, 24034, -1759, -249, 125},
+	{-20, 538, -3255, 13124, 24198, -1667, -280, 130},
+	{-21, 541, -3237, 12874, 24359, -1572, -312, 136},
+	{-22, 542, -3217, 12624, 24519, -1475, -345, 142},
+	{-22, 544, -3195, 12374, 24671, -1374, -378, 148},
+	{-22, 545, -3173, 12125, 24821, -1271, -411, 154},
+	{-23, 546, -3149, 11876, 24969, -1165, -446, 160},
+	{-23, 546, -3124, 11628, 25111, -1056, -481, 167},
+	{-23, 546, -3098, 11380, 25250, -944, -516, 173},
+	{-24, 546, -3071, 11132, 25387, -830, -552, 180},
+	{-24, 545, -3042, 10886, 25518, -712, -589, 186},
+	{-24, 544, -3013, 10640, 25646, -592, -626, 193},
+	{-24, 542, -2982, 10394, 25771, -469, -663, 199},
+	{-24, 541, -2951, 10150, 25890, -343, -701, 206},
+	{-24, 538, -2919, 9907, 26007, -214, -740, 213},
+	{-24, 536, -2885, 9664, 26119, -83, -779, 220},
+	{-24, 533, -2851, 9423, 26226, 52, -818, 227},
+	{-24, 530, -2816, 9182, 26331, 189, -858, 234},
+	{-24, 527, -2780, 8943, 26430, 329, -898, 241},
+	{-23, 523, -2743, 8705, 26525, 472, -939, 248},
+	{-23, 520, -2706, 8469, 26615, 617, -980, 256},
+	{-23, 516, -2668, 8233, 26703, 766, -1022, 263},
+	{-23, 511, -2629, 7999, 26787, 917, -1064, 270},
+	{-22, 507, -2590, 7767, 26863, 1071, -1106, 278},
+	{-22, 502, -2550, 7536, 26937, 1228, -1148, 285},
+	{-21, 497, -2509, 7307, 27006, 1387, -1191, 292},
+	{-21, 492, -2468, 7079, 27072, 1549, -1235, 300},
+	{-21, 487, -2427, 6853, 27133, 1714, -1278, 307},
+	{-20, 481, -2385, 6629, 27189, 1881, -1322, 315},
+	{-20, 475, -2343, 6406, 27243, 2051, -1366, 322},
+	{-19, 469, -2300, 6185, 27289, 2224, -1410, 330},
+	{-19, 463, -2257, 5967, 27332, 2399, -1454, 337},
+	{-18, 457, -2213, 5750, 27369, 2577, -1499, 345},
+	{-18, 451, -2170, 5535, 27403, 2758, -1543, 352},
+	{-17, 444, -2126, 5322, 27432, 2941, -1588, 360},
+	{-17, 438, -2081, 5111, 27457, 3126, -1633, 367},
+	{-16, 431, -2037, 4903, 27477, 3314, -1678, 374},
+	{-16, 424, -1992, 4696, 27493, 3504, -1723, 382},
+	{-15, 417, -1947, 4492, 27503, 3697, -1768, 389},
+	{-15, 410, -1903, 4289, 27512, 3892, -1813, 396},
+	{0, 403, -1857, 4088, 27500, 4088, -1857, 403},
+};
@@ -0,0 +1,160 @@
+#include "cmd.h"
+#include "generator.h"
+
+//Submitted commands, written by CmdSubmit() and drained by CmdApply()
+static Cmd cmdq[CMD_QUEUESIZ];
+static volatile uint8_t cmdhead = 0, cmdtail = 0;
+
+//Session record
+Cmd cmdlog[CMD_LOGSIZ];
+volatile uint16_t cmdlogn = 0;
+volatile uint8_t cmdlogfull = 0;
+
+//Trims applied and left out of the record
+volatile uint32_t cmdtrims = 0;
+
+//Scaled wavetables seen by the last block, to spot background swaps, and whether each
+//channel's waveform or amplitude was last set by a trim, whose swaps aren't recorded
+static const int16_t *lastwt[2] = {0, 0};
+static uint8_t trimwt[2] = {0, 0};
+
+//Fractional modulus from CMD_TUNEFRAC, taken by the next CMD_TUNE
+static uint32_t tunefa = 0, tunefb = 0;
+
+//Retunes seen by the last block, to spot clock failovers
+static uint8_t lastretunes = 0;
+
+//Queue a command, returns 0 if the queue is full. Called from thread context.
+uint8_t CmdSubmit(uint8_t op, uint8_t n, uint16_t w, uint32_t a, uint32_t b){
+	uint8_t h = cmdhead, next = (h+1)&(CMD_QUEUESIZ-1);
+
+	if(next == cmdtail) return 0;
+	cmdq[h].op = op;
+	cmdq[h].n = n;
+	cmdq[h].w = w;
+	cmdq[h].a = a;
+	cmdq[h].b = b;
+	cmdhead = next;
+	return 1;
+}
+
+//Free queue entries, for callers that need a group of commands applied together
+uint8_t CmdSpace(void){
+	return (cmdtail - cmdhead - 1)&(CMD_QUEUESIZ-1);
+}
+
+//Append to the record, stamped with the frame about to be generated
+static void CmdRecord(Cmd *c){
+	if(cmdlogn == CMD_LOGSIZ){
+		cmdlogfull = 1;
+		return;
+	}
+	c->frame = genframes;
+	cmdlog[cmdlogn++] = *c;
+}
+
+//Carry out one command
+void CmdExec(const Cmd *c){
+	switch(c->op & ~CMD_TRIM){
+	case CMD_FREQ:
+		SetFrequency(c->a);
+		break;
+	case CMD_AMPL:
+		SetAmplitude(c->a);
+		break;
+	case CMD_HOP:
+		HopConfig(c->a>>16, c->a&0xFFFF, c->n, c->w, c->b);
+		break;
+	case CMD_HOPSTOP:
+		HopStop();
+		break;
+	case CMD_UPCONV:
+		UpconvStart(c->a, c->b);
+		break;
+	case CMD_UPCONVSTOP:
+		UpconvStop();
+		break;
+	case CMD_DUAL:
+		if(c->n) DualStart();
+		else DualStop();
+		break;
+	case CMD_CHFREQ:
+		SetChanFrequency(c->n, c->a);
+		break;
+	case CMD_CHWAVE:
+		SetChanWave(c->n, c->w, c->a);
+		break;
+	case CMD_TUNEFRAC:
+		tunefa = c->a;
+		tunefb = c->b;
+		break;
+	case CMD_TUNE:
+		SetTuning(c->n, c->a, tunefa, tunefb);
+		tunefa = tunefb = 0;
+		break;
+	case CMD_PULSE:
+		PulseConfig(c->a, c->b, (int16_t)c->w, c->n);
+		break;
+	case CMD_PULSESTOP:
+		PulseStop();
+		break;
+	case CMD_SKEW:
+		SetSkew((int32_t)c->a);
+		break;
+	case CMD_RATIO:
+		UpconvRatio(c->a);
+		break;
+	}
+}
+
+//Apply queued commands, called by the refill stage before each Populate()
+void CmdApply(void){
+	const int16_t *wt;
+	uint32_t tag;
+	uint8_t t = cmdtail, n, op;
+	Cmd ev, *c;
+
+	//WCET-BOUND: 2
+	for(n = 0; n<2; n++){
+		wt = chwt[n];
+		if(wt != lastwt[n]){
+			//The first block just notes the boot tables. The table's own tag, rather than
+			//waveactive, stays right if a second swap has started since.
+			if(lastwt[n] && !trimwt[n]){
+				tag = TableTag(wt);
+				ev.op = EV_SWAP;
+				ev.n = n;
+				ev.w = tag>>16;
+				ev.a = tag&0xFFFF;
+				ev.b = 0;
+				CmdRecord(&ev);
+			}
+			lastwt[n] = wt;
+		}
+	}
+
+	//A retune a clock failover pended takes effect on this block
+	GenRetuneApply();
+	if(genretunes != lastretunes){
+		ev.op = EV_CLOCK;
+		ev.n = 0;
+		ev.w = 0;
+		ev.a = genfs;
+		lastretunes = genretunes;
+		ev.b = 0;
+		CmdRecord(&ev);
+	}
+
+	//WCET-BOUND: CMD_PERBLOCK
+	for(n = 0; n<CMD_PERBLOCK && t != cmdhead; n++){
+		c = &cmdq[t];
+		CmdExec(c);
+		op = c->op & ~CMD_TRIM;
+		if(op == CMD_AMPL) trimwt[0] = c->op & CMD_TRIM;
+		if(op == CMD_CHWAVE) trimwt[c->n&1] = c->op & CMD_TRIM;
+		if(c->op & CMD_TRIM) cmdtrims++;
+		else CmdRecord(c);
+		t = (t+1)&(CMD_QUEUESIZ-1);
+	}
+	cmdtail = t;
+}
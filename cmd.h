@@ -0,0 +1,77 @@
+#ifndef CMD_H
+#define CMD_H
+
+#include <stdint.h>
+
+/*
+ * Command path. Every control change goes through CmdSubmit() and is applied by the refill
+ * stage at the start of a block, so each one takes effect on an exact frame. Applied
+ * commands (and scaled wavetable swaps and clock failovers, which happen outside it) are
+ * recorded with that frame number. The host simulator replays the record against the
+ * same generator code to reproduce the output bit for bit, see "sim replay" in sim/sim.c.
+ *
+ * Control loops (ALC, tracking, ASRC) trim the generator every few blocks and submit with
+ * CMD_TRIM set on the op: applied the same, but neither the trim nor a table swap it causes
+ * is recorded, so a loop can't fill the record in a second and stop it. cmdtrims counts
+ * them, a record with trims in between replays the commands but not the loops' output.
+ *
+ * To pull a record off a board, stop it in the debugger and dump cmdlog, e.g. in gdb:
+ *     dump binary memory session.log &cmdlog[0] &cmdlog[cmdlogn]
+ */
+
+//Commands waiting to be applied, must be a power of two
+#define CMD_QUEUESIZ	8
+
+//Most commands applied per block, bounds the time spent in the interrupt
+#define CMD_PERBLOCK	2
+
+//Recorded entries, recording stops (cmdlogfull set) when this is reached
+#define CMD_LOGSIZ		64
+
+//Command ops
+#define CMD_FREQ		1	//a = frequency in Hz
+#define CMD_AMPL		2	//a = amplitude, Q15
+#define CMD_HOP			3	//a = base<<16 | spacing Hz, b = seed, n = channels, w = dwell
+#define CMD_HOPSTOP		4
+#define CMD_UPCONV		5	//a = IF in Hz, b = interpolator step, see UpconvStep()
+#define CMD_UPCONVSTOP	6
+#define CMD_DUAL		7	//n = 1 for independent channels, 0 for quadrature
+#define CMD_CHFREQ		8	//n = channel, a = frequency in Hz
+#define CMD_CHWAVE		9	//n = channel, w = waveform, a = amplitude, Q15
+#define CMD_TUNEFRAC	10	//a/b = fractional modulus for the next CMD_TUNE
+#define CMD_TUNE		11	//n = channel, a = tuning word, see SetTuning()
+#define CMD_PULSE		12	//a = PRI and b = pulse width in frames, w = chirp in Hz (signed),
+								//n = phase policy
+#define CMD_PULSESTOP	13
+#define CMD_SKEW		14	//a = Q channel skew in 1/65536 frames (signed)
+#define CMD_RATIO		15	//a = upconversion interpolator step, see UpconvRatio()
+
+//Set on an op by the control loops, applied but not recorded
+#define CMD_TRIM		0x40
+
+//Events, recorded but never submitted
+#define EV_SWAP			0x80	//Scaled wavetable swapped in, n = channel, w = waveform,
+								//a = amplitude
+#define EV_CLOCK		0x81	//Generator retuned after a clock failover, a = sample rate in Hz
+
+//16 bytes with no padding, so a dump from the target reads directly on the host
+typedef struct {
+	uint32_t frame;
+	uint8_t op;
+	uint8_t n;
+	uint16_t w;
+	uint32_t a;
+	uint32_t b;
+} Cmd;
+
+extern Cmd cmdlog[CMD_LOGSIZ];
+extern volatile uint16_t cmdlogn;
+extern volatile uint8_t cmdlogfull;
+extern volatile uint32_t cmdtrims;
+
+uint8_t CmdSubmit(uint8_t op, uint8_t n, uint16_t w, uint32_t a, uint32_t b);
+uint8_t CmdSpace(void);
+void CmdApply(void);
+void CmdExec(const Cmd *c);
+
+#endif
@@ -69,44 +69,82 @@ defined in linker script */
   .type Reset_Handler, %function
 Reset_Handler:
   ldr   r0, =_eram
-  mov   sp, r0          /* set stack pointer */
+  mov   sp, r0          /* set stack pointer, below the warm restart block (retain.h) */
 
-/* Copy the data segment initializers from flash to SRAM */
-  movs r1, #0
-  b LoopCopyDataInit
+/* Start the crystal now, it takes a couple of ms and main() has work to do at HSI until it
+   needs it (ClockStart()) */
+  ldr   r0, =0x40021000   /* RCC */
+  ldr   r1, [r0]          /* CR */
+  ldr   r2, =0x00010000   /* HSEON */
+  orrs  r1, r1, r2
+  str   r1, [r0]
+
+/* Free run SysTick from reset so main() can tell how long startup took */
+  ldr   r0, =0xE000E010
+  ldr   r1, =0x00FFFFFF
+  str   r1, [r0, #4]    /* LOAD */
+  movs  r1, #0
+  str   r1, [r0, #8]    /* VAL */
+  movs  r1, #5          /* CLKSOURCE | ENABLE */
+  str   r1, [r0]
+
+/* Copy the data segment initializers from flash to SRAM, four words a pass through r4-r7
+   while there are that many left, then a word at a time. The sections are word aligned. */
+  ldr   r0, =_sidata
+  ldr   r1, =_sdata
+  ldr   r2, =_edata
+  mov   r3, r2
+  subs  r3, #16
+  b     LoopCopyDataQuad
+
+CopyDataQuad:
+  ldmia r0!, {r4-r7}
+  stmia r1!, {r4-r7}
+
+LoopCopyDataQuad:
+  cmp   r1, r3
+  bls   CopyDataQuad
+  b     LoopCopyDataInit
 
 CopyDataInit:
-  ldr r3, =_sidata
-  ldr r3, [r3, r1]
-  str r3, [r0, r1]
-  adds r1, r1, #4
+  ldmia r0!, {r4}
+  stmia r1!, {r4}
 
 LoopCopyDataInit:
-  ldr r0, =_sdata
-  ldr r3, =_edata
-  adds r2, r0, r1
-  cmp r2, r3
-  bcc CopyDataInit
-  ldr r2, =_sbss
-  b LoopFillZerobss
-/* Zero fill the bss segment. */
-FillZerobss:
-  movs r3, #0
-  str  r3, [r2]
-  adds r2, r2, #4
+  cmp   r1, r2
+  bcc   CopyDataInit
+
+/* Zero fill the bss segment, eight words a pass then a word at a time */
+  ldr   r1, =_sbss
+  ldr   r2, =_ebss
+  mov   r3, r2
+  subs  r3, #32
+  movs  r4, #0
+  movs  r5, #0
+  movs  r6, #0
+  movs  r7, #0
+  b     LoopFillZerobssOct
 
+FillZerobssOct:
+  stmia r1!, {r4-r7}
+  stmia r1!, {r4-r7}
+
+LoopFillZerobssOct:
+  cmp   r1, r3
+  bls   FillZerobssOct
+  b     LoopFillZerobss
+
+FillZerobss:
+  stmia r1!, {r4}
 
 LoopFillZerobss:
-  ldr r3, = _ebss
-  cmp r2, r3
-  bcc FillZerobss
-
-/* Call the clock system intitialization function.*/
-    bl  SystemInit
-    
-/* Call the application's entry point.*/
+  cmp   r1, r2
+  bcc   FillZerobss
+
+/* main() brings the clocks up itself, overlapping the crystal and PLL start with the rest
+   of its setup, so SystemInit() isn't called. The RCC is at its reset values. */
   bl main
-  
+
 LoopForever:
     b LoopForever
 
@@ -0,0 +1,156 @@
+#include "coherent.h"
+#include "generator.h"
+#include "cmd.h"
+
+static uint64_t Gcd(uint64_t a, uint64_t b){
+	uint64_t t;
+
+	while(b){
+		t = a%b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+//Closest fraction to r/q with a denominator under COH_MAXMOD, from the continued fraction
+//of r/q. The last convergent that fits, or the semiconvergent past it if that is closer.
+static void CohApprox(uint64_t r, uint64_t q, uint32_t *fa, uint32_t *fb){
+	uint64_t p0 = 0, p1 = 1, q0 = 1, q1 = 0, a, t, x = r, y = q;
+
+	while(y){
+		a = x/y;
+		if(q1 && a>(COH_MAXMOD - 1 - q0)/q1){
+			//Semiconvergents (k*p1 + p0)/(k*q1 + q0) for k up to a; the largest that fits
+			//beats the last convergent when k is over half of a
+			t = (COH_MAXMOD - 1 - q0)/q1;
+			if(2*t>a){
+				p1 = t*p1 + p0;
+				q1 = t*q1 + q0;
+			}
+			break;
+		}
+		t = a*p1 + p0;
+		p0 = p1;
+		p1 = t;
+		t = a*q1 + q0;
+		q0 = q1;
+		q1 = t;
+
+		t = x%y;
+		x = y;
+		y = t;
+	}
+
+	*fa = p1;
+	*fb = q1;
+}
+
+//Tuning for exactly bin cycles per n sample record at fadc Hz, with the generator at
+//fsnum/fsden Hz. The accumulator steps twice per frame, so each step is
+//bin*fadc/(n*fs)/2 of a cycle, 2^31*bin*fadc*fsden/(n*fsnum) in accumulator LSBs.
+//Returns 0 if the tone is at or over the generator's Nyquist frequency or the numbers are
+//out of range.
+uint8_t CohTune(uint32_t fsnum, uint32_t fsden, uint32_t fadc, uint32_t n, uint32_t bin, CohTone *t){
+	uint64_t num, den, q, r, g;
+	uint8_t sh;
+
+	if(!fsnum || !fsden || !fadc || n<2 || n>COH_MAXRECORD || !bin) return 0;
+
+	g = Gcd(fsnum, fsden);
+	fsnum /= g;
+	fsden /= g;
+	if((uint64_t)fadc*fsden>~0ULL/bin) return 0;
+	num = (uint64_t)bin*fadc*fsden;
+	den = (uint64_t)n*fsnum;
+	g = Gcd(num, den);
+	num /= g;
+	den /= g;
+
+	//Powers of two in the denominator come straight off the 2^31
+	for(sh = 31; sh && !(den&1); sh--) den >>= 1;
+
+	//num*2^sh/den by long division, the whole part must be under 2^30 (Nyquist)
+	q = num/den;
+	r = num%den;
+	if(q>=1UL<<30) return 0;
+	while(sh--){
+		q <<= 1;
+		r <<= 1;
+		if(r>=den){
+			r -= den;
+			q |= 1;
+		}
+	}
+	if(q>=1UL<<30) return 0;
+
+	t->bin = bin;
+	t->mhz = ((uint64_t)bin*fadc*1000 + n/2)/n;
+	t->tw = q;
+	t->exact = 1;
+	if(!r){
+		t->fa = t->fb = 0;
+	}
+	else if(den<COH_MAXMOD){
+		t->fa = r;
+		t->fb = den;
+	}
+	else{
+		CohApprox(r, den, &t->fa, &t->fb);
+		t->exact = 0;
+		if(t->fa == t->fb){
+			t->tw++;
+			t->fa = t->fb = 0;
+		}
+	}
+
+	return 1;
+}
+
+//Plan ntones tones at the bins nearest the requested frequencies (Hz), each co-prime with
+//n, below both Nyquist frequencies and different from the others. Returns 0 if a
+//frequency is over the ADC's Nyquist frequency or no bin fits.
+uint8_t CohPlanTones(uint32_t fsnum, uint32_t fsden, uint32_t fadc, uint32_t n, const uint32_t *freq,
+		uint8_t ntones, CohPlan *p){
+	uint64_t want;
+	uint32_t bin, lo, hi;
+	uint8_t i;
+
+	if(!ntones || ntones>COH_MAXTONES || !fadc || n<4 || n>COH_MAXRECORD) return 0;
+
+	for(i = 0; i<ntones; i++){
+		//Bins either side of the requested frequency (in units of fadc/n Hz), working
+		//outwards taking whichever candidate is closer each time
+		want = (uint64_t)freq[i]*n;
+		if(want>=(uint64_t)fadc*(n/2)) return 0;
+		lo = want/fadc;
+		hi = lo + 1;
+		bin = 0;
+		while(!bin && (lo>=1 || hi<n/2)){
+			if(hi<n/2 && (lo<1 || (uint64_t)hi*fadc - want<want - (uint64_t)lo*fadc)) bin = hi++;
+			else bin = lo--;
+			if(bin>=n/2 || Gcd(bin, n) != 1 || (i && bin == p->tone[0].bin) ||
+					!CohTune(fsnum, fsden, fadc, n, bin, &p->tone[i])) bin = 0;
+		}
+		if(!bin) return 0;
+	}
+
+	p->ntones = ntones;
+	return 1;
+}
+
+//Start a plan through the command queue, so it takes effect on an exact frame. One tone
+//plays in quadrature, two in dual mode. Returns 0 without submitting anything if the
+//queue hasn't room for the whole plan.
+uint8_t CohApply(const CohPlan *p){
+	uint8_t i;
+
+	if(!p->ntones || p->ntones>COH_MAXTONES || CmdSpace()<1 + 2*p->ntones) return 0;
+
+	CmdSubmit(CMD_DUAL, p->ntones>1, 0, 0, 0);
+	for(i = 0; i<p->ntones; i++){
+		CmdSubmit(CMD_TUNEFRAC, 0, 0, p->tone[i].fa, p->tone[i].fb);
+		CmdSubmit(CMD_TUNE, i, 0, p->tone[i].tw, 0);
+	}
+	return 1;
+}
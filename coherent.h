@@ -0,0 +1,51 @@
+#ifndef COHERENT_H
+#define COHERENT_H
+
+#include <stdint.h>
+
+/*
+ * Coherent test signals for ADC characterisation. A tone only avoids spectral leakage in
+ * an ADC's FFT if it completes a whole number of cycles (its bin) in the n sample record,
+ * and the bin should be co-prime with n so every sample lands on a different phase of it.
+ * The planner picks the bin nearest each requested frequency and the tuning word that
+ * gives exactly bin*fadc/n Hz at the achieved I2S rate. That is rarely a whole tuning word,
+ * so the remainder becomes a fractional modulus (tw + fa/fb per accumulator step, see
+ * SetTuning()) which keeps the tone exact over any number of records.
+ *
+ * The I2S rate is a fraction as it isn't always a whole number of Hz (7812.5Hz on HSI).
+ * The two clocks must share a reference for the plan to stay coherent in practice.
+ *
+ * One tone is played in quadrature, two tones use dual mode with one per channel. Runs on
+ * the target without floating point; the planning is 64 bit division heavy so belongs in
+ * thread context, the commands it submits are cheap to apply. sim/coh.c is the host tool.
+ */
+
+//Tones per plan, one per generator channel
+#define COH_MAXTONES	2
+
+//Longest ADC record, keeps the arithmetic within 64 bits
+#define COH_MAXRECORD	65536
+
+//Fractional moduli are kept below this, as SetTuning() needs
+#define COH_MAXMOD		0x80000000UL
+
+typedef struct {
+	uint32_t bin;		//Cycles per record, co-prime with the record length
+	uint32_t mhz;		//Frequency in mHz, rounded
+	uint32_t tw;		//Tuning word, plus fa/fb per step if fb isn't 0
+	uint32_t fa, fb;
+	uint8_t exact;		//0 if the fraction needed a modulus over COH_MAXMOD and was rounded
+						//to the nearest that fits, off by under 2^-62 of a cycle per step
+} CohTone;
+
+typedef struct {
+	uint8_t ntones;
+	CohTone tone[COH_MAXTONES];
+} CohPlan;
+
+uint8_t CohTune(uint32_t fsnum, uint32_t fsden, uint32_t fadc, uint32_t n, uint32_t bin, CohTone *t);
+uint8_t CohPlanTones(uint32_t fsnum, uint32_t fsden, uint32_t fadc, uint32_t n, const uint32_t *freq,
+		uint8_t ntones, CohPlan *p);
+uint8_t CohApply(const CohPlan *p);
+
+#endif
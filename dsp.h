@@ -0,0 +1,95 @@
+#ifndef DSP_H
+#define DSP_H
+
+#include <stdint.h>
+
+/*
+ * Fixed-point DSP kernels shared by the generator and everything around it. All of them
+ * are plain C written for the Cortex-M0: Thumb-1 has MULS (32x32 -> low 32) but no long
+ * multiply, so anything that needs a 64 bit product is built from 16 bit halves rather
+ * than letting the compiler call __aeabi_lmul. The same code builds on the host, and since
+ * only 32 bit integer operations are used the results are bit-exact between the two.
+ * Right shifts of negative values are arithmetic, as they are with GCC on both.
+ *
+ * sim/sim.c "dsp" checks every kernel against a 64 bit reference, main.c BENCHMARK times
+ * them on the target.
+ */
+
+//Saturate to 16 bits
+static inline int16_t Sat16(int32_t x){
+	if(x>32767) return 32767;
+	if(x<-32768) return -32768;
+	return x;
+}
+
+//Saturating 16 and 32 bit add
+static inline int16_t SatAdd16(int16_t a, int16_t b){
+	return Sat16((int32_t)a + b);
+}
+
+static inline int32_t SatAdd32(int32_t a, int32_t b){
+	int32_t s = (int32_t)((uint32_t)a + (uint32_t)b);
+
+	//Overflow only when both operands share a sign the result doesn't have
+	if(((a^s) & (b^s))<0) return a<0 ? INT32_MIN : INT32_MAX;
+	return s;
+}
+
+//Q15 multiply, truncating (floor)
+static inline int16_t Q15Mul(int16_t a, int16_t b){
+	return ((int32_t)a*b)>>15;
+}
+
+//Q15 multiply, rounded and saturated (-1*-1 is the only case that needs it)
+static inline int16_t Q15MulR(int16_t a, int16_t b){
+	return Sat16(((int32_t)a*b + (1<<14))>>15);
+}
+
+//Rounding arithmetic right shift, n>0
+static inline int32_t RShiftR(int32_t x, uint8_t n){
+	return (x + (1L<<(n-1)))>>n;
+}
+
+//High word of an unsigned 32x32 -> 64 bit multiply, four 16x16 partial products
+static inline uint32_t UMulHi32(uint32_t a, uint32_t b){
+	uint32_t al = a&0xFFFF, ah = a>>16, bl = b&0xFFFF, bh = b>>16;
+	uint32_t ll = al*bl, lh = al*bh, hl = ah*bl, hh = ah*bh;
+
+	//Middle column, split so the carry out of bit 31 isn't lost
+	uint32_t mid = (ll>>16) + (lh&0xFFFF) + (hl&0xFFFF);
+
+	return hh + (lh>>16) + (hl>>16) + (mid>>16);
+}
+
+//High word of a signed 32x32 -> 64 bit multiply. The unsigned product is corrected for
+//each negative operand: (a + 2^32)b = ab + 2^32 b.
+static inline int32_t SMulHi32(int32_t a, int32_t b){
+	uint32_t hi = UMulHi32((uint32_t)a, (uint32_t)b);
+
+	if(a<0) hi -= (uint32_t)b;
+	if(b<0) hi -= (uint32_t)a;
+	return (int32_t)hi;
+}
+
+//Q31 multiply, truncating, -1*-1 wraps. The low bit comes from bit 31 of the full
+//product, which is the top bit of the wrapped low word.
+static inline int32_t Q31Mul(int32_t a, int32_t b){
+	uint32_t lo = (uint32_t)a*(uint32_t)b;
+	return (int32_t)(((uint32_t)SMulHi32(a, b)<<1) | (lo>>31));
+}
+
+//Q30 multiply, rounded. The carry out of the rounding add is propagated into the high
+//word.
+static inline int32_t Q30MulR(int32_t a, int32_t b){
+	uint32_t lo = (uint32_t)a*(uint32_t)b + (1UL<<29);
+	int32_t hi = SMulHi32(a, b) + (lo<(1UL<<29));
+	return ((uint32_t)hi<<2) | (lo>>30);
+}
+
+//Linear interpolation from a to b, frac is Q16 in [0, 1). The Q14 fraction keeps the 17
+//bit difference times fraction inside 32 bits.
+static inline int16_t Lerp16(int16_t a, int16_t b, uint32_t frac){
+	return a + ((((int32_t)b - a)*(int32_t)(frac>>2))>>14);
+}
+
+#endif
@@ -0,0 +1,978 @@
+#include "generator.h"
+#include "dsp.h"
+#include "wavepack.h"
+#include "bbfir.h"
+
+//DMA Buffer
+int16_t dmabuf[DMA_BUFSIZ*2] = {0};
+
+//Sinewave wavetable - constant population would reduce SRAM requirements!
+int16_t sinewt[256];
+
+//Pre-scaled wavetables, one per channel plus a spare. Populate() only ever reads a
+//channel's active table, so the inner loop stays a plain lookup. On an amplitude or
+//waveform change the spare is rebuilt from the idle loop and swapped with the channel's
+//table once it is complete - a single word store, so the DMA interrupt sees either the old
+//table or the new one. In quadrature mode both outputs use channel 0's table.
+int16_t scaledwt[3][256];
+int16_t * volatile chwt[2] = {scaledwt[0], scaledwt[1]};
+
+//Waveform<<16 | amplitude each scaled table was built for, see TableTag()
+static uint32_t scaledtag[3];
+
+//Keeps the compiler from moving the stores describing a table past the one that swaps it
+//in, the refill stage can pre-empt between any two
+#define SwapBarrier()	__asm__ volatile("" ::: "memory")
+
+//Requested waveform and amplitude per channel, and those of the active tables
+volatile uint16_t ampltarget[2] = {AMPLITUDE, AMPLITUDE};
+volatile uint8_t wavetarget[2] = {WAVE_SINE, WAVE_SINE};
+uint16_t amplactive[2] = {AMPLITUDE, AMPLITUDE};
+uint8_t waveactive[2] = {WAVE_SINE, WAVE_SINE};
+
+//Background rebuild - channel being rebuilt (REGEN_IDLE if none), progress through the
+//spare table and what it is being built for
+#define REGEN_IDLE	0xFF
+uint8_t regench = REGEN_IDLE, regenwave;
+uint16_t regenpos, regenampl;
+
+//Phase accumulators and tuning words, the second pair is only used in dual mode
+//tw = Tuning word, waves are generated using DDS: http://interface.khm.de/index.php/lab/interfaces-advanced/arduino-dds-sinewave-generator/
+uint32_t phac = 0, phac2 = 0;
+volatile uint32_t tw = TW_PER_HZ*FREQOUT, tw2 = TW_PER_HZ*FREQOUT;
+
+//Fractional modulus per channel, each accumulator step is tw + twfa/twfb with the fraction
+//carried in twfacc and added once per block. twfb is 0 when the tuning word is exact.
+//twfq and twfr are the whole and remaining part of a block's worth of fraction.
+static uint32_t twfa[2], twfb[2], twfacc[2], twfq[2], twfr[2];
+
+//Achieved sample rate and the tuning word per Hz at that rate, only differ from FS and
+//TW_PER_HZ after GenRetune()
+volatile uint32_t genfs = FS;
+uint32_t twperhz = TW_PER_HZ;
+
+//Number of retunes applied, each one is logged even if the rate came out the same
+volatile uint8_t genretunes = 0;
+
+volatile uint32_t genframes = 0;
+
+volatile uint8_t genmode = GEN_QUAD;
+
+//Baseband receive ring for upconversion, filled by BBPush() from the control link and
+//emptied by Populate(). After a start or an underrun nothing is taken from it until it is
+//back to bbwant samples, half full.
+int16_t bbring[BB_RINGSIZ][2];
+volatile uint16_t bbhead = 0, bbtail = 0;
+volatile uint32_t bbunderruns = 0, bboverruns = 0;
+static uint16_t bbwant;
+
+//Polyphase interpolator over the last BB_TAPS baseband samples. Each one is written twice,
+//BB_TAPS pairs apart, so the taps are always a straight run from bbhpos, oldest first.
+//bbfrac is the position between the middle two (Q32) and advances by bbstep = link
+//rate/genfs every frame. Its top bits pick the phase and the next 15 interpolate the taps
+//between that phase and the next.
+static int16_t bbhist[2*BB_TAPS*2];
+static uint8_t bbhpos;
+uint32_t bbfrac, bbstep;
+
+typedef char BBFirSize[sizeof(bbfir) == (BB_PHASES+1)*BB_TAPS*2 ? 1 : -1];
+
+//Fill level sum over the frames so far, and the last complete average
+static int32_t bbfillsum;
+static uint32_t bbfillframes;
+volatile int32_t bbfill;
+volatile uint32_t bbfillseq;
+
+//Hop plan, tuning words are stored in hop order so a hop is just a table read
+uint32_t hoptw[HOP_MAXCHAN];
+uint16_t hopn = 0, hopidx;
+uint32_t hopdwell, hopleft;
+static volatile uint8_t hopen = 0;
+
+//Q (right) channel skew, see SetSkew()
+static int32_t genskew = 0;
+
+//Pulsed mode. pulsepos is the frame within the PRI, the pulse is its first pulsewidth
+//frames. Each pulse starts at pulsetw and sweeps by pulsestep per frame if chirped.
+//pulseref is an accumulator at pulsetw that never stops, the coherent phase policy starts
+//each pulse from it.
+static volatile uint8_t pulseen = 0;
+static uint8_t pulsepolicy;
+static uint32_t pulsepri, pulsewidth, pulsepos, pulsetw, pulseref;
+static int32_t pulsestep;
+
+//Sine recurrence constants in Q30: 2cos(2pi/256) and sin(2pi/256)
+#define SINREC_K	2146836866L
+#define SINREC_S1	26350943L
+
+//Bias added before truncating to the table, covers the recurrence's rounding error so
+//exact values (sin(pi/2) = 1) don't fall one short. Worth 0.008 of a table LSB.
+#define SINREC_BIAS	256
+
+//Build the sine wavetable and the initial scaled copy. The first quarter comes from the
+//recurrence sin((n+1)x) = 2cos(x)sin(nx) - sin((n-1)x) in Q30, the rest by symmetry, so no
+//floating point or libm is needed. Matches 32767*sin() truncated toward zero.
+void GenInit(void){
+	int32_t s0 = 0, s1 = SINREC_S1, s2;
+	uint16_t n;
+
+	for(n = 0; n<=64; n++){
+		//16bit wavetable, 2^(16-1)-1 ~= +32767 to -32767. s0 is Q30, so the Q30 product
+		//with 32767 is the high word of s0*(32767<<2)
+		sinewt[n] = UMulHi32(s0 + SINREC_BIAS, 32767UL<<2);
+		sinewt[128-n] = sinewt[n];
+
+		s2 = Q30MulR(SINREC_K, s1) - s0;
+		s0 = s1;
+		s1 = s2;
+	}
+	for(n = 128; n<256; n++){
+		sinewt[n] = -sinewt[n-128];
+	}
+
+	for(n = 0; n<256; n++){
+		scaledwt[0][n] = scaledwt[1][n] = Q15Mul(sinewt[n], AMPLITUDE);
+	}
+	scaledtag[0] = scaledtag[1] = (uint32_t)WAVE_SINE<<16 | AMPLITUDE;
+
+	//Both channels back on them as at reset, the host tools start over with GenInit()
+	regench = REGEN_IDLE;
+	for(n = 0; n<2; n++){
+		wavetarget[n] = waveactive[n] = WAVE_SINE;
+		ampltarget[n] = amplactive[n] = AMPLITUDE;
+		chwt[n] = scaledwt[n];
+	}
+}
+
+//Unscaled waveform value at table index n, full scale is +-32767 and every waveform
+//starts at zero phase like the sine
+static int16_t WaveSample(uint8_t wave, uint16_t n){
+	int16_t v;
+
+	switch(wave){
+	case WAVE_TRIANGLE:
+		v = n<=64 ? n : n<=192 ? 128-n : n-256;
+		return (v*32767L)>>6;
+	case WAVE_SAW:
+		v = n<128 ? n : n-256;
+		return (v*32767L)>>7;
+	case WAVE_SQUARE:
+		return n<128 ? 32767 : -32767;
+	default:
+		return sinewt[n];
+	}
+}
+
+//Fill part of a scaled table. Library waveforms are expanded from flash a block at a time,
+//REGEN_CHUNK is a multiple of WP_BLOCK so a background rebuild step decodes whole blocks.
+static void BuildTable(int16_t *dst, uint8_t wave, uint16_t ampl, uint16_t from, uint16_t to){
+	int16_t blk[WP_BLOCK];
+	uint16_t n;
+
+	if(wave>=WAVE_LIB){
+		for(n = from; n<to; n++){
+			if(n == from || !(n&(WP_BLOCK-1))) WavePackBlock(&wavelib[wave-WAVE_LIB], n/WP_BLOCK, blk);
+			dst[n] = Q15Mul(blk[n&(WP_BLOCK-1)], ampl);
+		}
+		return;
+	}
+
+	for(n = from; n<to; n++){
+		dst[n] = Q15Mul(WaveSample(wave, n), ampl);
+	}
+}
+
+//The table neither channel is using
+static int16_t *SpareTable(void){
+	int16_t *a = chwt[0], *b = chwt[1];
+
+	if(a != scaledwt[0] && b != scaledwt[0]) return scaledwt[0];
+	if(a != scaledwt[1] && b != scaledwt[1]) return scaledwt[1];
+	return scaledwt[2];
+}
+
+//Make a complete table a channel's active one. Everything describing it is stored first,
+//so a refill that sees the new table also sees what it was built for.
+static void SwapIn(uint8_t ch, int16_t *wt, uint8_t wave, uint16_t ampl){
+	scaledtag[(wt - scaledwt[0])>>8] = (uint32_t)wave<<16 | ampl;
+	waveactive[ch] = wave;
+	amplactive[ch] = ampl;
+	SwapBarrier();
+	chwt[ch] = wt;
+}
+
+//Waveform<<16 | amplitude a scaled table was built for. For the refill stage, where the
+//table it has just latched can't be rebuilt under it.
+uint32_t TableTag(const int16_t *wt){
+	return scaledtag[(wt - scaledwt[0])>>8];
+}
+
+//Accumulator offset that moves the right channel by the skew, for a phase that advances by
+//perframe every frame. Exact for anything periodic in the table, as long as the frequency
+//holds for the run.
+static inline uint32_t SkewOffset(int32_t perframe){
+	return SMulHi32(perframe, (int32_t)((uint32_t)genskew<<16));
+}
+
+//Generate a run of frames at the current tuning word
+static inline void Render(int16_t *dst, uint32_t frames, const int16_t *wt){
+	uint32_t ph = phac;
+	const uint32_t inc = tw, qo = SkewOffset(inc<<1);
+
+	//WCET-TOTAL: DMA_BUFSIZ/2
+	while(frames--){
+		//Left - cosine, 1/4 of a cycle ahead of sine so 256/4 (64) is added. The anding
+		//with 255 ensures the wavetable index wraps
+		*dst++ = wt[((ph>>(32-8)) + 256/4)&255];
+		ph += inc;
+
+		//Right - sine
+		*dst++ = wt[(ph + qo)>>(32-8)];
+		ph += inc;
+	}
+
+	phac = ph;
+}
+
+//Linear FM chirp - as Render() but the tuning word moves by step every frame, and so does
+//the skew offset
+static inline void RenderChirp(int16_t *dst, uint32_t frames, const int16_t *wt, int32_t step){
+	uint32_t ph = phac, inc = tw, qo = SkewOffset(inc<<1);
+	const uint32_t qs = SkewOffset(step*2);
+
+	//WCET-TOTAL: DMA_BUFSIZ/2
+	while(frames--){
+		*dst++ = wt[((ph>>(32-8)) + 256/4)&255];
+		ph += inc;
+		*dst++ = wt[(ph + qo)>>(32-8)];
+		ph += inc;
+		inc += step;
+		qo += qs;
+	}
+
+	phac = ph;
+	tw = inc;
+}
+
+//Move the interpolator on to the next baseband sample. An empty ring holds the taps
+//rather than dropping to zero, until it is refilled to half.
+static inline void BBNext(void){
+	uint16_t t = bbtail;
+	uint8_t p = bbhpos;
+
+	if(((bbhead - t)&(BB_RINGSIZ-1))<bbwant){
+		if(bbwant == 1){
+			bbunderruns++;
+			bbwant = BB_RINGSIZ/2;
+		}
+		return;
+	}
+	bbwant = 1;
+
+	bbhist[2*p] = bbhist[2*(p + BB_TAPS)] = bbring[t][0];
+	bbhist[2*p + 1] = bbhist[2*(p + BB_TAPS) + 1] = bbring[t][1];
+	bbhpos = (p+1)&(BB_TAPS-1);
+	bbtail = (t+1)&(BB_RINGSIZ-1);
+}
+
+//Add a run of frames to the fill level average, in 1/256 samples: what is in the ring less
+//how far the interpolator is towards taking the next one. Averages only cover frames with
+//the ring in use, a refill after an underrun starts over.
+static inline void BBFill(uint32_t frames, uint32_t frac){
+	int32_t fill = (int32_t)(((bbhead - bbtail)&(BB_RINGSIZ-1))<<8) - (int32_t)(frac>>24);
+
+	if(bbwant != 1){
+		bbfillsum = 0;
+		bbfillframes = 0;
+		return;
+	}
+	bbfillsum += fill*(int32_t)frames;
+	bbfillframes += frames;
+	if(bbfillframes>=BB_FILLFRAMES){
+		bbfill = bbfillsum>>BB_LOG2FILLFRAMES;
+		bbfillseq++;
+		bbfillsum = 0;
+		bbfillframes = 0;
+	}
+}
+
+//Dual mode - two independent oscillators, each accumulator steps once per frame
+static inline void RenderDual(int16_t *dst, uint32_t frames, const int16_t *wl, const int16_t *wr){
+	uint32_t pl = phac, pr = phac2;
+	const uint32_t il = tw<<1, ir = tw2<<1, qo = SkewOffset(ir);
+
+	//WCET-TOTAL: DMA_BUFSIZ/2
+	while(frames--){
+		*dst++ = wl[pl>>(32-8)];
+		*dst++ = wr[(pr + qo)>>(32-8)];
+		pl += il;
+		pr += ir;
+	}
+
+	phac = pl;
+	phac2 = pr;
+}
+
+//Upconversion - interpolate the baseband up to FS and multiply by the oscillator as a
+//full complex multiply, (I + jQ)(cos + jsin). Cosine and sine are both taken at the left
+//sample's phase so the pair stays exactly in quadrature. The scaled table gives the output
+//amplitude for free. The skew moves the right channel's carrier only, the baseband is far
+//slower than any skew worth correcting. The interpolator's taps are a straight line
+//between the two phases either side of the position, the nearest phase alone would leave
+//timing noise as loud as the images it is there to remove.
+static inline void RenderMix(int16_t *dst, uint32_t frames, const int16_t *wt){
+	uint32_t ph = phac, frac = bbfrac, f;
+	const uint32_t inc = tw<<1, step = bbstep, qo = SkewOffset(inc);
+	const int16_t *h, *x;
+	int32_t bi, bq, c, s, mu;
+	uint8_t k;
+
+	BBFill(frames, frac);
+
+	//WCET-TOTAL: DMA_BUFSIZ/2
+	while(frames--){
+		//Taps are Q15 and each phase sums to one, an overshoot past full scale saturates
+		h = bbfir[frac>>(32-BB_LOG2PHASES)];
+		mu = (frac>>(32-BB_LOG2PHASES-15))&0x7FFF;
+		x = &bbhist[2*bbhpos];
+		bi = bq = 0;
+		//WCET-BOUND: BB_TAPS
+		for(k = 0; k<BB_TAPS; k++){
+			c = h[k] + (((h[k + BB_TAPS] - h[k])*mu)>>15);
+			bi += c*x[2*k];
+			bq += c*x[2*k + 1];
+		}
+		bi = Sat16(bi>>15);
+		bq = Sat16(bq>>15);
+
+		//Q15*Q15 products, the sum of two can't overflow 32 bits but can exceed Q15
+		c = wt[((ph>>(32-8)) + 256/4)&255];
+		s = wt[ph>>(32-8)];
+		*dst++ = Sat16((bi*c - bq*s)>>15);
+		c = wt[(((ph + qo)>>(32-8)) + 256/4)&255];
+		s = wt[(ph + qo)>>(32-8)];
+		*dst++ = Sat16((bi*s + bq*c)>>15);
+
+		//A carry out of the position is the next baseband sample
+		ph += inc;
+		f = frac + step;
+		if(f<frac) BBNext();
+		frac = f;
+	}
+
+	phac = ph;
+	bbfrac = frac;
+}
+
+//Generate a run of frames in the current mode. A null dst just advances the accumulators.
+static inline void RenderRun(int16_t *dst, uint32_t frames, const int16_t *wl, const int16_t *wr){
+	if(!dst){
+		phac += (tw<<1)*frames;
+		if(genmode == GEN_DUAL) phac2 += (tw2<<1)*frames;
+	}
+	else if(genmode == GEN_DUAL) RenderDual(dst, frames, wl, wr);
+	else if(genmode == GEN_UPCONV) RenderMix(dst, frames, wl);
+	else Render(dst, frames, wl);
+}
+
+//Generate frames into dst, or skip them if dst is null
+static void Generate(int16_t *dst, uint32_t frames){
+	//Latch the active tables once so a swap can't happen part way through a block
+	const int16_t *wl = chwt[0], *wr = chwt[1];
+	uint32_t run, n;
+
+	if(pulseen){
+		//Split the block at pulse edges. Off time is a block fill with the oscillator left
+		//alone, only the reference accumulator moves on. The bound is for Populate(),
+		//every run but the last ends at an edge and pulses and gaps are a frame or more.
+		//WCET-BOUND: DMA_BUFSIZ/2
+		while(frames){
+			if(pulsepos == 0){
+				tw = pulsetw;
+				phac = pulsepolicy == PULSE_COHERENT ? pulseref : 0;
+			}
+
+			if(pulsepos<pulsewidth){
+				run = pulsewidth - pulsepos;
+				if(run>frames) run = frames;
+				if(!pulsestep){
+					RenderRun(dst, run, wl, wr);
+				}
+				else if(dst){
+					RenderChirp(dst, run, wl, pulsestep);
+				}
+				else{
+					//Sum of the swept increments over the run, modulo 2^32
+					phac += (tw<<1)*run + pulsestep*run*(run-1);
+					tw += pulsestep*run;
+				}
+			}
+			else{
+				run = pulsepri - pulsepos;
+				if(run>frames) run = frames;
+				if(dst){
+					//A frame at a time, caller buffers from GenRender() are only
+					//halfword aligned. The bound is for Populate().
+					n = run;
+					//WCET-TOTAL: DMA_BUFSIZ/2
+					while(n--){
+						dst[2*n] = 0;
+						dst[2*n + 1] = 0;
+					}
+				}
+			}
+
+			pulseref += (pulsetw<<1)*run;
+			if(dst) dst += 2*run;
+			frames -= run;
+			pulsepos += run;
+			if(pulsepos == pulsepri) pulsepos = 0;
+		}
+	}
+	else if(!hopen){
+		RenderRun(dst, frames, wl, wr);
+	}
+	else{
+		//Split the block at hop boundaries. Only the tuning word changes at a hop, the
+		//accumulator carries on so the output is phase continuous. A zero length run only
+		//happens on the first block after HopConfig(). The bound is for Populate().
+		//WCET-BOUND: DMA_BUFSIZ/2+1
+		while(frames){
+			run = hopleft<frames ? hopleft : frames;
+			RenderRun(dst, run, wl, wr);
+			if(dst) dst += 2*run;
+			frames -= run;
+			hopleft -= run;
+
+			if(hopleft == 0){
+				tw = hoptw[hopidx];
+				if(++hopidx == hopn) hopidx = 0;
+				hopleft = hopdwell;
+			}
+		}
+	}
+}
+
+//Carry a block's worth of fractional modulus into a channel's accumulator. Only compares
+//and adds, the division was done by SetTuning().
+static inline void FracBlock(uint8_t ch){
+	uint32_t carry = twfq[ch], room = twfb[ch] - twfr[ch];
+
+	if(!twfb[ch]) return;
+	//twfacc + twfr can overflow, compare against what's left to the modulus instead
+	if(twfacc[ch]>=room){
+		twfacc[ch] -= room;
+		carry++;
+	}
+	else{
+		twfacc[ch] += twfr[ch];
+	}
+
+	if(ch) phac2 += carry;
+	else phac += carry;
+}
+
+//The same for any number of frames, for the host tools. Uses a 64 bit division so is
+//kept out of the DMA interrupt.
+static void FracRun(uint8_t ch, uint32_t frames){
+	uint64_t f;
+
+	if(!twfb[ch]) return;
+	f = (uint64_t)twfa[ch]*frames*2 + twfacc[ch];
+	twfacc[ch] = f%twfb[ch];
+
+	if(ch) phac2 += f/twfb[ch];
+	else phac += f/twfb[ch];
+}
+
+//Array population function
+void Populate(uint32_t pos){
+	Generate(&dmabuf[pos], DMA_BUFSIZ/2);
+	FracBlock(0);
+	if(genmode == GEN_DUAL) FracBlock(1);
+	genframes += DMA_BUFSIZ/2;
+}
+
+//Generate any number of frames into a caller's buffer, for the host tools
+void GenRender(int16_t *dst, uint32_t frames){
+	Generate(dst, frames);
+	FracRun(0, frames);
+	if(genmode == GEN_DUAL) FracRun(1, frames);
+	genframes += frames;
+}
+
+//Advance the generator by a number of blocks without producing output, leaving it in
+//exactly the state Populate() would. The cost is per hop rather than per frame. Upconversion
+//consumes baseband every frame so can't be skipped, returns 0 in that mode.
+uint8_t GenSkip(uint32_t blocks){
+	if(genmode == GEN_UPCONV) return 0;
+
+	Generate(0, blocks*(DMA_BUFSIZ/2));
+	FracRun(0, blocks*(DMA_BUFSIZ/2));
+	if(genmode == GEN_DUAL) FracRun(1, blocks*(DMA_BUFSIZ/2));
+	genframes += blocks*(DMA_BUFSIZ/2);
+	return 1;
+}
+
+#if BENCHMARK
+//Reference implementation with a per-sample gain multiply, only used for benchmarking
+void PopulateGain(uint32_t pos){
+	const int16_t gain = ampltarget[0];
+	int16_t *dst = &dmabuf[pos];
+	uint32_t frames = DMA_BUFSIZ/2, ph = phac;
+	const uint32_t inc = tw;
+
+	while(frames--){
+		*dst++ = Q15Mul(sinewt[((ph>>(32-8)) + 256/4)&255], gain);
+		ph += inc;
+		*dst++ = Q15Mul(sinewt[ph>>(32-8)], gain);
+		ph += inc;
+	}
+
+	phac = ph;
+}
+#endif
+
+//Change mode. The accumulators are shifted so the outputs carry on where they were: in
+//quadrature mode the left output is the cosine (a quarter cycle ahead of the accumulator)
+//and the right is one accumulator step later, in dual mode both index the accumulators
+//directly.
+static void SetMode(uint8_t mode){
+	if(mode == genmode) return;
+
+	//Pulses are quadrature only
+	if(pulseen) PulseStop();
+
+	if(mode == GEN_DUAL){
+		phac2 = phac + tw;
+		phac += 1UL<<30;
+	}
+	else if(genmode == GEN_DUAL){
+		phac -= 1UL<<30;
+	}
+	genmode = mode;
+}
+
+//Move the right (Q) channel in time by skew/65536 of a frame, positive for earlier, to
+//cancel a delay between the channels in the DAC and the analog chain. A unit is 0.33ns at
+//46875Hz and the range is GEN_MAXSKEW either way. Quadrature mode already puts the right
+//channel half a frame after the left, for the I2S slot it goes out in, and this is on top.
+//A time shift is a phase shift that grows with frequency, so it is applied as an offset
+//on the right channel's table index worked out per run from the tuning word: any table
+//waveform moves as a whole and the pair stays in quadrature across a sweep, a chirp or a
+//hop, for a multiply per run and an add per frame.
+void SetSkew(int32_t skew){
+	if(skew>GEN_MAXSKEW) skew = GEN_MAXSKEW;
+	if(skew<-GEN_MAXSKEW) skew = -GEN_MAXSKEW;
+	genskew = skew;
+}
+
+//Switch between quadrature and independent dual channel output
+void DualStart(void){
+	SetMode(GEN_DUAL);
+}
+
+void DualStop(void){
+	SetMode(GEN_QUAD);
+}
+
+//Set the output frequency in Hz, channel 0 drives both outputs in quadrature mode
+void SetFrequency(uint32_t freq){
+	SetTuning(0, twperhz*freq, 0, 0);
+}
+
+void SetChanFrequency(uint8_t ch, uint32_t freq){
+	SetTuning(ch, twperhz*freq, 0, 0);
+}
+
+//Set a channel's tuning word exactly, with a fractional modulus of fa/fb added to every
+//accumulator step (fb 0 for none). fb must be below 2^31 and fa below fb. Frequencies
+//that aren't a whole tuning word, e.g. coherent test tones (coherent.h), come out exact
+//on average. FracBlock() carries the fraction once per block, so within a block the phase
+//lags by up to DMA_BUFSIZ+1 accumulator LSBs (under 2^-26 of a cycle) and is back on at
+//the end of it. Hopping, pulses and GenRetune() drop the fraction. In pulsed mode channel
+//0's word is the carrier for the next pulse on.
+void SetTuning(uint8_t ch, uint32_t t, uint32_t fa, uint32_t fb){
+	uint32_t q = 0, r = 0;
+	uint8_t n;
+
+	ch &= 1;
+	if(fa>=fb) fb = 0;
+	if(!ch && pulseen){
+		pulsetw = t;
+		fb = 0;
+	}
+
+	//A block's worth of fraction, DMA_BUFSIZ accumulator steps, by repeated addition as the
+	//M0 has no divider and this runs in the interrupt when applied as a command
+	if(fb){
+		//WCET-BOUND: DMA_BUFSIZ
+		for(n = 0; n<DMA_BUFSIZ; n++){
+			r += fa;
+			if(r>=fb){
+				r -= fb;
+				q++;
+			}
+		}
+	}
+
+	twfa[ch] = fa;
+	twfb[ch] = fb;
+	twfq[ch] = q;
+	twfr[ch] = r;
+	twfacc[ch] = 0;
+	if(ch) tw2 = t;
+	else tw = t;
+}
+
+//Request a new waveform and amplitude (Q15) for a channel. Takes effect once
+//RegenWavetable() has rebuilt the spare table, until then the old table is output.
+void SetChanWave(uint8_t ch, uint8_t wave, uint16_t ampl){
+	if(ampl>32767) ampl = 32767;
+	if(wave>=WAVE_LIB + wavelibn) wave = WAVE_SINE;
+	ch &= 1;
+	wavetarget[ch] = wave;
+	ampltarget[ch] = ampl;
+}
+
+//Change channel 0's amplitude, keeping its waveform
+void SetAmplitude(uint16_t ampl){
+	SetChanWave(0, wavetarget[0], ampl);
+}
+
+//Incrementally rebuild the spare scaled wavetable for whichever channel needs it, called
+//from the idle loop. Only REGEN_CHUNK entries are scaled per call. Returns 1 while there is
+//work outstanding.
+uint8_t RegenWavetable(void){
+	uint16_t end;
+	uint8_t ch;
+
+	if(regench == REGEN_IDLE){
+		//Nothing to do if the active tables already match
+		for(ch = 0; ch<2; ch++){
+			if(ampltarget[ch] != amplactive[ch] || wavetarget[ch] != waveactive[ch]) break;
+		}
+		if(ch == 2) return 0;
+		regench = ch;
+		regenpos = 0;
+		regenwave = wavetarget[ch];
+		regenampl = ampltarget[ch];
+	}
+	else if(ampltarget[regench] != regenampl || wavetarget[regench] != regenwave){
+		//Changed again mid rebuild, start over
+		regenwave = wavetarget[regench];
+		regenampl = ampltarget[regench];
+		regenpos = 0;
+	}
+
+	end = regenpos + REGEN_CHUNK;
+	if(end>256) end = 256;
+	BuildTable(SpareTable(), regenwave, regenampl, regenpos, end);
+	regenpos = end;
+
+	if(regenpos == 256){
+		//Table complete, swap it in
+		SwapIn(regench, SpareTable(), regenwave, regenampl);
+		regench = REGEN_IDLE;
+	}
+
+	return 1;
+}
+
+//Build and swap in a channel's table straight away, abandoning any background rebuild
+//(which used the same spare table). For start up and the host simulator's replay.
+void WavetableNow(uint8_t ch, uint8_t wave, uint16_t ampl){
+	int16_t *dst = SpareTable();
+
+	ch &= 1;
+	regench = REGEN_IDLE;
+	BuildTable(dst, wave, ampl, 0, 256);
+	SwapIn(ch, dst, wave, ampl);
+}
+
+//Capture the state at the start of the next block, cheap enough to do every block
+void GenSnapshot(GenState *s){
+	s->phac = pulseen ? pulseref : phac;
+	s->phac2 = phac2;
+	s->tw = pulseen ? pulsetw : tw;
+	s->tw2 = tw2;
+	s->fs = genfs;
+	s->twperhz = twperhz;
+	s->frames = genframes;
+	s->ampl[0] = ampltarget[0];
+	s->ampl[1] = ampltarget[1];
+	s->wave[0] = wavetarget[0];
+	s->wave[1] = wavetarget[1];
+	s->mode = genmode;
+	s->skew = genskew;
+}
+
+//Build the tables a snapshot's channels were playing, unless they're already active. Slow
+//for a library waveform, main() does it at start up while the crystal comes up so
+//GenResume() finds them in place.
+void GenResumeWaves(const GenState *s){
+	uint8_t ch;
+
+	for(ch = 0; ch<2; ch++){
+		SetChanWave(ch, s->wave[ch], s->ampl[ch]);
+		if(wavetarget[ch] != waveactive[ch] || ampltarget[ch] != amplactive[ch])
+			WavetableNow(ch, wavetarget[ch], ampltarget[ch]);
+	}
+}
+
+//Carry on from a snapshot as if frames more had been generated since it was taken. Expects
+//GenInit() to have just run, with nothing since but an earlier GenResume() and its output.
+//The channels' tables are built first if GenResumeWaves() hasn't been, so output resumes at
+//the snapshot's waveform and amplitude from the first sample.
+void GenResume(const GenState *s, uint32_t frames){
+	SetMode(s->mode == GEN_DUAL ? GEN_DUAL : GEN_QUAD);
+	genfs = s->fs;
+	twperhz = s->twperhz;
+	genskew = s->skew;
+	twfb[0] = twfb[1] = 0;
+	tw = s->tw;
+	tw2 = s->tw2;
+	phac = s->phac + (s->tw<<1)*frames;
+	phac2 = s->phac2 + (s->tw2<<1)*frames;
+	genframes = s->frames + frames;
+	GenResumeWaves(s);
+}
+
+//Scale a per sample increment by a Q24 ratio
+static uint32_t ScaleQ24(uint32_t x, uint32_t ratio){
+	return (UMulHi32(x, ratio)<<8) | ((x*ratio)>>24);
+}
+
+//Retune pended by GenRetunePend(): the new rate and the Q24 ratios old/new and new/old,
+//ratio 0 if it only needs logging
+static volatile uint8_t retunepend = 0;
+static uint32_t retunefs, retuneratio, retuneinv;
+
+//Retune everything for a new achieved sample rate, e.g. after a clock failover. All the
+//per sample increments scale by old rate/new rate so output frequencies stay where they
+//were, anything above the new Nyquist frequency aliases. Hop dwells and pulse timing stay
+//in frames. Takes effect at once, for start up and the host tools.
+void GenRetune(uint32_t fs){
+	GenRetunePend(fs);
+	GenRetuneApply();
+}
+
+//The same from an interrupt that can land anywhere in a refill, such as the clock failover
+//NMI. Only the divisions are done here, CmdApply() applies the retune at the start of the
+//next block, so it can't be undone by a chirp storing its tuning word back or a command
+//scaling by the old twperhz. A later call before then replaces it.
+void GenRetunePend(uint32_t fs){
+	retunepend = 0;
+	retunefs = fs;
+	retuneratio = 0;
+	if(fs != genfs && fs>=genfs/255){
+		retuneratio = ((uint64_t)genfs<<24)/fs;
+		retuneinv = ((uint64_t)fs<<24)/genfs;
+	}
+	retunepend = 1;
+}
+
+//Apply a pended retune, multiplies only. Each one is counted (and logged) even if the
+//rate came out the same.
+void GenRetuneApply(void){
+	uint32_t ratio = retuneratio;
+	uint16_t n;
+
+	if(!retunepend) return;
+	retunepend = 0;
+	genretunes++;
+	if(!ratio) return;
+
+	//A fractional modulus was exact for the old rate only, the scaled word is as close as
+	//a plain one gets
+	twfb[0] = twfb[1] = 0;
+	tw = ScaleQ24(tw, ratio);
+	tw2 = ScaleQ24(tw2, ratio);
+	pulsetw = ScaleQ24(pulsetw, ratio);
+	pulsestep = pulsestep<0 ? -ScaleQ24(-pulsestep, ratio) : ScaleQ24(pulsestep, ratio);
+	bbstep = UMulHi32(bbstep, ratio)>>24 ? 0xFFFFFFFF : ScaleQ24(bbstep, ratio);
+	twperhz = ScaleQ24(twperhz, ratio);
+	genskew = genskew<0 ? -ScaleQ24(-genskew, retuneinv) : ScaleQ24(genskew, retuneinv);
+	if(genskew>GEN_MAXSKEW) genskew = GEN_MAXSKEW;
+	if(genskew<-GEN_MAXSKEW) genskew = -GEN_MAXSKEW;
+
+	//WCET-BOUND: HOP_MAXCHAN
+	for(n = 0; n<hopn; n++){
+		hoptw[n] = ScaleQ24(hoptw[n], ratio);
+	}
+
+	genfs = retunefs;
+}
+
+//Start upconverting streamed baseband to ifreq Hz. step is the interpolator step from
+//UpconvStep(), worked out by the caller as the division is too slow for the refill
+//interrupt. Output starts once the ring is half full.
+void UpconvStart(uint32_t ifreq, uint32_t step){
+	uint8_t n;
+
+	SetMode(GEN_QUAD);
+	//WCET-BOUND: 2*BB_TAPS*2
+	for(n = 0; n<2*BB_TAPS*2; n++){
+		bbhist[n] = 0;
+	}
+	bbhpos = 0;
+	bbfrac = 0;
+	bbstep = step;
+	bbhead = bbtail = 0;
+	bbwant = BB_RINGSIZ/2;
+	bbunderruns = bboverruns = 0;
+	bbfillsum = 0;
+	bbfillframes = 0;
+	SetFrequency(ifreq);
+	SetMode(GEN_UPCONV);
+}
+
+//Return to plain quadrature output
+void UpconvStop(void){
+	SetMode(GEN_QUAD);
+}
+
+//Interpolator step for a link rate in Hz at the current sample rate, baseband samples per
+//frame Q32. A link as fast as the sample rate gets the largest step there is.
+uint32_t UpconvStep(uint32_t linkrate){
+	if(linkrate>=genfs) return 0xFFFFFFFF;
+	return ((uint64_t)linkrate<<32)/genfs;
+}
+
+//Trim the interpolator step, for the drift loop to match the link's actual rate
+void UpconvRatio(uint32_t step){
+	bbstep = step;
+}
+
+//Queue one baseband I/Q sample, called by the control link receiver. Returns 0 if the
+//ring is full and the sample was dropped.
+uint8_t BBPush(int16_t i, int16_t q){
+	uint16_t h = bbhead, n = (h+1)&(BB_RINGSIZ-1);
+
+	if(n == bbtail){
+		bboverruns++;
+		return 0;
+	}
+	bbring[h][0] = i;
+	bbring[h][1] = q;
+	bbhead = n;
+	return 1;
+}
+
+//xorshift32 pseudo-random generator for the hop order
+static uint32_t XorShift(uint32_t *s){
+	uint32_t x = *s;
+	x ^= x<<13;
+	x ^= x>>17;
+	x ^= x<<5;
+	return *s = x;
+}
+
+//Configure and start frequency hopping. Channels are basefreq + k*spacing Hz for k = 0 to
+//nchan-1, visited in a seeded pseudo-random order (each channel once per pass) for dwell
+//frames each. The first hop happens on the first frame of the next block, or of the current
+//one when applied through CMD_HOP. Returns 0 if the plan is invalid.
+uint8_t HopConfig(uint32_t basefreq, uint32_t spacing, uint16_t nchan, uint32_t dwell, uint32_t seed){
+	uint16_t n, k;
+	uint32_t t;
+
+	if(nchan == 0 || nchan>HOP_MAXCHAN || dwell == 0) return 0;
+	if(basefreq + (uint32_t)(nchan-1)*spacing >= genfs/2) return 0;
+
+	//Stop hopping while the table is rebuilt, the DMA interrupt checks hopen per block
+	hopen = 0;
+	twfb[0] = 0;
+	if(pulseen) PulseStop();
+
+	//WCET-BOUND: HOP_MAXCHAN
+	for(n = 0; n<nchan; n++){
+		hoptw[n] = twperhz*(basefreq + n*spacing);
+	}
+
+	//Fisher-Yates shuffle, a zero seed would lock xorshift up. The index is scaled with a
+	//multiply rather than a modulo, the M0 has no divider and this runs in the interrupt
+	//when applied as a command.
+	if(seed == 0) seed = 1;
+	//WCET-BOUND: HOP_MAXCHAN
+	for(n = nchan-1; n>0; n--){
+		k = UMulHi32(XorShift(&seed), n+1);
+		t = hoptw[n];
+		hoptw[n] = hoptw[k];
+		hoptw[k] = t;
+	}
+
+	hopn = nchan;
+	hopidx = 0;
+	hopdwell = dwell;
+	hopleft = 0;
+	hopen = 1;
+
+	return 1;
+}
+
+//Stop hopping, the current channel is held
+void HopStop(void){
+	hopen = 0;
+}
+
+//Unsigned division by shift and subtract, bounded for tools/wcet.py where a library
+//division isn't
+static uint32_t UDiv32(uint32_t n, uint32_t d){
+	uint32_t q = 0, r = 0;
+	uint8_t i;
+
+	//WCET-BOUND: 32
+	for(i = 0; i<32; i++){
+		r = (r<<1) | (n>>31);
+		n <<= 1;
+		q <<= 1;
+		if(r>=d){
+			r -= d;
+			q |= 1;
+		}
+	}
+	return q;
+}
+
+//Start pulsed output in quadrature mode: a pulse of width frames every pri frames, silent
+//in between, the first starting on the first frame of the next block. The carrier is
+//channel 0's current frequency, with chirp Hz added linearly over the pulse for an LFM
+//chirp (negative sweeps down). policy is PULSE_COHERENT to start every pulse with the
+//phase a continuous carrier would have, or PULSE_RESET to start every pulse at zero phase
+//so they are all identical. Returns 0 if the timing is invalid or the chirp would leave
+//0 to Nyquist.
+uint8_t PulseConfig(uint32_t pri, uint32_t width, int32_t chirp, uint8_t policy){
+	uint32_t sweep = chirp<0 ? -chirp : chirp;
+	uint32_t carrier = pulseen ? pulsetw : tw, ref = pulseen ? pulseref : phac;
+	int32_t step;
+
+	if(width == 0 || width>=pri || sweep>=genfs/2) return 0;
+
+	//Step per frame, so the last frame of the pulse is chirp Hz from the first
+	step = UDiv32(twperhz*sweep, width>1 ? width-1 : 1);
+	if(chirp<0) step = -step;
+	if(carrier>=1UL<<30 || carrier + step*(width-1)>=1UL<<30) return 0;
+
+	//The carrier restarts from pulsetw every pulse, so there's no fraction to carry
+	SetMode(GEN_QUAD);
+	hopen = 0;
+	pulseen = 0;
+	twfb[0] = 0;
+	pulsestep = step;
+	pulsetw = carrier;
+	pulseref = ref;
+	pulsepri = pri;
+	pulsewidth = width;
+	pulsepos = 0;
+	pulsepolicy = policy;
+	pulseen = 1;
+
+	return 1;
+}
+
+//Back to continuous output at the carrier frequency
+void PulseStop(void){
+	if(!pulseen) return;
+	pulseen = 0;
+	tw = pulsetw;
+}
@@ -0,0 +1,168 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <stdint.h>
+
+/*
+ * Quadrature DDS generator core. Everything in here is hardware independent so the same
+ * code runs on the STM32F0 (fed by the DMA interrupt in main.c) and in the host simulator
+ * under sim/.
+ */
+
+//DMA Buffer size, this can be adjusted if samples seem to be dropped
+#define DMA_BUFSIZ	32
+
+//Sampling frequency
+//#define FS			48000
+//Sampling frequency with error correction - 48000*(100-2.3438)/100 = 46874.98Hz
+#define FS			46875
+
+//Waveform output frequency (subject to 2.34% error due to PLL)
+#define FREQOUT		8000
+
+//Output amplitude, Q15 where 32767 is full scale
+#define AMPLITUDE	32767
+
+//Number of scaled wavetable entries rebuilt per call of RegenWavetable(), small enough to
+//keep the idle loop responsive. A multiple of WP_BLOCK (wavepack.h).
+#define REGEN_CHUNK	32
+
+//Set to 1 to measure Populate() against a per-sample gain stage and the other modes with
+//SysTick
+#define BENCHMARK	0
+
+//Tuning word per Hz. FS multiplied by two as the phase accumulator steps once for the left
+//and once for the right sample of every frame.
+#define TW_PER_HZ	(4294967296ULL/(2*FS))
+
+//Maximum number of channels in a frequency hopping plan
+#define HOP_MAXCHAN	64
+
+//Baseband receive ring size in I/Q pairs for upconversion mode, must be a power of two
+#define BB_RINGSIZ	64
+
+//Polyphase interpolator from the ring to the sample rate: taps per output, and phases per
+//baseband sample and its log2. bbfir.h is built for these by tools/bbfir.py.
+#define BB_TAPS			8
+#define BB_PHASES		128
+#define BB_LOG2PHASES	7
+
+//Frames the ring's fill level is averaged over for the drift loop (asrc.c), and its log2
+#define BB_FILLFRAMES		1024
+#define BB_LOG2FILLFRAMES	10
+
+//Largest Q channel skew either way, in 1/65536 frames (just under half a frame)
+#define GEN_MAXSKEW	32767
+
+//Generator modes
+#define GEN_QUAD	0
+#define GEN_UPCONV	1
+#define GEN_DUAL	2
+
+//Waveforms
+#define WAVE_SINE		0
+#define WAVE_TRIANGLE	1
+#define WAVE_SAW		2
+#define WAVE_SQUARE		3
+#define WAVE_LIB		4	//First of the compressed library tables in wavelib.c
+
+//DMA Buffer
+extern int16_t dmabuf[DMA_BUFSIZ*2];
+
+//Sinewave wavetable and the scaled tables each channel is using
+extern int16_t sinewt[256];
+extern int16_t * volatile chwt[2];
+
+//Requested waveform and amplitude per channel, and those of the active tables
+extern volatile uint16_t ampltarget[2];
+extern volatile uint8_t wavetarget[2];
+extern uint16_t amplactive[2];
+extern uint8_t waveactive[2];
+
+//Phase accumulators and tuning words
+extern uint32_t phac, phac2;
+extern volatile uint32_t tw, tw2;
+
+//Achieved sample rate and tuning word per Hz, differ from FS after GenRetune()
+extern volatile uint32_t genfs;
+extern uint32_t twperhz;
+extern volatile uint8_t genretunes;
+
+//Frames generated since start up
+extern volatile uint32_t genframes;
+
+//Current generator mode
+extern volatile uint8_t genmode;
+
+//Times the receive ring ran empty and output held until it was half full again, and
+//baseband samples BBPush() dropped because it was full
+extern volatile uint32_t bbunderruns, bboverruns;
+
+//Average ring fill over the last BB_FILLFRAMES frames in 1/256 baseband samples, counting
+//the interpolator's position, and a count bumped each time it is updated
+extern volatile int32_t bbfill;
+extern volatile uint32_t bbfillseq;
+
+//Pulse phase policies
+#define PULSE_COHERENT	0
+#define PULSE_RESET		1
+
+//What a warm restart resumes from, see GenSnapshot(). Only continuous output survives:
+//hops, pulses and upconversion resume as a carrier at the frequency in use, without any
+//fractional modulus.
+typedef struct {
+	uint32_t phac, phac2;
+	uint32_t tw, tw2;
+	uint32_t fs, twperhz;
+	uint32_t frames;
+	uint16_t ampl[2];
+	uint8_t wave[2];
+	uint8_t mode;
+	uint8_t pad[3];
+	int32_t skew;
+} GenState;
+
+//Precomputed hop plan
+extern uint32_t hoptw[HOP_MAXCHAN];
+extern uint16_t hopn;
+extern uint32_t hopdwell;
+
+void GenInit(void);
+void Populate(uint32_t pos);
+void GenRender(int16_t *dst, uint32_t frames);
+uint8_t GenSkip(uint32_t blocks);
+void GenSnapshot(GenState *s);
+void GenResumeWaves(const GenState *s);
+void GenResume(const GenState *s, uint32_t frames);
+#if BENCHMARK
+void PopulateGain(uint32_t pos);
+#endif
+
+void DualStart(void);
+void DualStop(void);
+void SetFrequency(uint32_t freq);
+void SetChanFrequency(uint8_t ch, uint32_t freq);
+void SetTuning(uint8_t ch, uint32_t t, uint32_t fa, uint32_t fb);
+void SetSkew(int32_t skew);
+void SetChanWave(uint8_t ch, uint8_t wave, uint16_t ampl);
+void SetAmplitude(uint16_t ampl);
+uint8_t RegenWavetable(void);
+void GenRetune(uint32_t fs);
+void GenRetunePend(uint32_t fs);
+void GenRetuneApply(void);
+void WavetableNow(uint8_t ch, uint8_t wave, uint16_t ampl);
+uint32_t TableTag(const int16_t *wt);
+
+void UpconvStart(uint32_t ifreq, uint32_t step);
+void UpconvStop(void);
+uint32_t UpconvStep(uint32_t linkrate);
+void UpconvRatio(uint32_t step);
+uint8_t BBPush(int16_t i, int16_t q);
+
+uint8_t HopConfig(uint32_t basefreq, uint32_t spacing, uint16_t nchan, uint32_t dwell, uint32_t seed);
+void HopStop(void);
+
+uint8_t PulseConfig(uint32_t pri, uint32_t width, int32_t chirp, uint8_t policy);
+void PulseStop(void);
+
+#endif
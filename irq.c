@@ -0,0 +1,38 @@
+#include <stm32f0xx.h>
+#include "irq.h"
+
+volatile uint32_t refillmisses = 0;
+volatile uint32_t refillslack = 0xFFFFFFFF;
+
+#if LATENCY_PROBE
+volatile uint32_t lathist[LAT_BUCKETS];
+volatile uint32_t latmax = 0, latcount = 0;
+
+//TIM14 counts HCLK from 0 at every update, so its count on entry is the latency
+void LatencyStart(void){
+	RCC->APB1ENR |= RCC_APB1ENR_TIM14EN;
+
+	TIM14->CR1 = 0;
+	TIM14->PSC = 0;
+	TIM14->ARR = LAT_PERIOD - 1;
+	TIM14->EGR = TIM_EGR_UG;
+	TIM14->SR = 0;
+	TIM14->DIER = TIM_DIER_UIE;
+
+	NVIC_SetPriority(TIM14_IRQn, IRQ_PRIO_FAST);
+	NVIC_EnableIRQ(TIM14_IRQn);
+	TIM14->CR1 = TIM_CR1_CEN;
+}
+
+void TIM14_IRQHandler(void){
+	uint32_t lat = TIM14->CNT, b = lat/LAT_BUCKET;
+
+	TIM14->SR = 0;
+	lathist[b<LAT_BUCKETS ? b : LAT_BUCKETS-1]++;
+	if(lat>latmax) latmax = lat;
+	latcount++;
+}
+#else
+void LatencyStart(void){
+}
+#endif
@@ -0,0 +1,56 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdint.h>
+
+/*
+ * Interrupt priorities. The DMA interrupt only acknowledges the half transfer or transfer
+ * complete, notes which half wants refilling and pends PendSV, which does the refill
+ * (tracking detector, command queue, Populate() and the warm restart snapshot) two levels
+ * down. Short handlers that can't wait for a whole refill go in between at IRQ_PRIO_FAST
+ * and only ever wait for the acknowledge stage. Whatever they take comes out of the
+ * refill's margin, tools/wcet.py --fast reserves it.
+ *
+ * The refill has until the DMA comes back round to its half, a half buffer period. The
+ * DMA interrupt counts a miss if it finds the other half still waiting and PendSV counts
+ * one if another acknowledge came in while it worked; refillmisses and the smallest margin
+ * left at the end of a refill (refillslack) can be read out with the debugger.
+ *
+ * LATENCY_PROBE builds a TIM14 interrupt at IRQ_PRIO_FAST that fires every LAT_PERIOD
+ * cycles, out of step with the DMA, and histograms how long after its update it got in,
+ * as any other fast handler would. REFILL_DEFERRED 0 puts the refill back in the DMA
+ * interrupt to compare against.
+ */
+
+//Priorities, 0 is the highest of the M0's four
+#define IRQ_PRIO_DMA	0	//Refill acknowledge, and flash ARB repointing
+#define IRQ_PRIO_FAST	1	//Short time critical handlers
+#define IRQ_PRIO_REFILL	2	//PendSV
+#define IRQ_PRIO_TICK	3	//SysTick, extends the cycle count every 2^24 cycles
+
+//Set to 0 to refill from the DMA interrupt itself
+#define REFILL_DEFERRED	1
+
+//Set to 1 to build the latency probe
+#define LATENCY_PROBE	0
+
+//Probe period in HCLK cycles (prime, so it walks through every point of the half buffer
+//period), and its histogram in LAT_BUCKET cycle buckets, the last catching everything over
+#define LAT_PERIOD		4999
+#define LAT_BUCKET		32
+#define LAT_BUCKETS		64
+
+//Deadline monitoring
+extern volatile uint32_t refillmisses;
+extern volatile uint32_t refillslack;
+
+#if LATENCY_PROBE
+//Probe histogram, worst latency and samples, cycles from the timer update to the handler
+//reading the counter, exception entry included
+extern volatile uint32_t lathist[LAT_BUCKETS];
+extern volatile uint32_t latmax, latcount;
+#endif
+
+void LatencyStart(void);
+
+#endif
@@ -1,9 +1,17 @@
-#include <math.h>
-#include <stm32f0xx_gpio.h>
 #include <stm32f0xx_rcc.h>
-#include <stm32f0xx_spi.h>
-#include <stm32f0xx_dma.h>
-#include <stm32f0xx_misc.h>
+#include "generator.h"
+#include "sched.h"
+#include "dsp.h"
+#include "cmd.h"
+#include "arb.h"
+#include "coherent.h"
+#include "retain.h"
+#include "adc.h"
+#include "alc.h"
+#include "track.h"
+#include "asrc.h"
+#include "pdm.h"
+#include "irq.h"
 
 /*
  * Simple quadrature waveform generator using the STM32F0 Discovery board
@@ -38,159 +46,689 @@
  */
 
 
-//I2S GPIO definitions
-#define I2S_WS		GPIO_Pin_4
-#define I2S_CK		GPIO_Pin_5
-#define I2S_MCK		GPIO_Pin_6
-#define I2S_SD		GPIO_Pin_7
-
-#define I2S_WSPS	GPIO_PinSource4
-#define I2S_CKPS	GPIO_PinSource5
-#define I2S_MCKPS	GPIO_PinSource6
-#define I2S_SDPS	GPIO_PinSource7
-
-#define I2S_AF		GPIO_AF_0
+//I2S pins, PA4 WS, PA5 CK, PA6 MCK and PA7 SD, all AF0 (the reset value of AFR). PDM only
+//needs the data pin (MOSI).
 #define I2S_GPIO	GPIOA
 #define I2S_SPI		SPI1
+#if PDM_OUTPUT
+#define OUT_MODER	GPIO_MODER_MODER7_1
+#define OUT_OSPEEDR	GPIO_OSPEEDER_OSPEEDR7
+#else
+#define OUT_MODER	(GPIO_MODER_MODER4_1 | GPIO_MODER_MODER5_1 | GPIO_MODER_MODER6_1 | \
+		GPIO_MODER_MODER7_1)
+#define OUT_OSPEEDR	(GPIO_OSPEEDER_OSPEEDR4 | GPIO_OSPEEDER_OSPEEDR5 | \
+		GPIO_OSPEEDER_OSPEEDR6 | GPIO_OSPEEDER_OSPEEDR7)
+#endif
 
-//DMA Buffer size, this can be adjusted if samples seem to be dropped
-#define DMA_BUFSIZ	32
+//I2S Philips, 16 bit, master transmit with MCLK out. The prescaler is what I2S_Init()
+//works out for 48kHz from 48MHz, 2*2 times MCLK's 256 = 1024 (FS). From HSI alone it would
+//fall back to the same, so it doesn't depend on the clock and is written before the PLL
+//has locked.
+#define OUT_I2SCFGR	(SPI_I2SCFGR_I2SMOD | SPI_I2SCFGR_I2SCFG_1)
+#define OUT_I2SPR	(SPI_I2SPR_MCKOE | 2)
 
-//Sampling frequency
-//#define FS			48000
-//Sampling frequency with error correction - 48000*(100-2.3438)/100 = 46874.98Hz
-#define FS			46875
+//PDM: transmit only SPI master, 16 bit words, software NSS held high, PCLK/16
+#if PDM_SPIDIV != 16
+#error "OUT_SPICR1 has the SPI1 prescaler for PDM_SPIDIV 16"
+#endif
+#define OUT_SPICR1	(SPI_CR1_BIDIMODE | SPI_CR1_BIDIOE | SPI_CR1_SSM | SPI_CR1_SSI | \
+		SPI_CR1_BR_1 | SPI_CR1_BR_0 | SPI_CR1_MSTR)
+#define OUT_SPICR2	(SPI_CR2_DS | SPI_CR2_TXDMAEN)
 
-//Waveform output frequency (subject to 2.34% error due to PLL)
-#define FREQOUT		8000
+//DMA1 channel 3, circular from the buffer to SPI1->DR a halfword at a time, high priority,
+//interrupts at half transfer and transfer complete
+#define OUT_DMACCR	(DMA_CCR_PL_1 | DMA_CCR_MSIZE_0 | DMA_CCR_PSIZE_0 | DMA_CCR_MINC | \
+		DMA_CCR_CIRC | DMA_CCR_DIR | DMA_CCR_HTIE | DMA_CCR_TCIE)
+#if PDM_OUTPUT
+#define OUT_BUF		pdmbuf
+#define OUT_LEN		(DMA_BUFSIZ*PDM_WORDS)
+#else
+#define OUT_BUF		dmabuf
+#define OUT_LEN		(DMA_BUFSIZ*2)
+#endif
 
-//DMA Buffer
-int16_t dmabuf[DMA_BUFSIZ*2] = {0};
+//Upper bits of the cycle counter, SysTick supplies the low 24
+volatile uint32_t cyclehi = 0;
 
-//Sinewave wavetable - constant population would reduce SRAM requirements!
-int16_t sinewt[256];
+//HCLK cycles per I2S sample (half a frame), set up by CycleInit()
+uint32_t cyclespersample;
 
-//Peripheral typedefs
-GPIO_InitTypeDef G;
-I2S_InitTypeDef I;
-DMA_InitTypeDef D;
-NVIC_InitTypeDef N;
+//SysTick free runs over its full 24 bits and extends the count on every wrap
+void SysTick_Handler(void){
+	cyclehi += 1UL<<24;
+}
 
-//Array population function
-void Populate(uint32_t pos){
-	//tw = Tuning word, waves are generated using DDS: http://interface.khm.de/index.php/lab/interfaces-advanced/arduino-dds-sinewave-generator/
-	//FS multiplied by two as buffer actually contains both left and right!
-	const uint32_t tw = (4294967296UL/(2*FS))*FREQOUT;
-	static uint32_t phac = 0, sinph, cosph;
+void CycleInit(void){
+	cyclespersample = SystemCoreClock/(2*FS);
 
-	int16_t sample;
-	uint32_t n;
+	SysTick->LOAD = 0xFFFFFF;
+	SysTick->VAL = 0;
+	NVIC_SetPriority(SysTick_IRQn, IRQ_PRIO_TICK);
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+}
 
-	for(n = pos; n<pos+DMA_BUFSIZ; n++){
-		//Sine wave phase
-		sinph = phac>>(32-8);
+//Free running HCLK cycle count. Only valid from thread mode, where a pending wrap can
+//always be taken between the two reads.
+uint32_t SchedNow(void){
+	uint32_t hi, lo;
 
-		//Cosine wave phase
-		//Note the addition of 256/4 (64) as a cosine wave is 1/4 of a cycle ahead of a sine wave. The anding with 255
-		//ensures the wavetable index wraps
-		cosph = (sinph + 256/4)&255;
+	do{
+		hi = cyclehi;
+		lo = SysTick->VAL;
+	}while(hi != cyclehi);
 
-		//Every even buffer sample is for the left hand channel
-		if(n&1){
-			//Right
-			sample = sinewt[sinph];
-		}
-		else{
-			//Left
-			sample = sinewt[cosph];
-		}
+	return hi + (0xFFFFFF - lo);
+}
+
+//Cycles until the next DMA half/full transfer interrupt. CNDTR counts the samples left
+//in the whole buffer, the next interrupt is due at the half way point or the end. With PDM
+//output it counts bitstream words, 16 SPI clocks each.
+uint32_t SchedToDeadline(void){
+	uint32_t left = DMA1_Channel3->CNDTR;
+
+#if PDM_OUTPUT
+	if(left>DMA_BUFSIZ/2*PDM_WORDS) left -= DMA_BUFSIZ/2*PDM_WORDS;
+	return left*16*PDM_SPIDIV;
+#else
+	if(left>DMA_BUFSIZ) left -= DMA_BUFSIZ;
+	return left*cyclespersample;
+#endif
+}
+
+//Clock state, for reading out with the debugger
+#define CLK_HSE		0	//PLL from the crystal
+#define CLK_HSIPLL	1	//Crystal failed, PLL from HSI/2
+#define CLK_HSI		2	//Crystal failed and the PLL didn't lock, running from HSI directly
+volatile uint8_t clkstate = CLK_HSE;
+
+//Polling loops to wait for the crystal Reset_Handler started, about 20ms at 8MHz as
+//SystemInit() used to allow, and for the PLL to lock, about 1ms against a 200us worst case
+//lock time
+#define HSE_TIMEOUT	HSE_STARTUP_TIMEOUT
+#define PLL_TIMEOUT	1000
+
+//Divider from SYSCLK to the I2S sample rate, from the I2S prescaler (OUT_I2SPR). A PDM
+//frame is PDM_OSR bits at the SPI clock.
+static uint32_t I2SDiv(void){
+#if PDM_OUTPUT
+	return PDM_SPIDIV*PDM_OSR;
+#else
+	uint32_t pr = I2S_SPI->I2SPR, div;
+
+	div = 2*(pr & SPI_I2SPR_I2SDIV) + ((pr & SPI_I2SPR_ODD) ? 1 : 0);
+	if(pr & SPI_I2SPR_MCKOE) div *= 256;
+	else if(I2S_SPI->I2SCFGR & SPI_I2SCFGR_CHLEN) div *= 64;
+	else div *= 32;
+
+	return div;
+#endif
+}
+
+//Achieved I2S sample rate, rounded
+uint32_t I2SRate(void){
+	uint32_t div = I2SDiv();
 
-		//Write sample to dma buffer
-		dmabuf[n] = sample;
+	return (SystemCoreClock + div/2)/div;
+}
+
+//Plan coherent test tones for an ADC sampling at fadc Hz into n sample records and start
+//them, f1 0 for a single tone in quadrature. For the debugger or a task. Returns 0 if
+//there's no plan or the command queue is busy.
+uint8_t CoherentStart(uint32_t fadc, uint32_t n, uint32_t f0, uint32_t f1){
+	uint32_t f[2] = {f0, f1};
+	CohPlan p;
 
-		//Increment phase accumulator
-		phac += tw;
+	if(!CohPlanTones(SystemCoreClock, I2SDiv(), fadc, n, f, f1 ? 2 : 1, &p)) return 0;
+	return CohApply(&p);
+}
+
+//Start the PLL for 48MHz from src times 12 without waiting for it to lock. Expects SYSCLK
+//to be HSI with the PLL off.
+static void ClockPLLStart(uint32_t src){
+	//One wait state for 48MHz, a little slower at 8MHz meanwhile but safe either side of
+	//the switch
+	FLASH->ACR = FLASH_ACR_PRFTBE | FLASH_ACR_LATENCY;
+	RCC_PLLConfig(src, RCC_PLLMul_12);
+	RCC_PLLCmd(ENABLE);
+}
+
+//Switch to the PLL once it locks, or turn it off and stay on HSI if it doesn't. Returns 0
+//for the latter.
+static uint8_t ClockPLLSwitch(void){
+	uint32_t timeout = PLL_TIMEOUT;
+
+	while(!(RCC->CR & RCC_CR_PLLRDY) && --timeout);
+	if(timeout){
+		RCC_SYSCLKConfig(RCC_SYSCLKSource_PLLCLK);
+		while(RCC_GetSYSCLKSource() != 0x08);
 	}
+	else RCC_PLLCmd(DISABLE);
+
+	SystemCoreClockUpdate();
+	return timeout != 0;
 }
 
-//DMA interrupt handler
-void DMA1_Channel2_3_IRQHandler(void){
-	//Once the first half of the buffer has been sent, populate the first half (during
-	//this time, the second half will be being sent!)
-	if(DMA_GetITStatus(DMA1_IT_HT3)){
-		DMA_ClearITPendingBit(DMA1_IT_HT3);
-		Populate(0);
+//Rebuild 48MHz from HSI/2, or stay on HSI if the PLL won't lock. Expects SYSCLK to be HSI
+//with the PLL off, as it is after a clock security trip.
+void ClockHSIPLL(void){
+	ClockPLLStart(RCC_PLLSource_HSI_Div2);
+	clkstate = ClockPLLSwitch() ? CLK_HSIPLL : CLK_HSI;
+}
+
+//Wait for the crystal and start the PLL from it (HSE/2), or from HSI/2 if the crystal never
+//started. ClockSwitch() switches over, anything that doesn't need the clock can go in
+//between while the PLL locks.
+void ClockStart(void){
+	uint32_t timeout = HSE_TIMEOUT;
+
+	while(!(RCC->CR & RCC_CR_HSERDY) && --timeout);
+	if(timeout){
+		RCC_PREDIV1Config(RCC_PREDIV1_Div2);
+		ClockPLLStart(RCC_PLLSource_PREDIV1);
+		clkstate = CLK_HSE;
+	}
+	else{
+		RCC_HSEConfig(RCC_HSE_OFF);
+		ClockPLLStart(RCC_PLLSource_HSI_Div2);
+		clkstate = CLK_HSIPLL;
+	}
+}
+
+//Run from the PLL with the clock security system watching the crystal, or from HSI
+void ClockSwitch(void){
+	if(!ClockPLLSwitch()) clkstate = CLK_HSI;
+	else if(clkstate == CLK_HSE) RCC_ClockSecuritySystemCmd(ENABLE);
+}
+
+//Point DMA1 channel 3 at the output buffer, not enabled yet
+static void OutputDma(void){
+	DMA1_Channel3->CCR = 0;
+	DMA1_Channel3->CPAR = (uint32_t)&I2S_SPI->DR;
+	DMA1_Channel3->CMAR = (uint32_t)OUT_BUF;
+	DMA1_Channel3->CNDTR = OUT_LEN;
+	DMA1_Channel3->CCR = OUT_DMACCR;
+}
+
+//Pins, SPI1 as I2S (or as PDM's SPI master), the DMA channel and its interrupt, all but
+//enabling them. The register values are fixed above rather than worked out by the driver
+//library at startup, and none of them need the PLL, so this goes in while it locks.
+static void OutputInit(void){
+	RCC->AHBENR |= RCC_AHBENR_GPIOAEN | RCC_AHBENR_DMA1EN;
+	RCC->APB2ENR |= RCC_APB2ENR_SPI1EN;
+
+	I2S_GPIO->MODER |= OUT_MODER;
+	I2S_GPIO->OSPEEDR |= OUT_OSPEEDR;
+
+#if PDM_OUTPUT
+	I2S_SPI->CR1 = OUT_SPICR1;
+	I2S_SPI->CR2 = OUT_SPICR2;
+#else
+	I2S_SPI->I2SCFGR = OUT_I2SCFGR;
+	I2S_SPI->I2SPR = OUT_I2SPR;
+	I2S_SPI->CR2 |= SPI_CR2_TXDMAEN;
+#endif
+
+	OutputDma();
+	DMA1->IFCR = DMA_IFCR_CHTIF3 | DMA_IFCR_CTCIF3;
+
+	NVIC_SetPriority(DMA1_Channel2_3_IRQn, IRQ_PRIO_DMA);
+	NVIC_EnableIRQ(DMA1_Channel2_3_IRQn);
+	NVIC_SetPriority(PendSV_IRQn, IRQ_PRIO_REFILL);
+}
+
+//Clock security system trip. The hardware has already moved SYSCLK to HSI and stopped the
+//PLL, so I2S is running at a sixth of its rate. Get the clock back and pend a retune of the
+//generator for whatever sample rate that gives - the refill stage's CmdApply() applies it
+//on the next block, keeping the output frequencies where they were to within the HSI's
+//tolerance, and logs an EV_CLOCK. The NMI pre-empts the DMA interrupt, but at 8MHz a block
+//lasts 2ms so the PLL lock fits. "sim css" models the failover time.
+void NMI_Handler(void){
+	uint32_t fs;
+
+	if(RCC_GetITStatus(RCC_IT_CSS) == RESET) return;
+	RCC_ClearITPendingBit(RCC_IT_CSS);
+
+	ClockHSIPLL();
+	fs = I2SRate();
+	GenRetunePend(fs);
+	cyclespersample = SystemCoreClock/(2*fs);
+}
+
+//Background task - rebuild the scaled wavetable after an amplitude change
+uint8_t TaskRegen(void *ctx){
+	while(RegenWavetable()){
+		if(SchedYield()) return TASK_BUSY;
+	}
+	return TASK_IDLE;
+}
+
+//ADC I/Q pairs per half buffer, and fed to the level detector per unit of work
+#define ALC_HALF	(ADC_BUFSIZ/4)
+#define ALC_CHUNK	32
+
+//Background task - amplitude levelling, works through each ADC half buffer as it fills.
+//It has a half's time (ALC_HALF/ALC_RATE, 25ms) to finish before the DMA is back.
+uint8_t TaskAlc(void *ctx){
+	static const uint16_t *blk = 0;
+	static uint32_t pos;
+
+	if(alcstate == ALC_OFF) return TASK_IDLE;
+	if(!blk){
+		if(!(blk = AdcBlock())) return TASK_IDLE;
+		pos = 0;
+	}
+
+	while(pos<ALC_HALF){
+		AlcFeed(blk + 2*pos, ALC_CHUNK);
+		pos += ALC_CHUNK;
+		if(SchedYield()) return TASK_BUSY;
+	}
+	blk = 0;
+	return TASK_IDLE;
+}
+
+//Background task - tracking loop filter, once per detector update
+uint8_t TaskTrack(void *ctx){
+	TrackUpdate();
+	return TASK_IDLE;
+}
+
+//Background task - upconversion drift loop, once per fill average. AsrcStart() from the
+//debugger or the link starts it.
+uint8_t TaskAsrc(void *ctx){
+	AsrcUpdate();
+	return TASK_IDLE;
+}
+
+void TrackingStop(void);
+
+//Refill half the DMA buffer, through the modulator for PDM output
+#if PDM_OUTPUT
+#define Refill		PdmPopulate
+#else
+#define Refill		Populate
+#endif
+
+//Set by TrackingStart(), the refill interrupt starts the ADC at the next half transfer
+static volatile uint8_t trackarm = 0;
+
+//Hold the output at rms ADC counts on each input (0 for the level it is at now), with the
+//I and Q outputs fed back to PA1 and PA2. For the debugger or a task.
+void LevelStart(uint16_t rms){
+	TrackingStop();
+	AdcStart((SystemCoreClock + ALC_RATE/2)/ALC_RATE, ADC_IN1 | ADC_IN2, ADC_BUFSIZ);
+	AlcStart(rms);
+	AdcTrigger();
+}
+
+void LevelStop(void){
+	AlcStop();
+	AdcStop();
+}
+
+//Phase lock the output to a tone near freq Hz on PA3, loop noise bandwidth bw mHz. The
+//ADC converts every TRACK_DECIM frames exactly, on the same clock as I2S. For the debugger
+//or a task. Returns 0 if the command queue is busy.
+uint8_t TrackingStart(uint32_t freq, uint32_t bw){
+	LevelStop();
+	if(!TrackStart(freq, bw)) return 0;
+	AdcStart(I2SDiv()*TRACK_DECIM, ADC_IN3, TRACK_ADCLEN);
+	trackarm = 1;
+	return 1;
+}
+
+void TrackingStop(void){
+	trackarm = 0;
+	TrackStop();
+	AdcStop();
+}
+
+#if BENCHMARK
+//Cycle counts for one half buffer (DMA_BUFSIZ/2 frames), averaged over BENCH_RUNS calls.
+//Read out with the debugger. benchmix is upconversion mode at a link rate of FS/4 from a
+//full ring, which runs dry a quarter of the way through but the interpolator costs the
+//same either way, and benchdual is independent dual channel mode, both to compare against
+//benchlookup. benchunpack is selecting a compressed library waveform, decode and scale of
+//the whole table. benchseg is repointing the channel at a flash ARB segment, which with
+//interrupt entry and exit is all the CPU does per pass, against benchlookup every
+//DMA_BUFSIZ/2 frames for Populate(). benchpulse is pulsed mode against duty cycle (a 1
+//frame pulse, 25%, 50%, 75% and a 1 frame gap, BENCH_PULSEPRI frames apart) and
+//benchchirp the 50% duty cycle with an LFM chirp. benchskew is quadrature with the Q
+//channel skewed, which costs an add per frame whether or not the skew is 0. benchtrack is
+//the tracking phase detector's share of a refill. benchpdm is a refill for PDM output,
+//benchlookup plus the modulator's 64 bits a frame. The budget at 48MHz is 48000000/FS =
+//1024 cycles per frame, less whatever else the idle loop and other interrupts need.
+#define BENCH_RUNS	64
+volatile uint32_t benchlookup, benchgain, benchmix, benchdual, benchunpack, benchseg;
+
+//A whole number of PRIs in the BENCH_RUNS blocks BenchPopulate() times
+#define BENCH_PULSEPRI	(BENCH_RUNS*DMA_BUFSIZ/2/4)
+#define BENCH_DUTIES	5
+volatile uint32_t benchpulse[BENCH_DUTIES], benchchirp, benchskew, benchtrack, benchpdm;
+
+//Time a populate function with the cycle counter
+uint32_t BenchPopulate(void (*f)(uint32_t)){
+	uint32_t start, n;
+
+	start = SchedNow();
+	for(n = 0; n<BENCH_RUNS; n++) f((n&1)*DMA_BUFSIZ);
+
+	return (SchedNow() - start)/BENCH_RUNS;
+}
+
+//Pulsed mode from a 1 frame pulse to a 1 frame gap
+void BenchPulse(void){
+	static const uint16_t width[BENCH_DUTIES] = {1, BENCH_PULSEPRI/4, BENCH_PULSEPRI/2, 3*BENCH_PULSEPRI/4,
+			BENCH_PULSEPRI-1};
+	uint8_t n;
+
+	SetFrequency(FREQOUT);
+	for(n = 0; n<BENCH_DUTIES; n++){
+		PulseConfig(BENCH_PULSEPRI, width[n], 0, PULSE_COHERENT);
+		benchpulse[n] = BenchPopulate(Populate);
 	}
-	else if(DMA_GetITStatus(DMA1_IT_TC3)){
-		DMA_ClearITPendingBit(DMA1_IT_TC3);
-		//After the second half has been sent, re-populate while the first half is being
-		//sent.
+	PulseConfig(BENCH_PULSEPRI, BENCH_PULSEPRI/2, FREQOUT, PULSE_COHERENT);
+	benchchirp = BenchPopulate(Populate);
+	PulseStop();
+}
+
+//Per call cycle counts of the dsp.h kernels, loop overhead removed. Operands are volatile
+//so nothing gets folded away.
+#define BENCH_KERNELS	10
+volatile uint32_t benchdsp[BENCH_KERNELS];
+volatile int32_t bencha = 0x12345678, benchb = -0x0FEDCBA9, benchsink;
+
+#define BENCH_KERNEL(k, expr) do{ \
+		start = SchedNow(); \
+		for(n = 0; n<BENCH_RUNS; n++) benchsink = (expr); \
+		benchdsp[k] = (SchedNow() - start)/BENCH_RUNS - empty; \
+	}while(0)
+
+//Time selecting the first library waveform, then put the sine back
+uint32_t BenchUnpack(void){
+	uint32_t start = SchedNow(), cycles;
+
+	WavetableNow(0, WAVE_LIB, AMPLITUDE);
+	cycles = SchedNow() - start;
+	WavetableNow(0, WAVE_SINE, AMPLITUDE);
+	return cycles;
+}
+
+//Time loading an ARB segment. SPI DMA requests are off so nothing moves, then the channel
+//is set back up for the generator.
+uint32_t BenchSeg(void){
+	uint32_t start, cycles;
+
+	I2S_SPI->CR2 &= ~SPI_CR2_TXDMAEN;
+	start = SchedNow();
+	ArbLoad(0);
+	cycles = SchedNow() - start;
+
+	OutputDma();
+	arbseq = ARB_END;
+	I2S_SPI->CR2 |= SPI_CR2_TXDMAEN;
+	return cycles;
+}
+
+//Time the tracking phase detector on whatever is in the buffers
+uint32_t BenchTrack(void){
+	uint32_t start, n;
+
+	TrackSync();
+	start = SchedNow();
+	for(n = 0; n<BENCH_RUNS; n++) TrackMix((n&1)*DMA_BUFSIZ, adcbuf);
+	n = (SchedNow() - start)/BENCH_RUNS;
+	TrackStop();
+	return n;
+}
+
+void BenchKernels(void){
+	uint32_t start, n, empty = 0;
+
+	BENCH_KERNEL(0, bencha);
+	empty = benchdsp[0];
+
+	BENCH_KERNEL(0, Sat16(bencha));
+	BENCH_KERNEL(1, SatAdd16(bencha, benchb));
+	BENCH_KERNEL(2, SatAdd32(bencha, benchb));
+	BENCH_KERNEL(3, Q15Mul(bencha, benchb));
+	BENCH_KERNEL(4, Q15MulR(bencha, benchb));
+	BENCH_KERNEL(5, RShiftR(bencha, 7));
+	BENCH_KERNEL(6, UMulHi32(bencha, benchb));
+	BENCH_KERNEL(7, SMulHi32(bencha, benchb));
+	BENCH_KERNEL(8, Q31Mul(bencha, benchb));
+	BENCH_KERNEL(9, Lerp16(bencha, benchb, bencha));
+}
+#endif
+
+//Refill requests from the DMA interrupt to the refill stage: each half waiting, the tracking
+//detector synced as the first half's request came in (nothing to mix yet), and the whole
+//buffer for the end of a flash ARB sequence
+#define REFILL_FIRST	1
+#define REFILL_SECOND	2
+#define REFILL_SYNCED	4
+#define REFILL_ARB		8
+static volatile uint8_t refillpend = 0;
+
+//Half transfer and transfer complete interrupts acknowledged
+static volatile uint32_t refillacks = 0;
+
+//Refill stage, one request a call. Once the first half of the buffer has been sent,
+//populate the first half (during this time, the second half will be being sent!), and the
+//other way round.
+static void RefillStage(void){
+	uint32_t acks, pos, slack;
+	uint8_t req;
+
+	//The DMA interrupt can add a request at any time
+	__disable_irq();
+	acks = refillacks;
+	req = refillpend;
+	if(req & REFILL_ARB) req = REFILL_ARB;
+	else if(req & REFILL_FIRST) req &= REFILL_FIRST | REFILL_SYNCED;
+	else req &= REFILL_SECOND;
+	refillpend &= ~req;
+	__enable_irq();
+
+	if(req & REFILL_ARB){
+		Populate(0);
 		Populate(DMA_BUFSIZ);
 	}
+	else if(req){
+		pos = (req & REFILL_FIRST) ? 0 : DMA_BUFSIZ;
+		if(!(req & REFILL_SYNCED)) TrackMix(pos, adcbuf);
+		CmdApply();
+		Refill(pos);
+		RetainSave();
+
+		//Late if the DMA got back round to this half first, the interrupt for that has been
+		//taken (deferred) or is still waiting (not)
+		if(refillacks != acks || (DMA1->ISR & (DMA_ISR_HTIF3 | DMA_ISR_TCIF3))) refillmisses++;
+		else if((slack = SchedToDeadline())<refillslack) refillslack = slack;
+	}
+
+	//Both halves were waiting, which was already a miss. Catch up. The single stage runs
+	//each request as it comes so never has one left.
+#if REFILL_DEFERRED
+	if(refillpend) SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+#endif
+}
+
+static inline void RefillRequest(uint8_t req){
+	refillpend |= req;
+#if REFILL_DEFERRED
+	SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+#else
+	RefillStage();
+#endif
+}
+
+#if REFILL_DEFERRED
+void PendSV_Handler(void){
+	RefillStage();
+}
+#endif
+
+//DMA interrupt handler, the acknowledge stage. Everything at IRQ_PRIO_FAST waits for this
+//and no more, keep it short.
+void DMA1_Channel2_3_IRQHandler(void){
+	uint32_t isr = DMA1->ISR;
+	uint8_t req;
+
+	//Flash playback has the channel while a sequence plays, PCM for the DAC only
+#if !PDM_OUTPUT
+	if((req = ArbIrq())){
+		if(req == ARB_PREFILL) RefillRequest(REFILL_ARB);
+		return;
+	}
+#endif
+
+	if(isr & DMA_ISR_HTIF3){
+		DMA1->IFCR = DMA_IFCR_CHTIF3;
+		req = REFILL_FIRST;
+
+		//Tracking starts its ADC timer here first thing, so the samples land a fixed time
+		//into known frames
+		if(trackarm){
+			AdcTrigger();
+			TrackSync();
+			trackarm = 0;
+			req |= REFILL_SYNCED;
+		}
+	}
+	else if(isr & DMA_ISR_TCIF3){
+		DMA1->IFCR = DMA_IFCR_CTCIF3;
+		req = REFILL_SECOND;
+	}
+	else return;
+
+	//The DMA has just started on the other half, which should have been refilled by now
+	if(refillpend & ((req & REFILL_FIRST) ? REFILL_SECOND : REFILL_FIRST)) refillmisses++;
+	refillacks++;
+	RefillRequest(req);
+}
+
+//Startup breakdown, HCLK cycles from reset to each point, for the debugger. Up to the
+//switch they are counted at HSI and scaled.
+#define BOOT_MAIN	0	//Reset_Handler done, .data copied and .bss zeroed
+#define BOOT_TABLES	1	//Snapshot checked and wavetables built, while the crystal starts
+#define BOOT_PLL	2	//Crystal up, PLL started
+#define BOOT_OUTPUT	3	//Pins, I2S, DMA and NVIC set up, while the PLL locks
+#define BOOT_SWITCH	4	//Running from the PLL
+#define BOOT_FIRST	5	//DMA and I2S enabled, the first frame is on its way out
+#define BOOT_MARKS	6
+volatile uint32_t bootcycles[BOOT_MARKS];
+
+//HSI cycles since reset, from the SysTick Reset_Handler started. Only until CycleInit().
+static inline uint32_t BootTicks(void){
+	return 0xFFFFFF - SysTick->VAL;
+}
+
+//Resume from the retained snapshot as of cycle count at, startticks HSI cycles after
+//reset, and prefill both halves of the buffer
+static void WarmPrefill(uint32_t startticks, uint32_t at){
+	GenResume(&retained.gen, RETAIN_LOSTFRAMES + (uint64_t)startticks*retained.gen.fs/RETAIN_HSI +
+			at/(2*cyclespersample));
+	if(I2SRate() != genfs){
+		GenRetune(I2SRate());
+		cyclespersample = SystemCoreClock/(2*genfs);
+	}
+	Refill(0);
+	Refill(DMA_BUFSIZ);
 }
 
 int main(void)
 {
-	//Enable required clocks
-	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_GPIOA, ENABLE);
-	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
-	RCC_APB2PeriphClockCmd(RCC_APB2Periph_SPI1, ENABLE);
-
-	//Initialize pins
-	G.GPIO_Pin = I2S_WS | I2S_CK | I2S_MCK | I2S_SD;
-	G.GPIO_Mode = GPIO_Mode_AF;
-	G.GPIO_OType = GPIO_OType_PP;
-	G.GPIO_PuPd = GPIO_PuPd_NOPULL;
-	G.GPIO_Speed = GPIO_Speed_50MHz;
-	GPIO_Init(I2S_GPIO, &G);
-
-	//Intialize I2S peripheral
-	I.I2S_AudioFreq = I2S_AudioFreq_48k;
-	I.I2S_CPOL = I2S_CPOL_Low;
-	I.I2S_DataFormat = I2S_DataFormat_16b;
-	I.I2S_MCLKOutput = I2S_MCLKOutput_Enable;
-	I.I2S_Mode = I2S_Mode_MasterTx;
-	I.I2S_Standard = I2S_Standard_Phillips;
-	I2S_Init(I2S_SPI, &I);
-	SPI_I2S_DMACmd(I2S_SPI, SPI_I2S_DMAReq_Tx, ENABLE);
-
-	//Initialize DMA peripheral
-	D.DMA_BufferSize = DMA_BUFSIZ*2;
-	D.DMA_DIR = DMA_DIR_PeripheralDST;
-	D.DMA_M2M = DMA_M2M_Disable;
-	D.DMA_MemoryBaseAddr = (uint32_t) dmabuf;
-	D.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
-	D.DMA_MemoryInc = DMA_MemoryInc_Enable;
-	D.DMA_Mode = DMA_Mode_Circular;
-	D.DMA_PeripheralBaseAddr = (uint32_t)&(I2S_SPI->DR);
-	D.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
-	D.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
-	D.DMA_Priority = DMA_Priority_High;
-	DMA_Init(DMA1_Channel3, &D);
-
-	//Configure DMA interrupts
-	DMA_ClearITPendingBit(DMA1_IT_HT3);
-	DMA_ClearITPendingBit(DMA1_IT_TC3);
-	DMA_ITConfig(DMA1_Channel3, DMA_IT_HT, ENABLE);
-	DMA_ITConfig(DMA1_Channel3, DMA_IT_TC, ENABLE);
-
-	N.NVIC_IRQChannel = DMA1_Channel2_3_IRQn;
-	N.NVIC_IRQChannelPriority = 0;
-	N.NVIC_IRQChannelCmd = ENABLE;
-	NVIC_Init(&N);
-
-	//Generate sine wavetable
-	uint16_t n;
-	for(n = 0; n<256.0; n++){
-		//16bit wavetable, 2^(16-1)-1 ~= +32767 to -32767
-		sinewt[n] = 32767*sin((double)n*2*M_PI/256.0);
+	uint32_t startticks, start;
+	uint8_t warm, n;
+
+	bootcycles[BOOT_MAIN] = BootTicks();
+
+	//Reset_Handler started the crystal, which takes a couple of ms. Nothing here needs the
+	//clock, get it done at 8MHz meanwhile. A generator snapshot that survived the reset
+	//makes this a warm restart, its waveforms are built now too.
+	warm = RetainValid();
+	GenInit();
+	if(warm) GenResumeWaves(&retained.gen);
+	PdmInit();
+	bootcycles[BOOT_TABLES] = BootTicks();
+
+	//Start the PLL and set up the output while it locks
+	ClockStart();
+	bootcycles[BOOT_PLL] = BootTicks();
+	OutputInit();
+	bootcycles[BOOT_OUTPUT] = BootTicks();
+	ClockSwitch();
+
+	//Start the cycle counter used for scheduling and benchmarks
+	startticks = BootTicks();
+	CycleInit();
+	for(n = 0; n<BOOT_SWITCH; n++) bootcycles[n] *= SystemCoreClock/RETAIN_HSI;
+	bootcycles[BOOT_SWITCH] = startticks*(SystemCoreClock/RETAIN_HSI);
+
+	//Tune for the sample rate the clock tree actually gives if the crystal didn't start
+	if(clkstate != CLK_HSE){
+		GenRetune(I2SRate());
+		cyclespersample = SystemCoreClock/(2*genfs);
 	}
 
-	//Enable DMA and I2S
-	DMA_Cmd(DMA1_Channel3, ENABLE);
-	I2S_Cmd(I2S_SPI, ENABLE);
+#if BENCHMARK
+	benchlookup = BenchPopulate(Populate);
+	benchgain = BenchPopulate(PopulateGain);
+	BenchKernels();
+	UpconvStart(FREQOUT, UpconvStep(FS/4));
+	while(BBPush(0x1000, -0x1000));
+	benchmix = BenchPopulate(Populate);
+	UpconvStop();
+	SetFrequency(FREQOUT);
+	DualStart();
+	SetChanFrequency(1, FREQOUT/3);
+	benchdual = BenchPopulate(Populate);
+	DualStop();
+	benchunpack = BenchUnpack();
+	benchseg = BenchSeg();
+	BenchPulse();
+	SetSkew(6144);
+	benchskew = BenchPopulate(Populate);
+	SetSkew(0);
+	benchtrack = BenchTrack();
+	PdmInit();
+	benchpdm = BenchPopulate(PdmPopulate);
+#endif
+
+	//Carry on from the snapshot, moved on from the sample the DAC was playing when it was
+	//taken by the time since, retuned if the clock came back different, and with the whole
+	//buffer ready so the first sample out is already on phase. The prefill's own time
+	//counts too: one is timed, then the generator resumes again as of that long after the
+	//second one starts, and the DMA waits for then.
+	if(warm){
+		start = SchedNow();
+		WarmPrefill(startticks, start);
+		start += 2*(SchedNow() - start);
+		WarmPrefill(startticks, start);
+		while((int32_t)(SchedNow() - start)<0);
+	}
+
+	//Enable DMA and I2S (or SPI)
+	DMA1_Channel3->CCR |= DMA_CCR_EN;
+#if PDM_OUTPUT
+	I2S_SPI->CR1 |= SPI_CR1_SPE;
+#else
+	I2S_SPI->I2SCFGR |= SPI_I2SCFGR_I2SE;
+#endif
+	bootcycles[BOOT_FIRST] = bootcycles[BOOT_SWITCH] + SchedNow();
+	RetainBooted(warm, startticks/(RETAIN_HSI/1000000) + SchedNow()/(SystemCoreClock/1000000));
+	LatencyStart();
+
+	//Background tasks
+	SchedAdd("regen", TaskRegen, 0, 2000);
+	SchedAdd("alc", TaskAlc, 0, 2000);
+	SchedAdd("track", TaskTrack, 0, 2000);
+	SchedAdd("asrc", TaskAsrc, 0, 2000);
 
     while(1)
     {
+    	//Sleep until the next interrupt once every task is idle
+    	if(!SchedRun()) __WFI();
     }
 }
@@ -0,0 +1,80 @@
+#include "pdm.h"
+
+//Only the PDM build sends it, BENCHMARK times the refill for it either way
+#if PDM_OUTPUT || BENCHMARK
+uint16_t pdmbuf[DMA_BUFSIZ*PDM_WORDS];
+#endif
+volatile uint32_t pdmresets = 0;
+
+//Modulator state: the first integrator less PDM_LEVEL, the second, and the last input
+static int32_t pdmi1, pdmi2;
+static int32_t pdmlast;
+
+//One bit. The output is high (+PDM_LEVEL fed back) while the second integrator isn't
+//negative. m is its sign, 0 or -1: it goes into the word inverted, and masked with twice
+//the level it turns the -PDM_LEVEL the integrators start from into +PDM_LEVEL. Keeping the
+//first integrator offset by -PDM_LEVEL lets both integrators share the one masked term:
+//    i1 += x - y            i2 += i1 - y,    y = +-PDM_LEVEL
+#define PDM_BIT() \
+	m = i2>>31; \
+	w += w - m; \
+	m &= fb2; \
+	i1 += xa; \
+	i1 += m; \
+	i2 += i1; \
+	i2 += m
+
+//Start from rest, the next input is ramped to from 0
+void PdmInit(void){
+	pdmi1 = -PDM_LEVEL;
+	pdmi2 = 0;
+	pdmlast = 0;
+}
+
+//Modulate the left sample of each frame into PDM_WORDS words, MSB first. The input steps
+//a quarter of the way from the last sample to this one each word, so the output lags by a
+//frame.
+void PdmModulate(uint16_t *dst, const int16_t *src, uint32_t frames){
+	int32_t i1 = pdmi1, i2 = pdmi2, x0 = pdmlast, d, xa, m;
+	const int32_t fb2 = 2*PDM_LEVEL;
+	uint32_t w;
+	uint8_t k;
+
+	//WCET-TOTAL: DMA_BUFSIZ/2
+	while(frames--){
+		d = *src - x0;
+		src += 2;
+
+		//Sixteen bits an iteration, unrolled
+		//WCET-BOUND: PDM_WORDS
+		for(k = 1; k<=PDM_WORDS; k++){
+			xa = x0 + ((d*k)>>PDM_LOG2WORDS) - PDM_LEVEL;
+			w = 0;
+			PDM_BIT(); PDM_BIT(); PDM_BIT(); PDM_BIT();
+			PDM_BIT(); PDM_BIT(); PDM_BIT(); PDM_BIT();
+			PDM_BIT(); PDM_BIT(); PDM_BIT(); PDM_BIT();
+			PDM_BIT(); PDM_BIT(); PDM_BIT(); PDM_BIT();
+			*dst++ = ~w;
+		}
+		x0 += d;
+
+		//Past full scale a second order loop can run away, start it again
+		if(i2>PDM_LIMIT || i2<-PDM_LIMIT){
+			i1 = -PDM_LEVEL;
+			i2 = 0;
+			pdmresets++;
+		}
+	}
+
+	pdmi1 = i1;
+	pdmi2 = i2;
+	pdmlast = x0;
+}
+
+#if PDM_OUTPUT || BENCHMARK
+//Refill half the bitstream buffer, pos as for Populate(). dmabuf holds the samples.
+void PdmPopulate(uint32_t pos){
+	Populate(pos);
+	PdmModulate(&pdmbuf[pos/2*PDM_WORDS], &dmabuf[pos], DMA_BUFSIZ/2);
+}
+#endif
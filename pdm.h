@@ -0,0 +1,58 @@
+#ifndef PDM_H
+#define PDM_H
+
+#include <stdint.h>
+#include "generator.h"
+
+/*
+ * 1 bit output for fixtures with no DAC, just an RC filter on the SPI1 MOSI pin (PA7). A
+ * second order sigma-delta modulator turns the generator's I (left) channel into a
+ * bitstream, and SPI1 runs as a plain SPI master sending it 16 bits a word from a circular
+ * DMA buffer, on the same DMA channel and interrupt as I2S. The generator is unchanged:
+ * each refill renders its half buffer into dmabuf as usual and PdmModulate() turns that
+ * into pdmbuf. There is only the one output, Q and ARB playback need the I2S DAC.
+ *
+ * The bit clock is PCLK/PDM_SPIDIV and a frame is PDM_OSR bits, 3MHz and 64 at 48MHz, so
+ * frames still come at 48MHz/1024 = FS and nothing else needs retuning. The limit is the
+ * CPU rather than SPI (which could go to 24MHz): the modulator is 8 instructions a bit, so
+ * the 64 bits of a frame take over half of the 1024 cycles a frame has. The next
+ * prescaler down would need all of them. Each input sample is linearly interpolated over
+ * the frame's words, which keeps the images at multiples of FS down for the RC filter.
+ *
+ * At OSR 64 the noise in band (to FS/2) is about -81dB of the feedback level, so the SNR
+ * peaks at about 70dB with a full scale sine. "sim pdm" measures it against level. Set
+ * PDM_OUTPUT to 1 to build main.c for it.
+ */
+
+#define PDM_OUTPUT		0
+
+//Bits per frame, words of 16 bits per frame and its log2
+#define PDM_OSR			64
+#define PDM_WORDS		(PDM_OSR/16)
+#define PDM_LOG2WORDS	2
+
+//SPI1 prescaler from PCLK to the bit clock
+#define PDM_SPIDIV		16
+
+//Feedback level, a full scale generator sample is 32767/PDM_LEVEL (0.8) of it. At 0.9 a
+//full scale square already sends the loop unstable.
+#define PDM_LEVEL		40960
+
+//Second integrator bound, beyond it the modulator has gone unstable and is reset
+#define PDM_LIMIT		(16*PDM_LEVEL)
+
+#if PDM_OUTPUT || BENCHMARK
+//Bitstream DMA buffer, DMA_BUFSIZ frames as dmabuf
+extern uint16_t pdmbuf[DMA_BUFSIZ*PDM_WORDS];
+#endif
+
+//Times the modulator was reset after going unstable
+extern volatile uint32_t pdmresets;
+
+void PdmInit(void);
+void PdmModulate(uint16_t *dst, const int16_t *src, uint32_t frames);
+#if PDM_OUTPUT || BENCHMARK
+void PdmPopulate(uint32_t pos);
+#endif
+
+#endif
@@ -0,0 +1,45 @@
+#include <stm32f0xx.h>
+#include "retain.h"
+
+//The checksum is word by word over the start of the block
+typedef char RetainLayout[sizeof(Retained) == (RETAIN_WORDS+1)*4 && sizeof(Retained)<=RETAIN_SIZE ? 1 : -1];
+
+//Rotate and xor, so a changed or swapped word always shows
+static uint32_t RetainSum(void){
+	const uint32_t *p = (const uint32_t *)RETAIN_ADDR;
+	uint32_t sum = RETAIN_MAGIC;
+	uint8_t n;
+
+	//WCET-BOUND: RETAIN_WORDS
+	for(n = 0; n<RETAIN_WORDS; n++){
+		sum = ((sum<<5) | (sum>>27)) ^ p[n];
+	}
+	return sum;
+}
+
+//1 if the block holds a complete snapshot from before the reset
+uint8_t RetainValid(void){
+	return retained.magic == RETAIN_MAGIC && retained.check == RetainSum();
+}
+
+//Snapshot the generator, called by the refill stage after every refill. A reset part way
+//through leaves the checksum wrong, so the next start is cold.
+void RetainSave(void){
+	retained.magic = RETAIN_MAGIC;
+	GenSnapshot(&retained.gen);
+	retained.check = RetainSum();
+}
+
+//Record how a start went, before the first snapshot. A cold start clears the statistics
+//the debugger reads out of the block.
+void RetainBooted(uint8_t warm, uint32_t us){
+	if(warm){
+		retained.warmboots++;
+		retained.warmus = us;
+	}
+	else{
+		retained.warmboots = 0;
+		retained.coldus = us;
+		retained.warmus = 0;
+	}
+}
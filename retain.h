@@ -0,0 +1,55 @@
+#ifndef RETAIN_H
+#define RETAIN_H
+
+#include <stdint.h>
+#include "generator.h"
+
+/*
+ * Warm restart. The top RETAIN_SIZE bytes of SRAM are left out of the linker's RAM (IRAM1
+ * in the project is that much short of 8K) so startup neither zeroes them nor puts the
+ * stack there. The refill stage keeps a snapshot of the generator there, checksummed,
+ * every block. After a watchdog, software or brown-out reset that left the SRAM intact,
+ * main() finds a valid snapshot and resumes from it instead of starting over: the phase is
+ * moved on by the time the reset took and output starts from a prefilled buffer at the
+ * waveforms and amplitudes it had.
+ *
+ * The reset itself can't be timed, so the phase is extrapolated from RETAIN_LOSTFRAMES plus
+ * the measured startup time and is only as good as that estimate. A power-on reset leaves
+ * SRAM random and fails the checksum, as does a reset part way through a snapshot.
+ */
+
+#define RETAIN_SIZE		64
+#define RETAIN_ADDR		(0x20002000UL - RETAIN_SIZE)
+
+//Words the checksum covers, everything up to check
+#define RETAIN_WORDS	15
+
+#define RETAIN_MAGIC	0x57A27B00UL
+
+//Frames from the last snapshot to the sample at the DAC when Reset_Handler starts. The
+//refill stage saves after generating the block after the one the DAC has just started, so
+//the snapshot is both queued halves (DMA_BUFSIZ frames) ahead of the output. The reset lands
+//on average half a block into the playing one, plus the reset pulse and the reset sequence,
+//about 2us together. Negative, the startup time added to it always covers it.
+#define RETAIN_LOSTFRAMES	(DMA_BUFSIZ/4 - DMA_BUFSIZ)
+
+//Reset_Handler runs SysTick at HCLK from reset, which is HSI until main() switches to the
+//PLL and reads it, so the count it leaves is in HSI cycles
+#define RETAIN_HSI		8000000UL
+
+typedef struct {
+	uint32_t magic;
+	GenState gen;
+	uint32_t warmboots;		//Warm restarts since the last cold start
+	uint32_t coldus;		//Reset to first output sample of the last cold start, us
+	uint32_t warmus;		//and of the last warm restart
+	uint32_t check;
+} Retained;
+
+#define retained	(*(Retained *)RETAIN_ADDR)
+
+uint8_t RetainValid(void);
+void RetainSave(void);
+void RetainBooted(uint8_t warm, uint32_t us);
+
+#endif
@@ -0,0 +1,61 @@
+#include "sched.h"
+
+Task tasks[SCHED_MAXTASKS];
+uint8_t ntasks = 0;
+
+uint32_t schedpasses = 0, schedoverhead = 0;
+
+//Slice start and budget of the task currently running
+static uint32_t slicestart, slicebudget;
+
+//Register a task, returns 0 if the table is full
+Task *SchedAdd(const char *name, TaskFn fn, void *ctx, uint32_t budget){
+	Task *t;
+
+	if(ntasks == SCHED_MAXTASKS) return 0;
+
+	t = &tasks[ntasks++];
+	t->name = name;
+	t->fn = fn;
+	t->ctx = ctx;
+	t->budget = budget;
+	t->runs = t->total = t->max = t->overruns = 0;
+	return t;
+}
+
+//Called by tasks between units of work. Returns 1 once the slice budget is used up or the
+//next refill is too close to start anything else.
+uint8_t SchedYield(void){
+	if(SchedNow() - slicestart >= slicebudget) return 1;
+	if(SchedToDeadline()<SCHED_GUARD) return 1;
+	return 0;
+}
+
+//Give every task one slice, round robin. Returns 1 if any task still has work to do.
+uint8_t SchedRun(void){
+	uint32_t passstart = SchedNow(), intasks = 0, dt;
+	uint8_t n, busy = 0;
+	Task *t;
+
+	for(n = 0; n<ntasks; n++){
+		t = &tasks[n];
+
+		slicebudget = t->budget;
+		slicestart = SchedNow();
+		busy |= t->fn(t->ctx);
+		dt = SchedNow() - slicestart;
+
+		t->runs++;
+		t->total += dt;
+		if(dt>t->max) t->max = dt;
+		if(dt>t->budget) t->overruns++;
+		intasks += dt;
+	}
+
+	//Overhead is everything in the pass that wasn't spent inside a task. Interrupts that
+	//land in a pass are counted against whichever part they hit.
+	schedoverhead += (SchedNow() - passstart) - intasks;
+	schedpasses++;
+
+	return busy;
+}
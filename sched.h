@@ -0,0 +1,53 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+/*
+ * Cooperative scheduler for background work in the main loop. Tasks are resumable - each
+ * call does a slice of work and returns, keeping its own state between calls. A task
+ * should poll SchedYield() between small units of work and return as soon as it says so.
+ */
+
+//Maximum number of registered tasks
+#define SCHED_MAXTASKS	8
+
+//Don't start a unit of work if the next DMA refill is due within this many cycles. Work
+//done here can't delay the refill (it preempts us) but flash writes stall the bus, so
+//anything like that must check this first.
+#define SCHED_GUARD		2000
+
+//Task return values
+#define TASK_IDLE		0
+#define TASK_BUSY		1
+
+typedef uint8_t (*TaskFn)(void *ctx);
+
+typedef struct {
+	const char *name;
+	TaskFn fn;
+	void *ctx;
+	uint32_t budget;		//Cycles per slice
+
+	//Runtime statistics, in cycles
+	uint32_t runs;
+	uint32_t total;
+	uint32_t max;
+	uint32_t overruns;		//Slices that ran over budget
+} Task;
+
+extern Task tasks[SCHED_MAXTASKS];
+extern uint8_t ntasks;
+
+//Scheduler statistics, in cycles
+extern uint32_t schedpasses, schedoverhead;
+
+//Time source and refill deadline, provided by the platform (main.c on the target)
+uint32_t SchedNow(void);
+uint32_t SchedToDeadline(void);
+
+Task *SchedAdd(const char *name, TaskFn fn, void *ctx, uint32_t budget);
+uint8_t SchedRun(void);
+uint8_t SchedYield(void);
+
+#endif
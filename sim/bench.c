@@ -0,0 +1,350 @@
+/*
+ * Host microbenchmarks for the generator kernels. Each kernel runs the firmware code over
+ * a large buffer, with warm up runs first and then repetitions, and reports ns per frame
+ * (or per table entry) and frames per second as min/median/mean/stddev.
+ *
+ * Absolute numbers depend on the machine, so every kernel is also timed relative to a
+ * plain buffer fill ("ref") run straight after it in each repetition, which cancels out
+ * clock scaling and the like. The ratio of the two fastest runs is what a baseline records
+ * and --check compares, so a baseline taken on one workstation still catches algorithmic
+ * regressions on another. Interference from the rest of the machine only ever adds time,
+ * so the fastest runs are the ones least disturbed by it; a median still moves with load
+ * and made the check fail at random. tools/pre-commit runs the check.
+ *
+ * Build from this directory with:
+ *     gcc -O2 -falign-functions=64 -falign-loops=64 -I.. -o bench bench.c ../generator.c ../cmd.c
+ *         ../wavepack.c ../wavelib.c ../pdm.c -lm
+ *
+ * The alignment keeps a kernel's loops from moving between cache lines when unrelated code
+ * in generator.c changes, which shifts some of them by half as much again on x86.
+ *
+ * Usage:
+ *     bench [--json] [--frames n] [--reps n] [--save file] [--check file] [--tol pct]
+ *         --json writes the results as JSON instead of a table, --save writes them to a
+ *         baseline file and --check fails (exit 1) if any kernel's relative time is more
+ *         than --tol percent (default 25) over the baseline, after BENCH_RETRIES more tries.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "generator.h"
+#include "wavepack.h"
+#include "pdm.h"
+
+#define BENCH_WARMUP	3
+#define BENCH_MAXFRAMES	(1UL<<20)
+#define BENCH_RETRIES	3
+
+typedef struct {
+	const char *name;
+	const char *unit;
+	void (*setup)(void);
+	void (*run)(int16_t *buf, uint32_t frames);	//frames counts table entries for the table kernels
+} Kernel;
+
+//Results, ns per unit, rel is the kernel's fastest run over ref's fastest
+typedef struct {
+	double min, median, mean, sd, rel;
+} Result;
+
+static int16_t *benchbuf;
+static volatile uint32_t benchsink;
+
+//Plain buffer fill, the yardstick everything else is measured against
+static void RunRef(int16_t *buf, uint32_t frames){
+	uint32_t n;
+
+	for(n = 0; n<frames*2; n++) buf[n] = n;
+}
+
+//The firmware's refill path, one DMA half buffer at a time
+static void RunPopulate(int16_t *buf, uint32_t frames){
+	uint32_t n;
+
+	for(n = 0; n<frames; n += DMA_BUFSIZ/2){
+		Populate(0);
+		buf[n] = dmabuf[0];
+	}
+}
+
+static void RunRender(int16_t *buf, uint32_t frames){
+	GenRender(buf, frames);
+}
+
+//PDM output, the refill path with the modulator after it as PdmPopulate() does. pdmbuf is
+//only there in the PDM build.
+static void RunPdm(int16_t *buf, uint32_t frames){
+	static uint16_t bits[DMA_BUFSIZ/2*PDM_WORDS];
+	uint32_t n;
+
+	for(n = 0; n<frames; n += DMA_BUFSIZ/2){
+		Populate(0);
+		PdmModulate(bits, dmabuf, DMA_BUFSIZ/2);
+		buf[n] = bits[0];
+	}
+}
+
+//Upconversion with the baseband ring kept fed at a quarter of the sample rate
+static void RunUpconv(int16_t *buf, uint32_t frames){
+	uint32_t n, k;
+
+	for(n = 0; n<frames; n += 4*BB_RINGSIZ){
+		for(k = 0; k<BB_RINGSIZ-1; k++) BBPush(k*300, -k*300);
+		GenRender(&buf[2*n], 4*BB_RINGSIZ);
+	}
+}
+
+//Per sample gain multiply, the alternative to pre-scaled tables
+static void RunGain(int16_t *buf, uint32_t frames){
+	const int16_t gain = 16384;
+	uint32_t ph = phac;
+	const uint32_t inc = tw;
+
+	while(frames--){
+		*buf++ = ((int32_t)sinewt[((ph>>(32-8)) + 256/4)&255]*gain)>>15;
+		ph += inc;
+		*buf++ = ((int32_t)sinewt[ph>>(32-8)]*gain)>>15;
+		ph += inc;
+	}
+	phac = ph;
+}
+
+//Whole table builds, frames is a count of table entries
+static void RunBuild(int16_t *buf, uint32_t frames){
+	uint32_t n;
+
+	for(n = 0; n<frames; n += 256) WavetableNow(1, WAVE_TRIANGLE, 20000 + (n&1023));
+	buf[0] = chwt[1][1];
+}
+
+static void RunUnpack(int16_t *buf, uint32_t frames){
+	uint32_t n;
+
+	for(n = 0; n<frames; n += 256) WavePackDecode(&wavelib[(n>>8)%wavelibn], buf);
+}
+
+static void SetupQuad(void){
+	GenInit();
+	PulseStop();
+	SetSkew(0);
+	SetFrequency(FREQOUT);
+}
+
+static void SetupDual(void){
+	SetupQuad();
+	DualStart();
+	SetChanFrequency(1, 1234);
+}
+
+static void SetupUpconv(void){
+	SetupQuad();
+	UpconvStart(FREQOUT, UpconvStep(FS/4));
+}
+
+static void SetupPdm(void){
+	SetupQuad();
+	PdmInit();
+}
+
+static void SetupHop(void){
+	SetupQuad();
+	HopConfig(2000, 1000, 16, 23, 0x1234);
+}
+
+//Quadrature with the Q channel moved by 2us
+static void SetupSkew(void){
+	SetupQuad();
+	SetSkew(6144);
+}
+
+//Half duty cycle pulses with a chirp, half the frames are a block fill
+static void SetupPulse(void){
+	SetupQuad();
+	PulseConfig(1000, 500, 2000, PULSE_COHERENT);
+}
+
+static Kernel kernels[] = {
+	{"ref", "frame", SetupQuad, RunRef},
+	{"populate", "frame", SetupQuad, RunPopulate},
+	{"quad", "frame", SetupQuad, RunRender},
+	{"skew", "frame", SetupSkew, RunRender},
+	{"gain", "frame", SetupQuad, RunGain},
+	{"dual", "frame", SetupDual, RunRender},
+	{"hop", "frame", SetupHop, RunRender},
+	{"pulse", "frame", SetupPulse, RunRender},
+	{"upconv", "frame", SetupUpconv, RunUpconv},
+	{"pdm", "frame", SetupPdm, RunPdm},
+	{"build", "entry", SetupQuad, RunBuild},
+	{"unpack", "entry", SetupQuad, RunUnpack},
+};
+#define NKERNELS	(sizeof(kernels)/sizeof(kernels[0]))
+
+static Result results[NKERNELS];
+
+static double Now(void){
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec*1e9 + t.tv_nsec;
+}
+
+static int CmpDouble(const void *a, const void *b){
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x<y ? -1 : x>y;
+}
+
+static double Median(double *x, uint32_t n){
+	qsort(x, n, sizeof(double), CmpDouble);
+	return n&1 ? x[n/2] : (x[n/2-1] + x[n/2])/2;
+}
+
+static void Measure(const Kernel *k, Result *res, uint32_t frames, uint32_t reps){
+	double *t = malloc(reps*sizeof(double)), t0, t1, t2, sum = 0, sq = 0, kmin = 1e300, rmin = 1e300;
+	uint32_t r;
+
+	k->setup();
+	for(r = 0; r<BENCH_WARMUP; r++) k->run(benchbuf, frames);
+
+	for(r = 0; r<reps; r++){
+		t0 = Now();
+		k->run(benchbuf, frames);
+		t1 = Now();
+		//Through the same indirect call, an inlined copy compiles differently
+		kernels[0].run(benchbuf, frames);
+		t2 = Now();
+		t[r] = (t1 - t0)/frames;
+		if(t1 - t0<kmin) kmin = t1 - t0;
+		if(t2 - t1<rmin) rmin = t2 - t1;
+		benchsink += benchbuf[r&1023];
+		sum += t[r];
+		sq += t[r]*t[r];
+	}
+
+	res->mean = sum/reps;
+	res->sd = sqrt(fmax(sq/reps - res->mean*res->mean, 0));
+	res->median = Median(t, reps);
+	res->min = t[0];
+	res->rel = kmin/rmin;
+	free(t);
+}
+
+static void WriteJson(FILE *f, uint32_t frames, uint32_t reps){
+	uint32_t n;
+
+	//One kernel per line, --check relies on it
+	fprintf(f, "{\n\"frames\": %u, \"reps\": %u, \"kernels\": [\n", frames, reps);
+	for(n = 0; n<NKERNELS; n++){
+		const Result *r = &results[n];
+		fprintf(f, "{\"name\": \"%s\", \"unit\": \"%s\", \"min_ns\": %.4f, \"median_ns\": %.4f, "
+				"\"mean_ns\": %.4f, \"stddev_ns\": %.4f, \"per_s\": %.0f, \"rel\": %.4f}%s\n",
+				kernels[n].name, kernels[n].unit, r->min, r->median, r->mean, r->sd, 1e9/r->median, r->rel,
+				n+1<NKERNELS ? "," : "");
+	}
+	fprintf(f, "]\n}\n");
+}
+
+//Compare relative times against a baseline written by --save. A kernel over the tolerance
+//is measured again, up to BENCH_RETRIES times, and only fails if it stays over: a real
+//regression is there every time, a burst of load from elsewhere rarely is.
+static int Check(const char *path, double tol, uint32_t frames, uint32_t reps){
+	char line[512], name[64];
+	const char *p;
+	double rel;
+	Result retry;
+	uint32_t n, k, found = 0;
+	int fail = 0;
+	FILE *f;
+
+	if(!(f = fopen(path, "r"))){
+		fprintf(stderr, "can't read %s\n", path);
+		return 1;
+	}
+
+	while(fgets(line, sizeof(line), f)){
+		if(sscanf(line, "{\"name\": \"%63[^\"]\"", name) != 1 || !(p = strstr(line, "\"rel\": "))) continue;
+		rel = atof(p + 7);
+		for(n = 0; n<NKERNELS && strcmp(kernels[n].name, name); n++);
+		if(n == NKERNELS) continue;
+
+		found++;
+		for(k = 0; k<BENCH_RETRIES && results[n].rel>rel*(1 + tol/100); k++){
+			Measure(&kernels[n], &retry, frames, reps);
+			if(retry.rel<results[n].rel) results[n].rel = retry.rel;
+		}
+		if(results[n].rel>rel*(1 + tol/100)){
+			printf("REGRESSION %-10s %.3f x ref, baseline %.3f (+%.0f%%)\n", name, results[n].rel, rel,
+					(results[n].rel/rel - 1)*100);
+			fail = 1;
+		}
+	}
+	fclose(f);
+
+	if(!found){
+		fprintf(stderr, "no kernels in %s\n", path);
+		return 1;
+	}
+	printf("%s against %s (%u kernels, %.0f%% tolerance)\n", fail ? "FAIL" : "PASS", path, found, tol);
+	return fail;
+}
+
+int main(int argc, char **argv){
+	uint32_t frames = 1UL<<18, reps = 21, n;
+	const char *save = 0, *check = 0;
+	double tol = 25;
+	uint8_t json = 0;
+	int i;
+	FILE *f;
+
+	for(i = 1; i<argc; i++){
+		if(!strcmp(argv[i], "--json")) json = 1;
+		else if(!strcmp(argv[i], "--frames") && i+1<argc) frames = strtoul(argv[++i], 0, 0);
+		else if(!strcmp(argv[i], "--reps") && i+1<argc) reps = strtoul(argv[++i], 0, 0);
+		else if(!strcmp(argv[i], "--save") && i+1<argc) save = argv[++i];
+		else if(!strcmp(argv[i], "--check") && i+1<argc) check = argv[++i];
+		else if(!strcmp(argv[i], "--tol") && i+1<argc) tol = atof(argv[++i]);
+		else{
+			fprintf(stderr, "usage: %s [--json] [--frames n] [--reps n] [--save file] [--check file] [--tol pct]\n",
+					argv[0]);
+			return 2;
+		}
+	}
+
+	//Whole DMA blocks and whole tables
+	frames = (frames + 255)&~255UL;
+	if(frames<256 || frames>BENCH_MAXFRAMES || reps<1){
+		fprintf(stderr, "frames must be 256 to %lu, reps at least 1\n", BENCH_MAXFRAMES);
+		return 2;
+	}
+	benchbuf = malloc(frames*2*sizeof(int16_t));
+
+	for(n = 0; n<NKERNELS; n++) Measure(&kernels[n], &results[n], frames, reps);
+
+	if(json){
+		WriteJson(stdout, frames, reps);
+	}
+	else{
+		printf("%u frames x %u reps, ns per unit\n", frames, reps);
+		printf("%-10s %-6s %9s %9s %9s %9s %12s %8s\n", "kernel", "unit", "min", "median", "mean", "stddev",
+				"per second", "x ref");
+		for(n = 0; n<NKERNELS; n++){
+			const Result *r = &results[n];
+			printf("%-10s %-6s %9.3f %9.3f %9.3f %9.3f %12.3g %8.2f\n", kernels[n].name, kernels[n].unit,
+					r->min, r->median, r->mean, r->sd, 1e9/r->median, r->rel);
+		}
+	}
+
+	if(save){
+		if(!(f = fopen(save, "w"))){
+			fprintf(stderr, "can't write %s\n", save);
+			return 1;
+		}
+		WriteJson(f, frames, reps);
+		fclose(f);
+	}
+
+	return check ? Check(check, tol, frames, reps) : 0;
+}
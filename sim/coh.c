@@ -0,0 +1,219 @@
+/*
+ * Coherent test signal planner on the host, the firmware's coherent.c with a check of
+ * every plan and a parallel batch mode.
+ *
+ * Each tone is checked exactly in 128 bit arithmetic: the cycles it completes in one ADC
+ * record at the tuning it was given, against its bin. When the generator and the ADC run
+ * at the same rate the plan is also played through the firmware's command path and
+ * Populate(), and two successive records of output must match sample for sample, which
+ * only a coherent tone does.
+ *
+ * Build from this directory with:
+ *     gcc -O2 -I.. -o coh coh.c ../coherent.c ../generator.c ../cmd.c ../wavepack.c ../wavelib.c -lm -lpthread
+ *
+ * Usage:
+ *     coh <fs> <fadc> <n> <freq> [freq2]
+ *         Plans one tone (quadrature) or two (dual mode) near freq Hz for an ADC at fadc Hz
+ *         taking n sample records, with the generator at fs Hz. fs may be a fraction such
+ *         as 8000000/1024.
+ *
+ *     coh --batch <file> [--jobs n]
+ *         Plans every line of file (fs fadc n freq [freq2], # comments) on --jobs threads
+ *         (default one per core) and prints one line per plan in the same order:
+ *         bin, mHz, tw, fa, fb and exact per tone, then the worst error in cycles per
+ *         record. Exits 1 if any line fails to plan or check.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "generator.h"
+#include "cmd.h"
+#include "coherent.h"
+
+#define FRAMES_PER_HALF	(DMA_BUFSIZ/2)
+
+//Batch line length
+#define COH_LINE		256
+
+typedef struct {
+	uint32_t fsnum, fsden, fadc, n, freq[COH_MAXTONES];
+	uint8_t ntones;
+} Job;
+
+typedef struct {
+	uint8_t ok;
+	CohPlan plan;
+	double err;		//Worst tone's error, cycles per record
+} Outcome;
+
+static Job *jobs;
+static Outcome *outcomes;
+static uint32_t njobs;
+static volatile uint32_t nextjob;
+
+//Cycles per record at the planned tuning less the bin, exactly:
+//(tw + fa/fb)*2*fs/2^32*n/fadc - bin
+static double CohError(const Job *j, const CohTone *t){
+	__int128 fb = t->fb ? t->fb : 1, fa = t->fb ? t->fa : 0, num, den;
+
+	num = (t->tw*fb + fa)*2*j->fsnum*j->n - (__int128)t->bin*j->fadc*j->fsden*fb*((__int128)1<<32);
+	den = (__int128)j->fadc*j->fsden*fb*((__int128)1<<32);
+	return (double)num/(double)den;
+}
+
+static uint8_t Plan(const Job *j, Outcome *o){
+	uint8_t i;
+	double e;
+
+	o->err = 0;
+	o->ok = CohPlanTones(j->fsnum, j->fsden, j->fadc, j->n, j->freq, j->ntones, &o->plan);
+	for(i = 0; o->ok && i<o->plan.ntones; i++){
+		e = CohError(j, &o->plan.tone[i]);
+		if(e<0) e = -e;
+		if(e>o->err) o->err = e;
+	}
+
+	//Exact plans must be exact, rounded fractions within the bound in coherent.h
+	if(o->err>j->n*2.0*j->fsnum/j->fsden/j->fadc/4611686018427387904.0) o->ok = 0;
+	return o->ok;
+}
+
+static int ParseJob(const char *line, Job *j){
+	char fs[64];
+	int k;
+
+	memset(j, 0, sizeof(*j));
+	k = sscanf(line, "%63s %u %u %u %u", fs, &j->fadc, &j->n, &j->freq[0], &j->freq[1]);
+	if(k<4) return 0;
+	j->ntones = k - 3;
+	if(sscanf(fs, "%u/%u", &j->fsnum, &j->fsden) == 1) j->fsden = 1;
+	return j->fsnum && j->fsden;
+}
+
+static void *Worker(void *arg){
+	uint32_t n;
+
+	(void)arg;
+	while((n = __sync_fetch_and_add(&nextjob, 1))<njobs) Plan(&jobs[n], &outcomes[n]);
+	return 0;
+}
+
+//Play the plan on the generator and compare two records, only meaningful with the ADC on
+//the generator's clock at the same rate
+static int Periodic(const Job *j, const CohPlan *p){
+	int16_t *a = malloc(j->n*2*sizeof(int16_t)), *b = malloc(j->n*2*sizeof(int16_t));
+	uint8_t half = 0;
+	int same;
+
+	GenInit();
+	CohApply(p);
+	while(CmdSpace() != CMD_QUEUESIZ-1){
+		CmdApply();
+		Populate(half*DMA_BUFSIZ);
+		half ^= 1;
+	}
+	GenRender(a, j->n);
+	GenRender(b, j->n);
+	same = !memcmp(a, b, j->n*2*sizeof(int16_t));
+	free(a);
+	free(b);
+	return same;
+}
+
+static int Single(int argc, char **argv){
+	char line[COH_LINE];
+	Outcome o;
+	Job j;
+	uint8_t i;
+
+	snprintf(line, sizeof(line), "%s %s %s %s %s", argv[0], argv[1], argv[2], argv[3], argc>4 ? argv[4] : "");
+	if(!ParseJob(line, &j)){
+		fprintf(stderr, "bad arguments\n");
+		return 2;
+	}
+	if(!Plan(&j, &o)){
+		printf("no plan\n");
+		return 1;
+	}
+
+	printf("generator %.4f Hz, ADC %u Hz, %u sample records, %s\n", (double)j.fsnum/j.fsden, j.fadc, j.n,
+			o.plan.ntones>1 ? "dual mode" : "quadrature");
+	for(i = 0; i<o.plan.ntones; i++){
+		const CohTone *t = &o.plan.tone[i];
+		printf("tone %u          bin %u, %u.%03u Hz, tw 0x%08X", i, t->bin, t->mhz/1000, t->mhz%1000, t->tw);
+		if(t->fb) printf(" + %u/%u%s", t->fa, t->fb, t->exact ? "" : " (rounded)");
+		printf(", error %.3g cycles per record\n", CohError(&j, t));
+	}
+	if((uint64_t)j.fadc*j.fsden == j.fsnum){
+		if(!Periodic(&j, &o.plan)){
+			printf("output          not periodic over a record\nFAIL\n");
+			return 1;
+		}
+		printf("output          periodic over a record\n");
+	}
+	printf("PASS\n");
+	return 0;
+}
+
+static int Batch(const char *path, uint32_t nthreads){
+	char line[COH_LINE];
+	uint32_t n, cap = 64, failed = 0;
+	pthread_t *th;
+	uint8_t i;
+	FILE *f;
+
+	if(!(f = fopen(path, "r"))){
+		fprintf(stderr, "can't read %s\n", path);
+		return 2;
+	}
+	jobs = malloc(cap*sizeof(Job));
+	while(fgets(line, sizeof(line), f)){
+		if(line[strspn(line, " \t")] == '#' || line[strspn(line, " \t\r\n")] == 0) continue;
+		if(njobs == cap) jobs = realloc(jobs, (cap *= 2)*sizeof(Job));
+		if(!ParseJob(line, &jobs[njobs])){
+			fprintf(stderr, "%s: bad line: %s", path, line);
+			return 2;
+		}
+		njobs++;
+	}
+	fclose(f);
+
+	//The planner has no state of its own, so the threads only share the job counter
+	outcomes = calloc(njobs, sizeof(Outcome));
+	th = malloc(nthreads*sizeof(pthread_t));
+	for(n = 0; n<nthreads; n++) pthread_create(&th[n], 0, Worker, 0);
+	for(n = 0; n<nthreads; n++) pthread_join(th[n], 0);
+
+	for(n = 0; n<njobs; n++){
+		const Outcome *o = &outcomes[n];
+		if(!o->ok){
+			printf("FAIL\n");
+			failed++;
+			continue;
+		}
+		for(i = 0; i<o->plan.ntones; i++){
+			const CohTone *t = &o->plan.tone[i];
+			printf("%u %u.%03u 0x%08X %u %u %u ", t->bin, t->mhz/1000, t->mhz%1000, t->tw, t->fa, t->fb, t->exact);
+		}
+		printf("%.3g\n", o->err);
+	}
+	fprintf(stderr, "%u plans, %u failed\n", njobs, failed);
+	return failed != 0;
+}
+
+int main(int argc, char **argv){
+	uint32_t nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if(argc>=3 && !strcmp(argv[1], "--batch")){
+		if(argc>=5 && !strcmp(argv[3], "--jobs")) nthreads = strtoul(argv[4], 0, 0);
+		return Batch(argv[2], nthreads ? nthreads : 1);
+	}
+	if(argc>=5) return Single(argc-1, argv+1);
+
+	fprintf(stderr, "usage: %s <fs> <fadc> <n> <freq> [freq2]\n       %s --batch <file> [--jobs n]\n", argv[0],
+			argv[0]);
+	return 2;
+}
@@ -0,0 +1,1398 @@
+/*
+ * Host simulator for the quadrature generator. Runs the firmware's generator.c on a PC,
+ * standing in for the DMA interrupt by calling Populate() on alternate buffer halves.
+ *
+ * Build from this directory with:
+ *     gcc -O2 -I.. -o sim sim.c ../generator.c ../cmd.c ../wavepack.c ../wavelib.c ../alc.c ../track.c ../asrc.c ../pdm.c -lm
+ *
+ * Usage:
+ *     sim hop [dwell frames] [seconds] [seed]
+ *         Frequency hopping check - output is compared sample for sample against an
+ *         independent model of the hop plan, and the instantaneous frequency recovered
+ *         from the I/Q pair is used to measure settling and check phase continuity.
+ *
+ *     sim record <log> [seconds] [seed]
+ *         Runs a random control session through the firmware's command path, with the
+ *         background wavetable rebuild progressing at random rates, and writes the
+ *         session record in the same format as cmdlog dumped from a board.
+ *
+ *     sim replay <log> <frames> [ff]
+ *         Replays a session record (from "record" or from a board) for the given number of
+ *         frames and prints a hash of the output and the final generator state. With ff,
+ *         stretches with no events are skipped with GenSkip() and only the FF_WINDOW
+ *         blocks after each event are generated and hashed, the final state is unchanged.
+ *
+ *     sim css [lock us] [hsi ppm]
+ *         Clock security failover - the crystal fails part way through a block, I2S drops
+ *         to HSI until the NMI handler has the PLL locked again (or gives up and stays on
+ *         HSI if the lock time is over its timeout), then the generator is retuned. The
+ *         output frequency is measured from the I/Q samples at the real sample rate before,
+ *         during and after, along with the time until the output is back on frequency.
+ *
+ *     sim pack
+ *         Decodes every table in the compressed library, checks it against the hash
+ *         tools/wavepack.py recorded and reports the compression ratio and decode time.
+ *
+ *     sim dsp [vectors]
+ *         Checks every dsp.h kernel against a 64 bit reference on edge cases and random
+ *         operands, and the fixed-point sine table against libm.
+ *
+ *     sim warm [trials] [seed]
+ *         Warm restart check - snapshots the generator in random modes and tunings, runs
+ *         on for a random number of frames, then resumes a restarted generator from the
+ *         snapshot the way main() does, prefilling twice with a random prefill time, and
+ *         compares its output with the run that carried on.
+ *
+ *     sim skew [chain ns]
+ *         I/Q skew compensation check - the Q channel's analog chain is modelled as chain ns
+ *         late, and the I/Q phase is measured across a sweep with and without SetSkew()
+ *         cancelling it. Compensated, it must stay at 90 degrees to within SKEW_TOL.
+ *
+ *     sim alc [seconds] [tone Hz]
+ *         Level control check - the firmware's alc.c levels the output through a model of
+ *         the analog chain and ADC with a slow gain drift, a load step half way and noise.
+ *         After lock the output must stay within ALC_SIMTOL of the target, except while it
+ *         recovers from the step.
+ *
+ *     sim track [bandwidth Hz] [tone Hz]
+ *         Tracking check - the firmware's track.c locks the output to a modelled input
+ *         through the ADC sampling it would see, for each of a set of scripted inputs:
+ *         frequency offsets, a phase step, a ramp and noise. Prints lock and relock times
+ *         and the phase error (jitter) against the input, which must stay within twice the
+ *         lock tolerance after each event has settled.
+ *
+ *     sim asrc [tone Hz] [packet samples]
+ *         Streamed upconversion check - a sender with its own clock, off by up to 900ppm
+ *         and stepping part way through one script, streams a baseband tone in packets into
+ *         the ring while asrc.c tracks it. Prints the interpolator's SNR on its own, then
+ *         per script the lock time, the drift estimate, the worst fill error after lock
+ *         and the output SNR. Nothing may be dropped or repeated.
+ *
+ *     sim pdm [tone Hz]
+ *         PDM output check - the sigma-delta modulator in pdm.c turns the generator's I
+ *         channel into a bitstream at a range of levels, and the noise and distortion it adds
+ *         up to FS/2 are measured by FFT against its input. Prints SNR against level, then
+ *         runs a full scale square, the hardest input for the loop. It must never need a
+ *         reset and must reach PDM_SIMSNR at full scale.
+ *
+ *     sim pulse [pri] [width] [chirp Hz] [seconds]
+ *         Pulsed mode check - output under both phase policies is compared sample for
+ *         sample against an independent model, with a stretch in the middle skipped with
+ *         GenSkip(). Then times Populate() against duty cycle, plain and chirped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "generator.h"
+#include "dsp.h"
+#include "cmd.h"
+#include "wavepack.h"
+#include "alc.h"
+#include "adc.h"
+#include "track.h"
+#include "asrc.h"
+#include "pdm.h"
+#include "retain.h"
+
+#define FRAMES_PER_HALF	(DMA_BUFSIZ/2)
+
+//Run the generator for one half buffer, as the DMA interrupt would
+static const int16_t *SimHalf(void){
+	static uint8_t half = 0;
+	const int16_t *p = &dmabuf[half*DMA_BUFSIZ];
+
+	Populate(half*DMA_BUFSIZ);
+	half ^= 1;
+	return p;
+}
+
+//Hop plan used by the hop test: 16 channels, 2kHz to 17kHz in 1kHz steps
+#define HOP_BASE	2000
+#define HOP_SPACING	1000
+#define HOP_NCHAN	16
+
+static int SimHop(int argc, char **argv){
+	uint32_t dwell = argc>0 ? strtoul(argv[0], 0, 0) : 23;
+	double seconds = argc>1 ? atof(argv[1]) : 10.0;
+	uint32_t seed = argc>2 ? strtoul(argv[2], 0, 0) : 0x1234;
+	uint32_t frames = (uint32_t)(seconds*FS)/FRAMES_PER_HALF*FRAMES_PER_HALF;
+	uint32_t plan[HOP_MAXCHAN], f, k, idx = 0, left = 0, ph, mtw = 0, mismatches = 0;
+	uint32_t hops = 0, settlemax = 0, settle = 0, chanerr = 0;
+	double preva, a = 0, delta, dph = 0, fest, jump = 0;
+	const int16_t *buf, *wt;
+	int32_t chan, want;
+	uint8_t settled = 1;
+
+	//Settle the generator at its default frequency first so the hop starts mid stream, and
+	//seed the frequency estimator from its last frame
+	GenInit();
+	for(k = 0; k<64; k++) buf = SimHalf();
+	delta = 2*M_PI*tw/4294967296.0;
+	k = FRAMES_PER_HALF-1;
+	preva = atan2((buf[2*k + 1] - buf[2*k]*sin(delta))/cos(delta), buf[2*k]);
+
+	if(!HopConfig(HOP_BASE, HOP_SPACING, HOP_NCHAN, dwell, seed)){
+		fprintf(stderr, "invalid hop plan\n");
+		return 2;
+	}
+	memcpy(plan, hoptw, sizeof(plan));
+
+	//Reference model continues from the generator's accumulator
+	ph = phac;
+	wt = chwt[0];
+
+	for(f = 0; f<frames; f += FRAMES_PER_HALF){
+		buf = SimHalf();
+
+		for(k = 0; k<FRAMES_PER_HALF; k++){
+			//Model: hop on exact frame boundaries, accumulator untouched
+			if(left == 0){
+				mtw = plan[idx];
+				if(++idx == HOP_NCHAN) idx = 0;
+				left = dwell;
+				hops++;
+				settled = 0;
+				settle = 0;
+			}
+			left--;
+
+			if(wt[((ph>>24) + 64)&255] != buf[2*k]) mismatches++;
+			ph += mtw;
+			if(wt[ph>>24] != buf[2*k + 1]) mismatches++;
+			ph += mtw;
+
+			//Instantaneous frequency from the I/Q pair. The right sample is taken one
+			//accumulator step (delta) after the left, so undo that skew with
+			//R = sin(a)cos(delta) + cos(a)sin(delta) before taking the angle.
+			delta = 2*M_PI*mtw/4294967296.0;
+			a = atan2((buf[2*k + 1] - buf[2*k]*sin(delta))/cos(delta), buf[2*k]);
+			dph = a - preva;
+			while(dph<=-M_PI) dph += 2*M_PI;
+			while(dph>M_PI) dph -= 2*M_PI;
+			preva = a;
+			fest = dph*FS/(2*M_PI);
+
+			//Classify to the nearest channel, count frames until it matches the model
+			chan = (int32_t)floor((fest - HOP_BASE)/HOP_SPACING + 0.5);
+			want = (int32_t)((mtw/TW_PER_HZ - HOP_BASE)/HOP_SPACING);
+			if(!settled){
+				if(chan == want){
+					settled = 1;
+					if(settle>settlemax) settlemax = settle;
+				}
+				else settle++;
+			}
+			else if(chan != want){
+				chanerr++;
+			}
+
+			//Largest frame to frame phase step seen, should never exceed the highest channel
+			if(fabs(dph)>jump) jump = fabs(dph);
+		}
+	}
+
+	printf("frames          %u (%.2fs)\n", frames, (double)frames/FS);
+	printf("hops            %u (%.0f hops/s, dwell %u frames)\n", hops, (double)hops*FS/frames, dwell);
+	printf("sample errors   %u\n", mismatches);
+	printf("settling        %u frames max\n", settlemax);
+	printf("off channel     %u frames after settling\n", chanerr);
+	printf("max phase step  %.1f deg (top channel %.1f deg)\n", jump*180/M_PI,
+			360.0*(HOP_BASE + (HOP_NCHAN-1)*HOP_SPACING)/FS);
+
+	//Settling of one frame is 8 bit phase quantisation in the estimator, a phase step beyond
+	//half a channel above the top channel would be a discontinuity
+	if(mismatches || chanerr || settlemax>1 ||
+			jump>2*M_PI*(HOP_BASE + (HOP_NCHAN-0.5)*HOP_SPACING)/FS){
+		printf("FAIL\n");
+		return 1;
+	}
+	printf("PASS\n");
+	return 0;
+}
+
+//Pulsed mode load table, duty cycles in percent (0 and 100 are a 1 frame pulse and gap)
+#define PULSE_LOADBLOCKS	100000
+static const uint8_t pulseduty[] = {0, 10, 25, 50, 75, 90, 100};
+
+//One policy of the pulse check, returns the number of samples that differ from the model
+static uint32_t SimPulseRun(uint32_t pri, uint32_t width, int32_t chirp, uint8_t policy, uint32_t blocks,
+		uint32_t *pulses){
+	uint32_t b, k, n, sweep = chirp<0 ? -chirp : chirp, ptw, ref, ph = 0, mtw = 0, pos = 0, bad = 0;
+	const int16_t *buf, *wt;
+	int16_t l, r;
+	int32_t step;
+
+	//Start mid stream so the coherent policy has a phase to keep. GenInit() leaves the mode
+	//alone, the previous run's pulses are still going.
+	GenInit();
+	PulseStop();
+	SetFrequency(FREQOUT);
+	for(k = 0; k<7; k++) SimHalf();
+	ptw = tw;
+	ref = phac;
+	wt = chwt[0];
+	step = (int32_t)((uint64_t)TW_PER_HZ*sweep/(width>1 ? width-1 : 1));
+	if(chirp<0) step = -step;
+
+	*pulses = 0;
+	if(!PulseConfig(pri, width, chirp, policy)) return ~0U;
+
+	for(b = 0; b<blocks; b += n){
+		//The middle third is skipped in odd sized jumps, the model still steps every frame
+		if(b>=blocks/3 && b<2*blocks/3){
+			n = 1 + b%5;
+			if(b + n>2*blocks/3) n = 2*blocks/3 - b;
+			GenSkip(n);
+			buf = 0;
+		}
+		else{
+			n = 1;
+			buf = SimHalf();
+		}
+
+		for(k = 0; k<n*FRAMES_PER_HALF; k++){
+			if(pos == 0){
+				mtw = ptw;
+				ph = policy == PULSE_COHERENT ? ref : 0;
+				(*pulses)++;
+			}
+			if(pos<width){
+				l = wt[((ph>>24) + 64)&255];
+				ph += mtw;
+				r = wt[ph>>24];
+				ph += mtw;
+				mtw += step;
+			}
+			else{
+				l = r = 0;
+			}
+			if(buf && (buf[2*k] != l || buf[2*k + 1] != r)) bad++;
+
+			//A continuous carrier, for the coherent policy
+			ref += ptw<<1;
+			if(++pos == pri) pos = 0;
+		}
+	}
+
+	//Skipping must leave the oscillator where generating would have
+	if(phac != ph || tw != mtw) bad++;
+	return bad;
+}
+
+//Host time per frame for Populate() in the current mode, after a warm up
+static double SimPulseLoad(void){
+	struct timespec t0, t1;
+	uint32_t k;
+
+	for(k = 0; k<PULSE_LOADBLOCKS/10; k++) SimHalf();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for(k = 0; k<PULSE_LOADBLOCKS; k++) SimHalf();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return ((t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec))/PULSE_LOADBLOCKS/FRAMES_PER_HALF;
+}
+
+static int SimPulse(int argc, char **argv){
+	uint32_t pri = argc>0 ? strtoul(argv[0], 0, 0) : 1000;
+	uint32_t width = argc>1 ? strtoul(argv[1], 0, 0) : 137;
+	int32_t chirp = argc>2 ? strtol(argv[2], 0, 0) : 2000;
+	double seconds = argc>3 ? atof(argv[3]) : 2.0;
+	uint32_t blocks = (uint32_t)(seconds*FS)/FRAMES_PER_HALF, bad, pulses = 0, n, w;
+	double ns[2], cont;
+	uint8_t policy, c;
+	int fail = 0;
+
+	for(policy = PULSE_COHERENT; policy<=PULSE_RESET; policy++){
+		bad = SimPulseRun(pri, width, chirp, policy, blocks, &pulses);
+		if(bad == ~0U){
+			fprintf(stderr, "invalid pulse timing or chirp\n");
+			return 2;
+		}
+		printf("%-15s %u pulses, %u sample errors\n", policy == PULSE_COHERENT ? "coherent" : "reset", pulses,
+				bad);
+		fail |= bad != 0;
+	}
+
+	//Load against duty cycle on this machine, relative to continuous output. On the target
+	//see benchpulse in main.c.
+	PulseStop();
+	SetFrequency(FREQOUT);
+	cont = SimPulseLoad();
+	printf("continuous      %.2f ns/frame\n", cont);
+	printf("duty   plain ns/frame   chirp ns/frame\n");
+	for(n = 0; n<sizeof(pulseduty); n++){
+		w = (uint64_t)pri*pulseduty[n]/100;
+		if(w<1) w = 1;
+		if(w>pri-1) w = pri-1;
+		for(c = 0; c<2; c++){
+			PulseStop();
+			SetFrequency(FREQOUT);
+			PulseConfig(pri, w, c ? chirp : 0, PULSE_COHERENT);
+			ns[c] = SimPulseLoad();
+		}
+		printf("%3u%%   %5.2f (%3.0f%%)      %5.2f (%3.0f%%)\n", pulseduty[n], ns[0], 100*ns[0]/cont, ns[1],
+				100*ns[1]/cont);
+	}
+
+	printf("%s\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
+
+//Reference kernels, the obvious 64 bit versions
+static int32_t RefSat(int64_t x, int64_t lo, int64_t hi){
+	return x<lo ? lo : x>hi ? hi : x;
+}
+
+//Edge operands mixed in with the random ones
+static const uint32_t dspedge[] = {
+	0, 1, 2, 0x7FFF, 0x8000, 0xFFFF, 0x10000, 0x7FFFFFFF, 0x80000000, 0x80000001,
+	0xFFFFFFFF, 0xFFFFFFFE, 0xFFFF8000, 0xFFFF7FFF, 0x00018000, 0x55555555, 0xAAAAAAAA
+};
+#define DSP_NEDGE	(sizeof(dspedge)/sizeof(dspedge[0]))
+
+static int SimDsp(int argc, char **argv){
+	uint32_t vectors = argc>0 ? strtoul(argv[0], 0, 0) : 10000000;
+	uint32_t n, a, b, s = 0x2545F491, errors = 0;
+	int16_t a16, b16, ref;
+	uint8_t sh;
+
+	for(n = 0; n<vectors; n++){
+		if(n<DSP_NEDGE*DSP_NEDGE){
+			a = dspedge[n/DSP_NEDGE];
+			b = dspedge[n%DSP_NEDGE];
+		}
+		else{
+			s ^= s<<13; s ^= s>>17; s ^= s<<5; a = s;
+			s ^= s<<13; s ^= s>>17; s ^= s<<5; b = s;
+		}
+		a16 = a;
+		b16 = b;
+		sh = (b>>16)%31 + 1;
+
+		if(UMulHi32(a, b) != (uint32_t)(((uint64_t)a*b)>>32)) errors++;
+		if(SMulHi32(a, b) != (int32_t)(((int64_t)(int32_t)a*(int32_t)b)>>32)) errors++;
+		if(Q31Mul(a, b) != (int32_t)(((int64_t)(int32_t)a*(int32_t)b)>>31)) errors++;
+		if(Q30MulR(a, b) != (int32_t)(((int64_t)(int32_t)a*(int32_t)b + (1LL<<29))>>30)) errors++;
+		if(SatAdd32(a, b) != RefSat((int64_t)(int32_t)a + (int32_t)b, INT32_MIN, INT32_MAX)) errors++;
+		if(SatAdd16(a16, b16) != RefSat((int64_t)a16 + b16, -32768, 32767)) errors++;
+		if(Q15Mul(a16, b16) != (int16_t)(((int64_t)a16*b16)>>15)) errors++;
+		ref = RefSat(((int64_t)a16*b16 + (1<<14))>>15, -32768, 32767);
+		if(Q15MulR(a16, b16) != ref) errors++;
+		if(RShiftR((int32_t)a>>1, sh) != (int32_t)(((int64_t)((int32_t)a>>1) + (1LL<<(sh-1)))>>sh)) errors++;
+		if(Lerp16(a16, b16, a>>16) != (int16_t)(a16 + ((((int64_t)b16 - a16)*(int64_t)((a>>16)>>2))>>14))) errors++;
+	}
+
+	GenInit();
+	for(n = 0; n<256; n++){
+		if(sinewt[n] != (int16_t)(32767*sin((double)n*2*M_PI/256.0))) errors++;
+	}
+
+	printf("vectors         %u\n", vectors);
+	printf("mismatches      %u\n", errors);
+	if(errors){
+		printf("FAIL\n");
+		return 1;
+	}
+	printf("PASS\n");
+	return 0;
+}
+
+//FNV-1a over the output, with the frame number of each block mixed in
+static uint32_t Hash(uint32_t h, const void *p, uint32_t len){
+	const uint8_t *b = p;
+
+	while(len--){
+		h ^= *b++;
+		h *= 16777619UL;
+	}
+	return h;
+}
+
+static uint32_t HashBlock(uint32_t h, const int16_t *buf, uint32_t frame){
+	h = Hash(h, &frame, sizeof(frame));
+	return Hash(h, buf, DMA_BUFSIZ*sizeof(int16_t));
+}
+
+static void PrintState(uint32_t hash){
+	printf("frames          %u\n", genframes);
+	printf("output hash     %08x\n", hash);
+	printf("final state     phac %08x/%08x tw %08x/%08x mode %u tables %u:%u/%u:%u\n", phac, phac2, tw, tw2,
+			genmode, waveactive[0], amplactive[0], waveactive[1], amplactive[1]);
+}
+
+static uint32_t Rand(uint32_t *s){
+	*s ^= *s<<13;
+	*s ^= *s>>17;
+	*s ^= *s<<5;
+	return *s;
+}
+
+static int SimRecord(int argc, char **argv){
+	double seconds = argc>1 ? atof(argv[1]) : 10.0;
+	uint32_t seed = argc>2 ? strtoul(argv[2], 0, 0) : 0xC0FFEE;
+	uint32_t blocks = (uint32_t)(seconds*FS)/FRAMES_PER_HALF, n, r, hash = 2166136261UL;
+	const int16_t *buf;
+	uint8_t half = 0;
+	FILE *f;
+
+	if(argc<1){
+		fprintf(stderr, "record needs a log file\n");
+		return 2;
+	}
+	if(seed == 0) seed = 1;
+
+	GenInit();
+	for(n = 0; n<blocks; n++){
+		//A command now and then, bursty like a link would be
+		r = Rand(&seed);
+		if((r&2047) == 0){
+			switch((r>>11)%13){
+			case 0: CmdSubmit(CMD_FREQ, 0, 0, 100 + (r>>12)%20000, 0); break;
+			case 1: CmdSubmit(CMD_AMPL, 0, 0, (r>>12)&0x7FFF, 0); break;
+			case 2: CmdSubmit(CMD_HOP, 4 + (r>>12)%28, 1 + (r>>20)%200, (1000UL<<16) | 500, r); break;
+			case 3: CmdSubmit(CMD_HOPSTOP, 0, 0, 0, 0); break;
+			case 4: CmdSubmit(CMD_AMPL, 0, 0, 32767, 0); CmdSubmit(CMD_FREQ, 0, 0, FREQOUT, 0); break;
+			case 5: CmdSubmit(CMD_FREQ, 0, 0, (r>>12)%23000, 0); break;
+			case 6: CmdSubmit(CMD_DUAL, (r>>12)&1, 0, 0, 0); break;
+			case 7: CmdSubmit(CMD_CHFREQ, (r>>12)&1, 0, (r>>13)%23000, 0); break;
+			case 8: CmdSubmit(CMD_CHWAVE, (r>>12)&1, (r>>13)%(WAVE_LIB + wavelibn), (r>>18)&0x7FFF, 0); break;
+			case 9:
+				CmdSubmit(CMD_TUNEFRAC, 0, 0, (r>>12)%9999, 10007);
+				CmdSubmit(CMD_TUNE, (r>>12)&1, 0, TW_PER_HZ*((r>>13)%23000), 0);
+				break;
+			case 10:
+				CmdSubmit(CMD_PULSE, (r>>12)&1, (r>>13)%4001 - 2000, 2 + (r>>16)%3000, 1 + (r>>20)%2000);
+				break;
+			case 11: CmdSubmit(CMD_PULSESTOP, 0, 0, 0, 0); break;
+			case 12: CmdSubmit(CMD_SKEW, 0, 0, (int32_t)((r>>12)%65535) - GEN_MAXSKEW, 0); break;
+			}
+		}
+
+		//DMA interrupt
+		CmdApply();
+		buf = &dmabuf[half*DMA_BUFSIZ];
+		Populate(half*DMA_BUFSIZ);
+		hash = HashBlock(hash, buf, genframes - FRAMES_PER_HALF);
+		half ^= 1;
+
+		//Idle loop gets a random amount of time between interrupts
+		r = Rand(&seed)&3;
+		while(r--) RegenWavetable();
+	}
+
+	if(!(f = fopen(argv[0], "wb")) || fwrite(cmdlog, sizeof(Cmd), cmdlogn, f) != cmdlogn){
+		fprintf(stderr, "can't write %s\n", argv[0]);
+		return 2;
+	}
+	fclose(f);
+
+	printf("events          %u%s\n", cmdlogn, cmdlogfull ? " (record full)" : "");
+	PrintState(hash);
+	if(cmdlogfull) printf("record filled up, replay will stop matching after the last event\n");
+	printf("replay with     sim replay %s %u\n", argv[0], genframes);
+	return 0;
+}
+
+//Blocks generated after each event when fast forwarding
+#define FF_WINDOW	64
+
+//Clock failover model, timings match NMI_Handler() in main.c at 8MHz: exception entry and
+//the register writes before the PLL is enabled, and the PLL_TIMEOUT polling loop
+#define CSS_ENTRYUS		(60/8.0)
+#define CSS_TIMEOUTUS	1000.0
+#define CSS_TONE		1000
+
+//Run the generator for a number of blocks and measure the output frequency, given the rate
+//the DAC is actually being clocked at. Returns Hz, the phase of the I/Q pair is unwrapped
+//frame to frame so the constant L/R skew drops out.
+static double SimTone(uint32_t blocks, double fs, double *last){
+	double ph, dph, total = 0;
+	const int16_t *buf;
+	uint32_t b, k;
+
+	for(b = 0; b<blocks; b++){
+		CmdApply();
+		buf = SimHalf();
+		for(k = 0; k<FRAMES_PER_HALF; k++){
+			ph = atan2(buf[2*k+1], buf[2*k]);
+			dph = remainder(ph - *last, 2*M_PI);
+			total += dph;
+			*last = ph;
+		}
+	}
+
+	return total/(2*M_PI)/(blocks*FRAMES_PER_HALF)*fs;
+}
+
+static int SimCss(int argc, char **argv){
+	double lockus = argc>0 ? atof(argv[0]) : 200.0;
+	double ppm = argc>1 ? atof(argv[1]) : 10000.0;
+	double hsi = 8e6*(1 + ppm*1e-6), clk, fsgap, fsafter, tfail, tdone, t, last = 0;
+	double fbefore, fgap, fafter;
+	uint32_t blocks, fsnom, n;
+	uint8_t locked = lockus<CSS_TIMEOUTUS;
+
+	GenInit();
+	SetFrequency(CSS_TONE);
+
+	//Quarter of a second on the crystal, SimTone() also seeds the phase
+	blocks = FS/4/FRAMES_PER_HALF;
+	SimTone(1, FS, &last);
+	fbefore = SimTone(blocks, FS, &last);
+
+	//Crystal fails 30% of the way into the next block. The sample rate scales with SYSCLK,
+	//48MHz gives FS.
+	tfail = 0.3*FRAMES_PER_HALF/FS;
+	fsgap = FS*hsi/48e6;
+	clk = locked ? hsi*6 : hsi;
+	tdone = tfail + (CSS_ENTRYUS + (locked ? lockus : CSS_TIMEOUTUS))*1e-6;
+
+	//The handler's view of the new rate uses the nominal HSI
+	fsnom = (uint32_t)((locked ? 48e6 : 8e6)/48e6*FS + 0.5);
+	fsafter = FS*clk/48e6;
+
+	//The block in flight finishes at the HSI rate, as does every block generated before the
+	//handler finishes. It pends the retune and the next block's CmdApply() applies it.
+	fgap = SimTone(1, fsgap, &last);
+	t = tfail + (FRAMES_PER_HALF - tfail*FS)/fsgap;
+	for(n = 1; t<tdone; n++){
+		fgap += SimTone(1, fsgap, &last);
+		t += FRAMES_PER_HALF/fsgap;
+	}
+	GenRetunePend(fsnom);
+	fgap /= n;
+
+	blocks = (uint32_t)(fsafter/2)/FRAMES_PER_HALF;
+	fafter = SimTone(blocks, fsafter, &last);
+
+	printf("failover        %s, lock %.0fus, HSI %+.0fppm\n", locked ? "HSI PLL" : "HSI (PLL timed out)", lockus, ppm);
+	printf("sample rate     %u -> %.1f -> %.1f Hz, retuned for %u\n", FS, fsgap, fsafter, fsnom);
+	printf("handler done    %.1fus after the failure\n", (tdone - tfail)*1e6);
+	printf("back on freq    %.1fus after the failure, %u blocks at the HSI rate\n", (t - tfail)*1e6, n);
+	printf("tone            %.3f Hz before, %.3f during, %.3f after (%+.0fppm)\n", fbefore, fgap, fafter,
+			(fafter/CSS_TONE - 1)*1e6);
+	printf("telemetry       %s\n", cmdlogn && cmdlog[cmdlogn-1].op == EV_CLOCK && cmdlog[cmdlogn-1].a == fsnom ?
+			"EV_CLOCK logged" : "EV_CLOCK missing");
+
+	//Within the HSI tolerance plus the rounding of the retuned rate
+	if(fabs(fafter/CSS_TONE - 1)>fabs(ppm)*1e-6 + 1e-4 || !cmdlogn || cmdlog[cmdlogn-1].op != EV_CLOCK){
+		printf("FAIL\n");
+		return 1;
+	}
+	printf("PASS\n");
+	return 0;
+}
+
+//Skew check sweep, frames fitted per frequency and the flatness it must meet in degrees.
+//Truncating the phase to an 8 bit table index leaves up to about 0.1 degree on its own.
+#define SKEW_FRAMES	8192
+#define SKEW_STEP	250
+#define SKEW_TOL	0.2
+
+//Phase in degrees of a tone at f Hz in n samples taken at times t0 + k/fs, by least squares
+static double SkewPhase(const int16_t *x, uint32_t n, double f, double t0){
+	double cc = 0, ss = 0, cs = 0, xc = 0, xs = 0, a, b, c, s, det;
+	uint32_t k;
+
+	for(k = 0; k<n; k++){
+		c = cos(2*M_PI*f*(t0 + (double)k/FS));
+		s = sin(2*M_PI*f*(t0 + (double)k/FS));
+		cc += c*c;
+		ss += s*s;
+		cs += c*s;
+		xc += x[2*k]*c;
+		xs += x[2*k]*s;
+	}
+
+	//x = a cos + b sin = A cos(wt + phase) with a = A cos(phase), b = -A sin(phase)
+	det = cc*ss - cs*cs;
+	a = (xc*ss - xs*cs)/det;
+	b = (xs*cc - xc*cs)/det;
+	return atan2(-b, a)*180/M_PI;
+}
+
+//Worst deviation from quadrature across the sweep, the Q channel chain s late
+static double SkewSweep(double chain){
+	static int16_t buf[SKEW_FRAMES*2];
+	double f, d, worst = 0;
+	uint32_t hz;
+
+	for(hz = SKEW_STEP; hz<FS/2; hz += SKEW_STEP){
+		SetFrequency(hz);
+		f = 2.0*tw*FS/4294967296.0;
+		GenRender(buf, SKEW_FRAMES);
+
+		//Left goes out at the frame, right in the next I2S slot and then through its chain.
+		//The sine should lag the cosine by 90 degrees.
+		d = SkewPhase(buf + 1, SKEW_FRAMES, f, 0.5/FS + chain) - SkewPhase(buf, SKEW_FRAMES, f, 0) + 90;
+		while(d<=-180) d += 360;
+		while(d>180) d -= 360;
+		if(fabs(d)>fabs(worst)) worst = d;
+	}
+	return worst;
+}
+
+static int SimSkew(int argc, char **argv){
+	double chain = (argc>0 ? atof(argv[0]) : 2000)*1e-9, raw, fixed;
+	int32_t skew = (int32_t)floor(chain*FS*65536 + 0.5);
+
+	if(skew>GEN_MAXSKEW || skew<-GEN_MAXSKEW){
+		fprintf(stderr, "chain delay out of range, at most %.0f ns\n", GEN_MAXSKEW*1e9/65536/FS);
+		return 2;
+	}
+
+	GenInit();
+	PulseStop();
+	HopStop();
+	DualStop();
+	SetSkew(0);
+	raw = SkewSweep(chain);
+	SetSkew(skew);
+	fixed = SkewSweep(chain);
+	SetSkew(0);
+
+	printf("chain           %.1f ns, %d/65536 frame\n", chain*1e9, skew);
+	printf("uncompensated   %+.3f deg worst, %u to %u Hz\n", raw, SKEW_STEP, (FS/2 - 1)/SKEW_STEP*SKEW_STEP);
+	printf("compensated     %+.4f deg worst\n", fixed);
+	printf("%s\n", fabs(fixed)>SKEW_TOL ? "FAIL" : "PASS");
+	return fabs(fixed)>SKEW_TOL;
+}
+
+//Level control plant: full scale (Q15 32767) gives ALC_PLANTPK counts peak at the ADC,
+//scaled by a slow gain drift of ALC_PLANTDRIFT over ALC_PLANTPERIOD s and a load step of
+//ALC_PLANTSTEP at half time, with ALC_PLANTNOISE counts RMS of noise
+#define ALC_PLANTPK		1500.0
+#define ALC_PLANTDRIFT	0.06
+#define ALC_PLANTPERIOD	400.0
+#define ALC_PLANTSTEP	0.94
+#define ALC_PLANTNOISE	1.5
+
+//Target level and the amplitude the generator starts at, about 1dB short of it
+#define ALC_SIMAMPL		20000
+#define ALC_SIMSTART	18000
+
+//Settling allowed after the load step before deviation counts again, s
+#define ALC_SIMSETTLE	20.0
+#define ALC_SIMTOL		0.05
+
+static double SimGauss(uint32_t *seed){
+	double u = (Rand(seed) + 1.0)/4294967297.0, v = Rand(seed)/4294967296.0;
+
+	return sqrt(-2*log(u))*cos(2*M_PI*v);
+}
+
+static double SimPlant(double t, double seconds){
+	return (1 + ALC_PLANTDRIFT*sin(2*M_PI*t/ALC_PLANTPERIOD))*(t>=seconds/2 ? ALC_PLANTSTEP : 1);
+}
+
+static int SimAlc(int argc, char **argv){
+	double seconds = argc>0 ? atof(argv[0]) : 1200, freq = argc>1 ? atof(argv[1]) : 1000;
+	uint32_t div = (48000000 + ALC_RATE/2)/ALC_RATE, seed = 0xA1C, n, k, pos = 0, blocks = 0;
+	double rate = 48000000.0/div, want = ALC_SIMAMPL*ALC_PLANTPK/32767, t, dev, worst = 0, open = 0;
+	double lockt = -1, recovt = -1, maxstep = 0, nextadc = 0, v;
+	uint64_t frame = 0, end = (uint64_t)(seconds*FS);
+	static uint16_t adc[ADC_BUFSIZ/2];
+	uint16_t last;
+	uint8_t state;
+	const int16_t *p;
+
+	GenInit();
+	PulseStop();
+	HopStop();
+	DualStop();
+	SetSkew(0);
+	SetFrequency(freq);
+	WavetableNow(0, WAVE_SINE, ALC_SIMSTART);
+	SetAmplitude(ALC_SIMSTART);
+	AlcStart(floor(want/sqrt(2) + 0.5));
+	last = amplactive[0];
+
+	while(frame<end){
+		CmdApply();
+		p = SimHalf();
+		for(n = 0; n<FRAMES_PER_HALF; n++, frame++){
+			if(frame<nextadc) continue;
+			nextadc += FS/rate;
+
+			//The analog chain and the ADC, DC offset included for the detector to ignore
+			t = (double)frame/FS;
+			for(k = 0; k<2; k++){
+				v = 2060 + p[2*n + k]*SimPlant(t, seconds)*ALC_PLANTPK/32767 + ALC_PLANTNOISE*SimGauss(&seed);
+				v = floor(v + 0.5);
+				adc[2*pos + k] = v<0 ? 0 : v>ADC_FULL ? ADC_FULL : v;
+			}
+			if(++pos<ADC_BUFSIZ/4) continue;
+			pos = 0;
+
+			//What TaskAlc() does with each half, then the wavetable rebuild it triggers
+			if(AlcFeed(adc, ADC_BUFSIZ/4)) blocks++;
+			while(RegenWavetable());
+		}
+
+		//Output level against the target once per half, from the table actually in use
+		t = (double)frame/FS;
+		dev = 20*log10(amplactive[0]*SimPlant(t, seconds)*ALC_PLANTPK/32767/want);
+		if(fabs(20*log10(SimPlant(t, seconds))) > open) open = fabs(20*log10(SimPlant(t, seconds)));
+		if(amplactive[0] != last){
+			if(fabs(20*log10((double)amplactive[0]/last))>maxstep) maxstep = fabs(20*log10((double)amplactive[0]/last));
+			last = amplactive[0];
+		}
+		if(lockt<0){
+			if(alcstate == ALC_LOCKED) lockt = t;
+			continue;
+		}
+		if(t>=seconds/2 && recovt<0 && fabs(dev)<=ALC_SIMTOL) recovt = t - seconds/2;
+		if(t>=seconds/2 && t<seconds/2 + ALC_SIMSETTLE) continue;
+		if(fabs(dev)>fabs(worst)) worst = dev;
+	}
+	state = alcstate;
+	AlcStop();
+
+	printf("plant           %.0f%% drift over %.0f s, %+.2f dB step at %.0f s, %.1f counts noise\n",
+			ALC_PLANTDRIFT*100, ALC_PLANTPERIOD, 20*log10(ALC_PLANTSTEP), seconds/2, ALC_PLANTNOISE);
+	printf("adc             %.2f Hz, %u pair blocks, %u updates, tone %.0f Hz\n", rate, ALC_FRAMES, blocks, freq);
+	printf("open loop       %.3f dB worst\n", open);
+	printf("locked          %.1f s from %+.2f dB\n", lockt, 20*log10((double)ALC_SIMSTART/ALC_SIMAMPL));
+	printf("step recovery   %.1f s to within %.2f dB\n", recovt, ALC_SIMTOL);
+	printf("closed loop     %+.4f dB worst after lock, %.0f s after the step excluded\n", worst, ALC_SIMSETTLE);
+	printf("largest step    %.4f dB\n", maxstep);
+	printf("final           gain %.2f, state %u\n", alcgain/65536.0, state);
+	printf("record          %u entries, %u trims left out%s\n", cmdlogn, cmdtrims, cmdlogfull ? ", FULL" : "");
+	if(lockt<0 || recovt<0 || fabs(worst)>ALC_SIMTOL || cmdlogfull){
+		printf("FAIL\n");
+		return 1;
+	}
+	printf("PASS\n");
+	return 0;
+}
+
+//Tracking input, ADC counts peak, and the settling allowed after each scripted event
+//before the phase error counts, s
+#define TRACK_SIMAMPL	1000.0
+#define TRACK_SIMSETTLE	1.0
+
+//Scripted inputs: frequency offset from the start frequency (Hz), a phase step (degrees)
+//at 1/3 of the run, a frequency ramp (Hz/s) from 1/3 to 2/3 and noise (SNR dB, 0 none)
+typedef struct {
+	const char *name;
+	double offset, step, ramp, snr, seconds;
+} TrackScript;
+
+static const TrackScript trackscripts[] = {
+	{"offset 2Hz", 2, 0, 0, 0, 3},
+	{"offset 20Hz", 20, 0, 0, 0, 3},
+	{"phase 90deg", 0.2, 90, 0, 0, 3},
+	{"ramp 0.2Hz/s", 0.2, 0, 0.2, 0, 6},
+	{"snr 20dB", 0.2, 0, 0, 20, 3},
+	{"snr 10dB", 0.2, 0, 0, 10, 3},
+};
+
+#define TRACK_NSCRIPTS	(sizeof(trackscripts)/sizeof(trackscripts[0]))
+
+//Input phase in cycles at time t
+static double TrackPhase(const TrackScript *sc, double f, double t){
+	double a = sc->seconds/3, b = 2*sc->seconds/3, ph = (f + sc->offset)*t + 0.3;
+
+	if(t>a) ph += sc->step/360;
+	if(t>a) ph += sc->ramp*(t<b ? (t-a)*(t-a) : (b-a)*(b-a) + 2*(b-a)*(t-b))/2;
+	return ph;
+}
+
+//One script. Returns the lock time (s, -1 for never), with the worst phase error after
+//lock and after each event's settling time, the mean and RMS deviation from it over the
+//last third, and the relock time after the event if it unlocked (-1 if not).
+static double TrackRun(const TrackScript *sc, double f, uint32_t bw, double *worst, double *mean, double *rms,
+		double *relock, uint32_t *seed){
+	static uint16_t adc[TRACK_ADCLEN];
+	uint64_t frame = 0, end = (uint64_t)(sc->seconds*FS), sync = 0;
+	double t, e, lockt = -1, sum = 0, sq = 0, v, ev = sc->seconds/3;
+	double noise = sc->snr ? TRACK_SIMAMPL/sqrt(2)/pow(10, sc->snr/20) : 0;
+	uint32_t n, sqn = 0, pos, g;
+	uint8_t synced = 0, lost = 0;
+
+	GenInit();
+	PulseStop();
+	HopStop();
+	DualStop();
+	SetSkew(0);
+	Populate(0);
+	Populate(DMA_BUFSIZ);
+	TrackStart(f, bw);
+	*worst = 0;
+	*relock = -1;
+
+	while(frame<end){
+		//The half playing, with the ADC sampling every TRACK_DECIM frames from the frame
+		//after the sync point, TRACK_LAG into the frame
+		for(n = 0; n<FRAMES_PER_HALF; n++){
+			g = frame + n;
+			if(!synced || g<=sync || (g - sync - 1)%TRACK_DECIM) continue;
+			t = (g + TRACK_LAG/256.0)/FS;
+			v = ADC_MID + TRACK_SIMAMPL*cos(2*M_PI*TrackPhase(sc, f, t)) + noise*SimGauss(seed);
+			v = floor(v + 0.5);
+			adc[(g - sync - 1)/TRACK_DECIM%TRACK_ADCLEN] = v<0 ? 0 : v>ADC_FULL ? ADC_FULL : v;
+		}
+		frame += FRAMES_PER_HALF;
+
+		//The refill interrupt for that half, starting the ADC at the first half transfer,
+		//then the task
+		pos = (frame/FRAMES_PER_HALF + 1)%2*DMA_BUFSIZ;
+		if(!synced && !pos){
+			TrackSync();
+			sync = frame;
+			synced = 1;
+		}
+		else TrackMix(pos, adc);
+		CmdApply();
+
+		//The half about to be refilled plays a half from now, compare its first frame. The
+		//table index truncates the accumulator, so on average the output is half an entry
+		//behind it.
+		t = (double)(frame + FRAMES_PER_HALF)/FS;
+		e = TrackPhase(sc, f, t) - (phac - (1UL<<23))/4294967296.0;
+		e = (e - floor(e + 0.5))*360;
+		Populate(pos);
+		TrackUpdate();
+
+		if(lockt<0){
+			if(trackstate == TRACK_LOCKED) lockt = t;
+			continue;
+		}
+		if(t>ev && trackstate != TRACK_LOCKED) lost = 1;
+		if(lost && *relock<0 && trackstate == TRACK_LOCKED) *relock = t - ev;
+		if(!(t>ev && t<ev + TRACK_SIMSETTLE) && fabs(e)>fabs(*worst)) *worst = e;
+		if(t>2*ev){
+			sum += e;
+			sq += e*e;
+			sqn++;
+		}
+	}
+	TrackStop();
+	*mean = sqn ? sum/sqn : 0;
+	*rms = sqn ? sqrt(sq/sqn - *mean**mean) : 0;
+	return lockt;
+}
+
+static int SimTrack(int argc, char **argv){
+	double bw = argc>0 ? atof(argv[0]) : 5, f = argc>1 ? atof(argv[1]) : 1000, lockt, worst, mean, rms, relock;
+	uint32_t seed = 0x7AC4, n, fail = 0;
+
+	printf("loop            %.2f Hz noise bandwidth, update every %u frames, input %.0f counts at %.0f Hz\n", bw,
+			TRACK_FRAMES, TRACK_SIMAMPL, f);
+	printf("script          lock s  relock s  worst deg  mean deg  jitter deg  jitter ns\n");
+	for(n = 0; n<TRACK_NSCRIPTS; n++){
+		lockt = TrackRun(&trackscripts[n], f, bw*1000, &worst, &mean, &rms, &relock, &seed);
+		printf("%-15s %6.3f  ", trackscripts[n].name, lockt);
+		if(relock<0) printf("       -");
+		else printf("%8.3f", relock);
+		printf("  %9.3f  %8.3f  %10.4f  %9.1f\n", worst, mean, rms, rms/360/f*1e9);
+		if(lockt<0 || fabs(worst)>TRACK_LOCKTOL*360.0/4294967296.0*2) fail++;
+	}
+	printf("record          %u entries, %u trims left out%s\n", cmdlogn, cmdtrims, cmdlogfull ? ", FULL" : "");
+	if(cmdlogfull) fail++;
+	printf("%s\n", fail ? "FAIL" : "PASS");
+	return fail != 0;
+}
+
+//Streamed upconversion: the link rate the sender is nominally at, its packet size, the
+//baseband tone's amplitude and the IF. At an IF of 0 the output is the interpolated
+//baseband itself, any other and the carrier table's phase truncation (about 44dB) would
+//hide the interpolator.
+#define ASRC_SIMLINK	(FS/4)
+#define ASRC_SIMPACKET	8
+#define ASRC_SIMAMPL	16000.0
+#define ASRC_SIMIF		0
+
+//Packets arrive up to this fraction of a packet late, at random
+#define ASRC_SIMJITTER	0.5
+
+//SNR fit length, frames
+#define ASRC_SIMSEG		4096
+
+//Output SNR each script must meet over its last quarter, dB, and how close the drift
+//estimate must come to the sender's clock, ppm. The fill average's slow wander as the
+//packets slide past the refills keeps the estimate moving by a few ppm.
+#define ASRC_SIMSNR		60.0
+#define ASRC_SIMPPM		5.0
+
+//Scripted senders: clock offset (ppm), a step in it at half time (ppm) and run length (s)
+typedef struct {
+	const char *name;
+	double ppm, step, seconds;
+} AsrcScript;
+
+static const AsrcScript asrcscripts[] = {
+	{"0ppm", 0, 0, 20},
+	{"+100ppm", 100, 0, 20},
+	{"-100ppm", -100, 0, 20},
+	{"+900ppm", 900, 0, 30},
+	{"-900ppm", -900, 0, 30},
+	{"step -+200ppm", -100, 200, 60},
+};
+
+#define ASRC_NSCRIPTS	(sizeof(asrcscripts)/sizeof(asrcscripts[0]))
+
+//SNR in dB of a complex tone at f cycles per frame in n output frames, least squares fits
+//over ASRC_SIMSEG frames at a time so slow wander of the timing doesn't count
+static double AsrcSnr(const int16_t *z, uint32_t n, double f){
+	double ar, ai, c, s, er, ei, sig = 0, noise = 0;
+	uint32_t k, j;
+
+	for(j = 0; j + ASRC_SIMSEG<=n; j += ASRC_SIMSEG){
+		ar = ai = 0;
+		for(k = j; k<j + ASRC_SIMSEG; k++){
+			c = cos(2*M_PI*f*k);
+			s = sin(2*M_PI*f*k);
+			ar += z[2*k]*c + z[2*k + 1]*s;
+			ai += z[2*k + 1]*c - z[2*k]*s;
+		}
+		ar /= ASRC_SIMSEG;
+		ai /= ASRC_SIMSEG;
+		for(k = j; k<j + ASRC_SIMSEG; k++){
+			c = cos(2*M_PI*f*k);
+			s = sin(2*M_PI*f*k);
+			er = z[2*k] - (ar*c - ai*s);
+			ei = z[2*k + 1] - (ar*s + ai*c);
+			noise += er*er + ei*ei;
+		}
+		sig += (ar*ar + ai*ai)*ASRC_SIMSEG;
+	}
+	return 10*log10(sig/noise);
+}
+
+//One script with a baseband tone of fb Hz at the sender's rate, in packets of packet
+//samples. With loop 0 the drift loop is left off and the step set to the sender's actual
+//rate. Returns the lock time (s, -1 for never) with the drift estimate at the end (ppm),
+//the spread of the average fill after lock (samples), the SNR over the last quarter and
+//the underruns and overruns.
+static double AsrcRun(const AsrcScript *sc, double fb, uint32_t packet, uint8_t loop, double *drift,
+		double *wander, double *snr, uint32_t *under, uint32_t *over){
+	uint64_t frame = 0, end = (uint64_t)(sc->seconds*FS)/FRAMES_PER_HALF*FRAMES_PER_HALF;
+	uint64_t from = end - end/4/FRAMES_PER_HALF*FRAMES_PER_HALF;
+	double t, ts = 0, due = 0, ppm = sc->ppm, lockt = -1, lo = 1e9, hi = -1e9;
+	int16_t *z = malloc((end - from)*2*sizeof(int16_t));
+	uint32_t k = 0, n, seed = 0xA5C;
+	const int16_t *p;
+
+	GenInit();
+	PulseStop();
+	HopStop();
+	DualStop();
+	SetSkew(0);
+	AsrcStart(ASRC_SIMIF, ASRC_SIMLINK);
+	CmdApply();
+	if(!loop){
+		AsrcStop();
+		UpconvRatio(UpconvStep(ASRC_SIMLINK)*(1 + ppm*1e-6));
+	}
+
+	while(frame<end){
+		//The sender's packets that have arrived by the refill, each one once its last
+		//sample is out plus the link's delay
+		t = (double)frame/FS;
+		if(t>=sc->seconds/2) ppm = sc->ppm + sc->step;
+		while(due<=t){
+			for(n = 0; n<packet; n++, k++){
+				BBPush(floor(ASRC_SIMAMPL*cos(2*M_PI*fb*k/ASRC_SIMLINK) + 0.5),
+						floor(ASRC_SIMAMPL*sin(2*M_PI*fb*k/ASRC_SIMLINK) + 0.5));
+				ts += 1/(ASRC_SIMLINK*(1 + ppm*1e-6));
+			}
+			due = ts + packet*ASRC_SIMJITTER*Rand(&seed)/4294967296.0/ASRC_SIMLINK;
+		}
+
+		CmdApply();
+		p = SimHalf();
+		if(frame>=from) memcpy(&z[2*(frame - from)], p, DMA_BUFSIZ*sizeof(int16_t));
+		frame += FRAMES_PER_HALF;
+		if(!AsrcUpdate()) continue;
+
+		if(lockt<0){
+			if(asrcstate == ASRC_LOCKED) lockt = (double)frame/FS;
+			continue;
+		}
+		if(asrcfill<lo) lo = asrcfill;
+		if(asrcfill>hi) hi = asrcfill;
+	}
+
+	//The tone at the output, the IF as tuned plus the baseband on the sender's clock
+	*snr = AsrcSnr(z, end - from, tw*2.0/4294967296.0 + fb*(1 + ppm*1e-6)/FS);
+	*drift = asrcdrift/4294.967296;
+	*wander = hi>lo ? (hi - lo)/256 : 0;
+	*under = bbunderruns;
+	*over = bboverruns;
+	if(!loop) lockt = 0;
+	AsrcStop();
+	free(z);
+	return lockt;
+}
+
+static int SimAsrc(int argc, char **argv){
+	double fb = argc>0 ? atof(argv[0]) : 1000, lockt, drift, wander, snr, want;
+	uint32_t packet = argc>1 ? strtoul(argv[1], 0, 0) : ASRC_SIMPACKET, under, over, n, fail = 0;
+	static const double tones[] = {100, 1000, 2000, 3000};
+	static const AsrcScript fixed = {"", 0, 0, 4};
+
+	printf("link            %u Hz nominal in %u sample packets, up to %.0f%% of one late, ring %u\n", ASRC_SIMLINK,
+			packet, ASRC_SIMJITTER*100, BB_RINGSIZ);
+	printf("loop            %.2f rad/s acquiring, %.2f rad/s locked, update every %u frames, range +-%u ppm\n",
+			ASRC_WN/1000.0, ASRC_TRACKWN/1000.0, BB_FILLFRAMES, ASRC_RANGE);
+
+	//The interpolator on its own, at the exact ratio
+	printf("interpolator    ");
+	for(n = 0; n<sizeof(tones)/sizeof(tones[0]); n++){
+		AsrcRun(&fixed, tones[n], packet, 0, &drift, &wander, &snr, &under, &over);
+		printf("%.0f Hz %.1f dB%s", tones[n], snr, n+1<sizeof(tones)/sizeof(tones[0]) ? ", " : " SNR\n");
+	}
+
+	printf("script          lock s  drift ppm  wander  wander us  SNR dB  underruns  overruns   (tone %.0f Hz)\n", fb);
+	for(n = 0; n<ASRC_NSCRIPTS; n++){
+		lockt = AsrcRun(&asrcscripts[n], fb, packet, 1, &drift, &wander, &snr, &under, &over);
+		want = asrcscripts[n].ppm + asrcscripts[n].step;
+		printf("%-15s %6.2f  %9.2f  %6.2f  %9.1f  %6.1f  %9u  %8u\n", asrcscripts[n].name, lockt, drift, wander,
+				wander*1e6/ASRC_SIMLINK, snr, under, over);
+		if(lockt<0 || under || over || snr<ASRC_SIMSNR || fabs(drift - want)>ASRC_SIMPPM) fail++;
+	}
+	printf("record          %u entries, %u trims left out%s\n", cmdlogn, cmdtrims, cmdlogfull ? ", FULL" : "");
+	if(cmdlogfull) fail++;
+	printf("%s\n", fail ? "FAIL" : "PASS");
+	return fail != 0;
+}
+
+//Bitstream length each level is measured over (a power of two for the FFT), about 0.35s,
+//and the frames of settling before it
+#define PDM_SIMBITS		(1UL<<20)
+#define PDM_SIMSETTLE	256
+
+//SNR the modulator must reach in band with a full scale sine, dB. The 2nd order loop's
+//noise floor is about -81dB of its feedback level, rising as the input nears its limit.
+#define PDM_SIMSNR		68.0
+
+//Bins either side of the tone (and of DC) that are signal rather than noise, the window's
+//main lobe is four
+#define PDM_SIMLOBE		6
+
+//In place radix 2 FFT
+static void Fft(double *re, double *im, uint32_t n){
+	uint32_t i, j, k, len;
+	double wr, wi, tr, ti, a;
+
+	for(i = 1, j = 0; i<n; i++){
+		for(k = n>>1; j&k; k >>= 1) j ^= k;
+		j |= k;
+		if(i<j){
+			tr = re[i]; re[i] = re[j]; re[j] = tr;
+			ti = im[i]; im[i] = im[j]; im[j] = ti;
+		}
+	}
+	for(len = 2; len<=n; len <<= 1){
+		for(k = 0; k<len/2; k++){
+			a = -2*M_PI*k/len;
+			wr = cos(a);
+			wi = sin(a);
+			for(i = k; i<n; i += len){
+				j = i + len/2;
+				tr = re[j]*wr - im[j]*wi;
+				ti = re[j]*wi + im[j]*wr;
+				re[j] = re[i] - tr;
+				im[j] = im[i] - ti;
+				re[i] += tr;
+				im[i] += ti;
+			}
+		}
+	}
+}
+
+//Modulate PDM_SIMBITS of the generator's output as it is set up and return the noise and
+//distortion the modulator adds up to FS/2, as a power against its full scale in dB. The
+//generator's own spurs aren't counted: the error is taken against the modulator's input,
+//interpolated as it does and a bit late, as the loop delays it.
+static double PdmNoise(void){
+	static int16_t buf[(PDM_SIMSETTLE + PDM_SIMBITS/PDM_OSR)*2];
+	static uint16_t bits[PDM_SIMSETTLE*PDM_WORDS + PDM_SIMBITS/16];
+	static double re[PDM_SIMBITS], im[PDM_SIMBITS];
+	const uint32_t band = PDM_SIMBITS/PDM_OSR/2;
+	const uint16_t *b = &bits[PDM_SIMSETTLE*PDM_WORDS];
+	const int16_t *x = &buf[PDM_SIMSETTLE*2], *p;
+	double w, noise = 0, wsum = 0;
+	int32_t d;
+	uint32_t k, n;
+
+	PdmInit();
+	GenRender(buf, PDM_SIMSETTLE + PDM_SIMBITS/PDM_OSR);
+	PdmModulate(bits, buf, PDM_SIMSETTLE + PDM_SIMBITS/PDM_OSR);
+
+	//The modulator's input for each bit, ramping over each frame's words from the last sample
+	for(k = 0; k<PDM_SIMBITS/16; k++){
+		p = &x[2*(int32_t)(k/PDM_WORDS)];
+		d = p[0] - p[-2];
+		for(n = 0; n<16; n++) re[16*k + n] = p[-2] + ((d*(int32_t)(k%PDM_WORDS + 1))>>PDM_LOG2WORDS);
+	}
+
+	//Output bit less the input one bit before, windowed (4 term Blackman-Harris, sidelobes
+	//at -92dB). Backwards so the input the next bit needs is still there.
+	for(k = PDM_SIMBITS; k--;){
+		w = 0.35875 - 0.48829*cos(2*M_PI*k/PDM_SIMBITS) + 0.14128*cos(4*M_PI*k/PDM_SIMBITS) -
+				0.01168*cos(6*M_PI*k/PDM_SIMBITS);
+		re[k] = w*(((b[k/16]>>(15 - k%16))&1 ? 1 : -1) - (k ? re[k - 1] : x[-2])/PDM_LEVEL);
+		im[k] = 0;
+		wsum += w*w;
+	}
+	Fft(re, im, PDM_SIMBITS);
+
+	//Both sides of the spectrum, against the windowed power of a full scale (+-1) bitstream
+	for(k = PDM_SIMLOBE + 1; k<=band; k++) noise += 2*(re[k]*re[k] + im[k]*im[k]);
+	return 10*log10(noise/(PDM_SIMBITS*wsum));
+}
+
+static int SimPdm(int argc, char **argv){
+	double f = argc>0 ? atof(argv[0]) : 1000, level, noise, snr, full = 0, peak = -1e9;
+	static const int8_t dbfs[] = {0, -1, -3, -6, -10, -20, -40, -60};
+	uint32_t n;
+
+	GenInit();
+	PulseStop();
+	HopStop();
+	DualStop();
+	SetSkew(0);
+	SetFrequency(f);
+
+	printf("bit clock       %u Hz, OSR %u, band to %u Hz, full scale input %.2f of the feedback\n", FS*PDM_OSR,
+			PDM_OSR, FS/2, 32767.0/PDM_LEVEL);
+	printf("input dBFS  dB of feedback  noise dB  SNR dB   (%.1f Hz)\n", tw*2.0*FS/4294967296.0);
+	for(n = 0; n<sizeof(dbfs)/sizeof(dbfs[0]); n++){
+		WavetableNow(0, WAVE_SINE, floor(32767*pow(10, dbfs[n]/20.0) + 0.5));
+		level = dbfs[n] + 20*log10(32767.0/PDM_LEVEL);
+		noise = PdmNoise();
+		snr = level - 3.01 - noise;
+		printf("%10d  %14.1f  %8.1f  %6.1f\n", dbfs[n], level, noise, snr);
+		if(!n) full = snr;
+		if(snr>peak) peak = snr;
+	}
+
+	//A full scale square is the longest stretch at the modulator's limit
+	WavetableNow(0, WAVE_SQUARE, 32767);
+	noise = PdmNoise();
+	printf("square          noise %.1f dB\n", noise);
+	printf("peak SNR        %.1f dB, resets %u\n", peak, pdmresets);
+	printf("%s\n", pdmresets || full<PDM_SIMSNR ? "FAIL" : "PASS");
+	return pdmresets || full<PDM_SIMSNR;
+}
+
+//Frames compared after each warm restart, and the most blocks the DAC gets through before
+//the reset
+#define WARM_FRAMES	256
+#define WARM_BLOCKS	64
+
+static int SimWarm(int argc, char **argv){
+	uint32_t trials = argc>0 ? strtoul(argv[0], 0, 0) : 1000;
+	uint32_t seed = argc>1 ? strtoul(argv[1], 0, 0) : 0xB007;
+	static int16_t want[WARM_FRAMES*2], got[WARM_FRAMES*2];
+	uint32_t n, r, w, b, k, at, d, start, lost, pre, frames, bad = 0, off = 0, dual = 0, shaped = 0;
+	uint8_t ch;
+	int32_t err, worst = 0;
+	GenState snap;
+
+	if(seed == 0) seed = 1;
+	for(n = 0; n<trials; n++){
+		//Somewhere mid stream in a random mode and tuning
+		GenInit();
+		PulseStop();
+		HopStop();
+		DualStop();
+		r = Rand(&seed);
+		SetFrequency(r%23000);
+		if(r&1){
+			DualStart();
+			SetChanFrequency(1, (r>>1)%23000);
+			dual++;
+		}
+		if(((r>>16)&7) == 0) PulseConfig(1000, 300, 0, PULSE_COHERENT);
+
+		//Mostly at some other waveform and amplitude, built as the idle loop would have
+		w = Rand(&seed);
+		if(w&3){
+			for(ch = 0; ch<2; ch++){
+				SetChanWave(ch, (w>>(2 + 8*ch))%(WAVE_LIB + wavelibn), (w>>(16 + 8*ch)&0xFF)<<7 | 0x7F);
+				WavetableNow(ch, wavetarget[ch], ampltarget[ch]);
+			}
+			shaped++;
+		}
+		GenRender(got, 1 + (r>>20)%WARM_FRAMES);
+
+		//The DMA pipeline from there: both halves prefilled, then as the DAC starts each block
+		//the refill stage generates the one after it and snapshots. The reset lands at frame
+		//at of the output, in block k, after the refill that made block k+1.
+		start = genframes;
+		at = FRAMES_PER_HALF + Rand(&seed)%(WARM_BLOCKS*FRAMES_PER_HALF);
+		k = at/FRAMES_PER_HALF;
+		for(b = 0; b<=k+1; b++){
+			Populate(b&1 ? DMA_BUFSIZ : 0);
+			if(b>=2) GenSnapshot(&snap);
+		}
+
+		//Reset and startup take lost frames from that sample on, then main() times a prefill
+		//of pre frames and resumes again as of two of them later for the one the DMA starts
+		//on. RETAIN_LOSTFRAMES stands in for the part it can't measure, which can be off by no
+		//more than where in the block the reset landed.
+		lost = DMA_BUFSIZ + Rand(&seed)%100000;
+		pre = Rand(&seed)%(4*DMA_BUFSIZ);
+		frames = snap.frames + RETAIN_LOSTFRAMES + lost + 2*pre;
+		err = (int32_t)(frames - (start + at + lost + 2*pre));
+		if(err>FRAMES_PER_HALF/2 || err<-FRAMES_PER_HALF/2) off++;
+		if(err>worst || -err>worst) worst = err<0 ? -err : err;
+
+		//The board carries on to the frame the resume picks up at
+		d = frames - genframes;
+		GenSkip(d/FRAMES_PER_HALF);
+		GenRender(got, d%FRAMES_PER_HALF);
+		GenRender(want, WARM_FRAMES);
+
+		//Restart, pulses resume as the carrier so that is what to compare against
+		if(((r>>16)&7) == 0){
+			GenResume(&snap, RETAIN_LOSTFRAMES + lost + 2*pre);
+			PulseStop();
+			GenRender(want, WARM_FRAMES);
+		}
+		SetFrequency(1234);
+		DualStop();
+		phac = Rand(&seed);
+		GenInit();
+
+		//The timed prefill, then the one that goes out, which has to pick up where the board
+		//would have been with nothing left over from the first
+		GenResume(&snap, RETAIN_LOSTFRAMES + lost);
+		Populate(0);
+		Populate(DMA_BUFSIZ);
+		GenResume(&snap, RETAIN_LOSTFRAMES + lost + 2*pre);
+		if(genframes != frames) bad++;
+		Populate(0);
+		Populate(DMA_BUFSIZ);
+		memcpy(got, dmabuf, sizeof(dmabuf));
+		GenRender(&got[2*DMA_BUFSIZ], WARM_FRAMES - DMA_BUFSIZ);
+		if(memcmp(want, got, sizeof(want))) bad++;
+	}
+
+	printf("trials          %u (%u dual, %u not the default sine)\n", trials, dual, shaped);
+	printf("mismatches      %u\n", bad);
+	printf("phase estimate  worst %d frames, %u over half a block\n", worst, off);
+	printf("%s\n", bad || off ? "FAIL" : "PASS");
+	return bad || off;
+}
+
+#define PACK_RUNS	20000
+
+static int SimPack(void){
+	int16_t table[256];
+	uint32_t raw = 0, packed = 0, n, r, fail = 0;
+	struct timespec t0, t1;
+	double ns;
+
+	for(n = 0; n<wavelibn; n++){
+		const PackedWave *w = &wavelib[n];
+		uint32_t size = w->size + 2*(w->halfsym ? 128 : 256)/WP_BLOCK;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for(r = 0; r<PACK_RUNS; r++) WavePackDecode(w, table);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		ns = ((t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec))/PACK_RUNS;
+
+		fail += WavePackHash(table, 256) != w->hash;
+		printf("%-12s %4u bytes  %.2f:1  decode %.0fns  %s\n", w->name, size, 512.0/size, ns,
+				WavePackHash(table, 256) == w->hash ? "ok" : "HASH MISMATCH");
+		raw += 512;
+		packed += size;
+	}
+
+	printf("library      %4u bytes  %.2f:1\n", packed, (double)raw/packed);
+	printf("%s\n", fail ? "FAIL" : "PASS");
+	return fail ? 1 : 0;
+}
+
+static int SimReplay(int argc, char **argv){
+	static Cmd log[4096];
+	uint32_t frames, nlog, next = 0, hash = 2166136261UL, skip;
+	uint8_t half = 0, ff = argc>2 && !strcmp(argv[2], "ff");
+	int32_t window = FF_WINDOW;
+	const int16_t *buf;
+	FILE *f;
+
+	if(argc<2){
+		fprintf(stderr, "replay needs a log file and a frame count\n");
+		return 2;
+	}
+	frames = strtoul(argv[1], 0, 0)/FRAMES_PER_HALF*FRAMES_PER_HALF;
+	if(!(f = fopen(argv[0], "rb"))){
+		fprintf(stderr, "can't read %s\n", argv[0]);
+		return 2;
+	}
+	nlog = fread(log, sizeof(Cmd), 4096, f);
+	fclose(f);
+
+	GenInit();
+	while(genframes<frames){
+		//Events are stamped with the first frame of the block they were applied to
+		if(next<nlog && log[next].frame<genframes){
+			fprintf(stderr, "event %u at frame %u is not on a block boundary\n", next, log[next].frame);
+			return 1;
+		}
+		while(next<nlog && log[next].frame == genframes){
+			//Swaps are rebuilt on the spot, the background rebuild never runs here
+			if(log[next].op == EV_SWAP) WavetableNow(log[next].n, log[next].w, log[next].a);
+			else if(log[next].op == EV_CLOCK) GenRetune(log[next].a);
+			else CmdExec(&log[next]);
+			next++;
+			window = FF_WINDOW;
+		}
+
+		//Skip to the next event (or the end) once the window after the last one is done
+		if(ff && window<=0){
+			skip = (next<nlog ? log[next].frame : frames) - genframes;
+			if(skip>frames - genframes) skip = frames - genframes;
+			if(GenSkip(skip/FRAMES_PER_HALF)) continue;
+		}
+
+		buf = &dmabuf[half*DMA_BUFSIZ];
+		Populate(half*DMA_BUFSIZ);
+		hash = HashBlock(hash, buf, genframes - FRAMES_PER_HALF);
+		half ^= 1;
+		window--;
+	}
+
+	printf("events          %u replayed of %u\n", next, nlog);
+	PrintState(hash);
+	return 0;
+}
+
+int main(int argc, char **argv){
+	if(argc>1 && !strcmp(argv[1], "record")) return SimRecord(argc-2, argv+2);
+	if(argc>1 && !strcmp(argv[1], "replay")) return SimReplay(argc-2, argv+2);
+	if(argc>1 && !strcmp(argv[1], "hop")) return SimHop(argc-2, argv+2);
+	if(argc>1 && !strcmp(argv[1], "css")) return SimCss(argc-2, argv+2);
+	if(argc>1 && !strcmp(argv[1], "pack")) return SimPack();
+	if(argc>1 && !strcmp(argv[1], "dsp")) return SimDsp(argc-2, argv+2);
+	if(argc>1 && !strcmp(argv[1], "pulse")) return SimPulse(argc-2, argv+2);
+	if(argc>1 && !strcmp(argv[1], "warm")) return SimWarm(argc-2, argv+2);
+	if(argc>1 && !strcmp(argv[1], "skew")) return SimSkew(argc-2, argv+2);
+	if(argc>1 && !strcmp(argv[1], "alc")) return SimAlc(argc-2, argv+2);
+	if(argc>1 && !strcmp(argv[1], "track")) return SimTrack(argc-2, argv+2);
+	if(argc>1 && !strcmp(argv[1], "asrc")) return SimAsrc(argc-2, argv+2);
+	if(argc>1 && !strcmp(argv[1], "pdm")) return SimPdm(argc-2, argv+2);
+
+	fprintf(stderr, "usage: %s hop [dwell] [seconds] [seed]\n"
+			"       %s record <log> [seconds] [seed]\n"
+			"       %s replay <log> <frames> [ff]\n"
+			"       %s css [lock us] [hsi ppm]\n"
+			"       %s pack\n"
+			"       %s dsp [vectors]\n"
+			"       %s pulse [pri] [width] [chirp Hz] [seconds]\n"
+			"       %s warm [trials] [seed]\n"
+			"       %s skew [chain ns]\n"
+			"       %s alc [seconds] [tone Hz]\n"
+			"       %s track [bandwidth Hz] [tone Hz]\n"
+			"       %s asrc [tone Hz] [packet samples]\n"
+			"       %s pdm [tone Hz]\n", argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+			argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+	return 2;
+}
@@ -0,0 +1,627 @@
+/*
+ * Soak test farm. Runs many simulated boards, each for days or weeks of operation, with
+ * random control sessions and fault scripts, to shake out the rare glitch or slow drift
+ * that a short simulation never reaches.
+ *
+ * Time is event driven. After each event (a command, a fault) the DMA interrupt path is
+ * run block by block, CmdApply() then Populate() with the background table rebuild getting
+ * a random share of the idle time between blocks, until the command queue has drained and
+ * any table swap has landed. The quiet stretch up to the next event is skipped with
+ * GenSkip(), so a week of output costs a few thousand windows per board.
+ *
+ * Every generated block is compared sample for sample against an independent model of the
+ * output. The model keeps its own phase accumulators (carried across the skips too), its
+ * own hop schedule and its own copy of the command queue, so it knows which block each
+ * command lands in and what tuning word it should give. Only the tables and a retune's
+ * scaled tuning words are taken from the generator. Per board it counts:
+ *     glitch   blocks that differ from the model, after which the model resyncs
+ *     slip     accumulator differences found at the start of a window, i.e. after a skip
+ *     tw       commands that didn't give the tuning word the model expected
+ *     drift    the output frequency against the one asked for, at the board's real sample
+ *              rate (crystal error, tuning word rounding, a failover to HSI), as the worst
+ *              ppm and the phase error it builds up in cycles per day. Frequencies over
+ *              half the sample rate (after a failover to HSI alone) only alias, so are left
+ *              out.
+ *     latency  blocks from CmdSubmit() to the command being applied, and from a wave or
+ *              amplitude command to its table being swapped in
+ *
+ * Configurations:
+ *     quad     frequency, amplitude and waveform changes in quadrature mode
+ *     dual     independent channels, per channel changes, switching in and out of dual
+ *     hop      hop plans with 0.1-1s dwells, stopping and restarting
+ *     late     quad, plus a DMA interrupt missing its deadline in a quarter of the windows
+ *              so a stale half buffer is played, each should show up as exactly one glitch
+ *     css      quad, plus a crystal failure at a random time, failing over to the HSI PLL
+ *              or to HSI alone, the drift shows the HSI's error
+ *     storm    bursts of 6-12 commands, more than the queue holds
+ *     starve   quad with the idle loop mostly busy, table rebuilds crawl
+ * Upconversion isn't covered, it consumes baseband every frame so can't be skipped.
+ *
+ * The generator's state is global, as it is on the target, so each board runs in its own
+ * process, --jobs at a time (one per core by default).
+ *
+ * Build from this directory with:
+ *     gcc -O2 -I.. -o soak soak.c ../generator.c ../cmd.c ../wavepack.c ../wavelib.c -lm
+ *
+ * Usage:
+ *     soak [--days n] [--boards n] [--jobs n] [--gap s] [--seed n] [config ...]
+ *         Simulates --boards boards (default 8) of each configuration (default all) for
+ *         --days days (default 14) with an event every --gap seconds on average (default
+ *         300), and prints the totals per configuration. Exits 1 if any board glitched
+ *         other than for an injected late interrupt, slipped, got a wrong tuning word or
+ *         never settled.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "generator.h"
+#include "cmd.h"
+#include "wavepack.h"
+
+#define FRAMES_PER_HALF	(DMA_BUFSIZ/2)
+
+//Blocks generated after every event, and the most before a board counts as stuck
+#define SOAK_WINDOW		32
+#define SOAK_MAXWINDOW	65536
+
+//RegenWavetable() calls per block with a normal idle loop, and the chance of any at all
+//(1 in SOAK_STARVE) when starved
+#define SOAK_IDLE		4
+#define SOAK_STARVE		4
+
+//Crystal tolerance and HSI error in ppm, boards get a random value within +-
+#define SOAK_XTALPPM	30
+#define SOAK_HSIPPM		10000
+
+//Fault scripts
+#define FAULT_LATE		1
+#define FAULT_CSS		2
+#define FAULT_STORM		4
+#define FAULT_STARVE	8
+
+typedef struct {
+	const char *name;
+	uint8_t mode;		//GEN_QUAD or GEN_DUAL at start up
+	uint8_t hop;		//Hop plan sessions rather than fixed frequencies
+	uint8_t faults;
+} Config;
+
+static const Config configs[] = {
+	{"quad", GEN_QUAD, 0, 0},
+	{"dual", GEN_DUAL, 0, 0},
+	{"hop", GEN_QUAD, 1, 0},
+	{"late", GEN_QUAD, 0, FAULT_LATE},
+	{"css", GEN_QUAD, 0, FAULT_CSS},
+	{"storm", GEN_QUAD, 0, FAULT_STORM},
+	{"starve", GEN_QUAD, 0, FAULT_STARVE},
+};
+#define NCONFIGS	(sizeof(configs)/sizeof(configs[0]))
+
+//One board's totals, passed back to the farm through a pipe
+typedef struct {
+	uint32_t config, seed;
+	double days;
+	uint32_t events, windows, late, glitches, slips, twerrs, stuck;
+	uint32_t drops, cmdlat, swaplat;
+	double slipdeg, driftppm, phasecyc;
+} Result;
+
+//Hop state of the generator, not in generator.h as nothing else should touch it
+extern uint16_t hopidx;
+extern uint32_t hopleft;
+
+static const Config *cfg;
+static Result res;
+static uint32_t seed;
+
+//Blocks generated or skipped, the board's real sample rate and elapsed time
+static uint64_t block;
+static double fstrue, seconds;
+
+//Output model: accumulators, tuning words, hop schedule and mode
+static uint32_t mph, mph2, mtw, mtw2, midx, mleft;
+static uint8_t mmode, mhop;
+
+//Frequency asked for on channel 0, 0 while hopping
+static uint32_t mfreq;
+
+//Commands in the queue as the model sees them, with the block they were submitted in
+static struct {
+	Cmd c;
+	uint64_t block;
+} mq[CMD_QUEUESIZ];
+static uint8_t mqn;
+
+//Block a wave or amplitude command was applied in per channel, while its swap is pending
+static uint64_t swapfrom[2];
+static uint8_t swapping[2];
+
+static uint32_t Rand(uint32_t *s){
+	*s ^= *s<<13;
+	*s ^= *s>>17;
+	*s ^= *s<<5;
+	return *s;
+}
+
+static uint32_t RandRange(uint32_t lo, uint32_t hi){
+	return lo + Rand(&seed)%(hi - lo + 1);
+}
+
+static void Submit(uint8_t op, uint8_t n, uint16_t w, uint32_t a, uint32_t b){
+	if(!CmdSubmit(op, n, w, a, b)){
+		res.drops++;
+		return;
+	}
+	mq[mqn].c.op = op;
+	mq[mqn].c.n = n;
+	mq[mqn].c.w = w;
+	mq[mqn].c.a = a;
+	mq[mqn].c.b = b;
+	mq[mqn].block = block;
+	mqn++;
+}
+
+//Take the model back to the generator's state after a glitch or slip has been counted
+static void Resync(void){
+	mph = phac;
+	mph2 = phac2;
+	mtw = tw;
+	mtw2 = tw2;
+	midx = hopidx;
+	mleft = hopleft;
+}
+
+//The commands CmdApply() has just taken, in order, and the state each should leave
+static void ModelApply(void){
+	uint8_t k, n = mqn<CMD_PERBLOCK ? mqn : CMD_PERBLOCK;
+	const Cmd *c;
+
+	for(k = 0; k<n; k++){
+		c = &mq[k].c;
+		if(block - mq[k].block>res.cmdlat) res.cmdlat = block - mq[k].block;
+
+		switch(c->op){
+		case CMD_FREQ:
+			mtw = twperhz*c->a;
+			mfreq = c->a;
+			break;
+		case CMD_CHFREQ:
+			if(c->n) mtw2 = twperhz*c->a;
+			else mtw = twperhz*c->a, mfreq = c->a;
+			break;
+		case CMD_AMPL:
+		case CMD_CHWAVE:
+			if(!swapping[c->n]) swapfrom[c->n] = block;
+			swapping[c->n] = 1;
+			break;
+		case CMD_DUAL:
+			//The right channel carries on from the sine and the left from the cosine
+			if(c->n && mmode != GEN_DUAL){
+				mph2 = mph + mtw;
+				mph += 1UL<<30;
+				mmode = GEN_DUAL;
+			}
+			else if(!c->n && mmode == GEN_DUAL){
+				mph -= 1UL<<30;
+				mmode = GEN_QUAD;
+			}
+			break;
+		case CMD_HOP:
+			mhop = 1;
+			midx = 0;
+			mleft = 0;
+			mfreq = 0;
+			break;
+		case CMD_HOPSTOP:
+			mhop = 0;
+			break;
+		}
+	}
+	memmove(mq, &mq[n], (mqn - n)*sizeof(mq[0]));
+	mqn -= n;
+
+	if(mtw != tw || (mmode == GEN_DUAL && mtw2 != tw2)){
+		res.twerrs++;
+		Resync();
+	}
+}
+
+//Elapsed time and the frequency error of channel 0 over it
+static void Advance(uint32_t frames){
+	double dt = frames/fstrue, f;
+
+	seconds += dt;
+	if(!mfreq || mfreq>=genfs/2) return;
+
+	f = mtw*2*fstrue/4294967296.0;
+	if(fabs(f/mfreq - 1)*1e6>res.driftppm) res.driftppm = fabs(f/mfreq - 1)*1e6;
+	res.phasecyc += (f - mfreq)*dt;
+}
+
+//Next hop, taken as soon as the dwell runs out as Generate() does
+static inline void ModelHop(void){
+	if(mleft == 0){
+		mtw = hoptw[midx];
+		if(++midx == hopn) midx = 0;
+		mleft = hopdwell;
+	}
+}
+
+//Model's accumulators over a skipped stretch
+static void ModelSkip(uint32_t frames){
+	uint32_t run;
+
+	if(mhop) ModelHop();
+	while(frames){
+		run = mhop && mleft<frames ? mleft : frames;
+		mph += (mtw<<1)*run;
+		if(mmode == GEN_DUAL) mph2 += (mtw2<<1)*run;
+		frames -= run;
+		if(mhop){
+			mleft -= run;
+			ModelHop();
+		}
+	}
+}
+
+//One DMA interrupt's worth of output checked against the model. A late interrupt leaves
+//the half buffer as it was, so the DAC plays it again.
+static void Block(uint8_t late){
+	static uint8_t half = 0;
+	const int16_t *buf = &dmabuf[half*DMA_BUFSIZ], *wl, *wr;
+	uint32_t k, bad = 0;
+	int16_t l, r;
+
+	if(!late){
+		CmdApply();
+		ModelApply();
+		Populate(half*DMA_BUFSIZ);
+	}
+	half ^= 1;
+
+	wl = chwt[0];
+	wr = chwt[1];
+	if(mhop) ModelHop();
+	for(k = 0; k<FRAMES_PER_HALF; k++){
+
+		if(mmode == GEN_DUAL){
+			l = wl[mph>>24];
+			r = wr[mph2>>24];
+			mph += mtw<<1;
+			mph2 += mtw2<<1;
+		}
+		else{
+			l = wl[((mph>>24) + 64)&255];
+			mph += mtw;
+			r = wl[mph>>24];
+			mph += mtw;
+		}
+		bad += (l != buf[2*k]) + (r != buf[2*k + 1]);
+
+		if(mhop){
+			mleft--;
+			ModelHop();
+		}
+	}
+
+	if(bad){
+		res.glitches++;
+		Resync();
+	}
+	block++;
+	Advance(FRAMES_PER_HALF);
+
+	for(k = 0; k<2; k++){
+		if(swapping[k] && amplactive[k] == ampltarget[k] && waveactive[k] == wavetarget[k]){
+			if(block - swapfrom[k]>res.swaplat) res.swaplat = block - swapfrom[k];
+			swapping[k] = 0;
+		}
+	}
+
+	//The idle loop until the next interrupt
+	k = cfg->faults&FAULT_STARVE ? Rand(&seed)%SOAK_STARVE == 0 : RandRange(1, SOAK_IDLE);
+	while(k--) RegenWavetable();
+}
+
+//Anything still to settle from the last event
+static uint8_t Busy(void){
+	return mqn || swapping[0] || swapping[1];
+}
+
+static uint32_t RandFreq(void){
+	return RandRange(100, genfs*2/5);
+}
+
+static uint16_t RandAmpl(void){
+	return RandRange(1000, 32767);
+}
+
+//A random control change for the board's configuration
+static void Event(void){
+	uint32_t n, base, spacing;
+
+	if(cfg->hop){
+		switch(Rand(&seed)%8){
+		case 0:
+			Submit(CMD_HOPSTOP, 0, 0, 0, 0);
+			Submit(CMD_FREQ, 0, 0, RandFreq(), 0);
+			break;
+		case 1:
+			Submit(CMD_AMPL, 0, 0, RandAmpl(), 0);
+			break;
+		default:
+			n = RandRange(2, 16);
+			base = RandRange(200, genfs/5);
+			spacing = RandRange(10, (genfs*2/5 - base)/(n - 1));
+			Submit(CMD_HOP, n, RandRange(FS/10, FS), base<<16 | spacing, Rand(&seed));
+			break;
+		}
+		return;
+	}
+
+	n = cfg->faults&FAULT_STORM ? RandRange(6, 12) : 1;
+	while(n--){
+		switch(Rand(&seed)%10){
+		case 0:
+			if(cfg->mode == GEN_DUAL){
+				Submit(CMD_DUAL, mmode != GEN_DUAL, 0, 0, 0);
+				break;
+			}
+			//Fall through
+		case 1:
+		case 2:
+			Submit(CMD_CHWAVE, cfg->mode == GEN_DUAL ? Rand(&seed)&1 : 0, Rand(&seed)%(WAVE_LIB + wavelibn),
+					RandAmpl(), 0);
+			break;
+		case 3:
+		case 4:
+			Submit(CMD_AMPL, 0, 0, RandAmpl(), 0);
+			break;
+		default:
+			if(cfg->mode == GEN_DUAL) Submit(CMD_CHFREQ, Rand(&seed)&1, 0, RandFreq(), 0);
+			else Submit(CMD_FREQ, 0, 0, RandFreq(), 0);
+			break;
+		}
+	}
+}
+
+//Crystal failure. The NMI handler either gets the PLL locked on HSI, keeping the nominal
+//rate, or stays on HSI at a sixth of it. Either way the real rate follows the HSI's error,
+//which the firmware can't see. The retune scales the tuning words so the model takes them.
+static void Failover(void){
+	double hsi = (double)RandRange(0, 2*SOAK_HSIPPM) - SOAK_HSIPPM;
+	uint8_t locked = Rand(&seed)&1;
+
+	GenRetune(locked ? FS : (uint32_t)(FS/6.0 + 0.5));
+	fstrue = (locked ? FS : FS/6.0)*(1 + hsi*1e-6);
+	mtw = tw;
+	mtw2 = tw2;
+}
+
+//Start of a window, the skip must have left the generator where the model is
+static void CheckSkip(void){
+	int32_t d = phac - mph;
+
+	if(d || (mmode == GEN_DUAL && phac2 != mph2) || (mhop && (hopidx != midx || hopleft != mleft))){
+		res.slips++;
+		if(d == INT32_MIN) d++;
+		if(fabs(d*360.0/4294967296.0)>res.slipdeg) res.slipdeg = fabs(d*360.0/4294967296.0);
+		Resync();
+	}
+}
+
+static void RunBoard(uint32_t config, uint32_t boardseed, double days, double gap){
+	double end = days*86400, next, fail = -1, ppm;
+	uint32_t n, lateat;
+	uint64_t skip;
+
+	cfg = &configs[config];
+	seed = boardseed;
+	memset(&res, 0, sizeof(res));
+	res.config = config;
+	res.seed = boardseed;
+
+	ppm = (double)RandRange(0, 2*SOAK_XTALPPM) - SOAK_XTALPPM;
+	fstrue = FS*(1 + ppm*1e-6);
+	if(cfg->faults&FAULT_CSS) fail = end*(Rand(&seed)/4294967296.0);
+
+	GenInit();
+	mph = phac;
+	mph2 = phac2;
+	mtw = tw;
+	mtw2 = tw2;
+	mmode = genmode;
+	mfreq = FREQOUT;
+	if(cfg->mode == GEN_DUAL) Submit(CMD_DUAL, 1, 0, 0, 0);
+
+	while(seconds<end){
+		res.windows++;
+		CheckSkip();
+
+		//The first window just settles the start up
+		if(res.windows>1){
+			if(fail>=0 && seconds>=fail){
+				Failover();
+				fail = -1;
+			}
+			else{
+				Event();
+				res.events++;
+			}
+		}
+
+		lateat = cfg->faults&FAULT_LATE && Rand(&seed)%4 == 0 ? RandRange(1, SOAK_WINDOW/4) : 0;
+		res.late += lateat != 0;
+		for(n = 0; n<SOAK_WINDOW || Busy(); n++){
+			if(n == SOAK_MAXWINDOW){
+				res.stuck++;
+				break;
+			}
+			Block(lateat && n == lateat);
+		}
+
+		//Quiet until the next event, or the failover if that comes first
+		next = seconds - gap*log(1 - Rand(&seed)/4294967296.0);
+		if(fail>=0 && fail<next) next = fail;
+		if(next>end) next = end;
+		skip = next>seconds ? (uint64_t)((next - seconds)*fstrue)/FRAMES_PER_HALF : 0;
+		while(skip){
+			n = skip>0x1000000 ? 0x1000000 : skip;
+			GenSkip(n);
+			ModelSkip(n*FRAMES_PER_HALF);
+			block += n;
+			Advance(n*FRAMES_PER_HALF);
+			skip -= n;
+		}
+	}
+
+	res.days = seconds/86400;
+}
+
+//Board n's seed, never zero
+static uint32_t BoardSeed(uint32_t base, uint32_t n){
+	uint32_t s = (base + n)*2654435761UL;
+
+	return s ? s : 1;
+}
+
+static int Failed(const Result *r){
+	return r->glitches != r->late || r->slips || r->twerrs || r->stuck;
+}
+
+int main(int argc, char **argv){
+	uint32_t boards = 8, base = 1, jobs = sysconf(_SC_NPROCESSORS_ONLN), njobs = 0, running = 0, n, k;
+	double days = 14, gap = 300, t0, t1, simdays = 0;
+	struct timespec ts;
+	uint8_t want[NCONFIGS] = {0}, any = 0;
+	Result *results, tot, r;
+	uint32_t *jobcfg, *jobseed, failed = 0;
+	struct { pid_t pid; int fd; uint32_t job; } *slot;
+	int i, fd[2], status;
+	pid_t pid;
+
+	for(i = 1; i<argc; i++){
+		if(!strcmp(argv[i], "--days") && i+1<argc) days = atof(argv[++i]);
+		else if(!strcmp(argv[i], "--boards") && i+1<argc) boards = strtoul(argv[++i], 0, 0);
+		else if(!strcmp(argv[i], "--jobs") && i+1<argc) jobs = strtoul(argv[++i], 0, 0);
+		else if(!strcmp(argv[i], "--gap") && i+1<argc) gap = atof(argv[++i]);
+		else if(!strcmp(argv[i], "--seed") && i+1<argc) base = strtoul(argv[++i], 0, 0);
+		else{
+			for(n = 0; n<NCONFIGS && strcmp(argv[i], configs[n].name); n++);
+			if(n == NCONFIGS){
+				fprintf(stderr, "usage: %s [--days n] [--boards n] [--jobs n] [--gap s] [--seed n] [config ...]\n",
+						argv[0]);
+				fprintf(stderr, "configs:");
+				for(n = 0; n<NCONFIGS; n++) fprintf(stderr, " %s", configs[n].name);
+				fprintf(stderr, "\n");
+				return 2;
+			}
+			want[n] = any = 1;
+		}
+	}
+	if(days<=0 || gap<=0 || !boards || !jobs){
+		fprintf(stderr, "days, gap, boards and jobs must be positive\n");
+		return 2;
+	}
+
+	//Job list, configs in order so each config's boards have the same seeds every run
+	jobcfg = malloc(NCONFIGS*boards*sizeof(uint32_t));
+	jobseed = malloc(NCONFIGS*boards*sizeof(uint32_t));
+	results = calloc(NCONFIGS*boards, sizeof(Result));
+	slot = calloc(jobs, sizeof(*slot));
+	for(n = 0; n<NCONFIGS; n++){
+		if(any && !want[n]) continue;
+		for(k = 0; k<boards; k++){
+			jobcfg[njobs] = n;
+			jobseed[njobs++] = BoardSeed(base, n*boards + k);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t0 = ts.tv_sec + ts.tv_nsec*1e-9;
+
+	//Keep up to jobs boards running, each in a fresh process so it starts from a clean
+	//generator. Results come back through a pipe per board.
+	for(n = 0; n<njobs || running; ){
+		if(n<njobs && running<jobs){
+			if(pipe(fd) || (pid = fork())<0){
+				perror("soak");
+				return 2;
+			}
+			if(!pid){
+				close(fd[0]);
+				RunBoard(jobcfg[n], jobseed[n], days, gap);
+				_exit(write(fd[1], &res, sizeof(res)) != (ssize_t)sizeof(res));
+			}
+			close(fd[1]);
+			for(k = 0; slot[k].pid; k++);
+			slot[k].pid = pid;
+			slot[k].fd = fd[0];
+			slot[k].job = n++;
+			running++;
+			continue;
+		}
+
+		pid = wait(&status);
+		for(k = 0; k<jobs && slot[k].pid != pid; k++);
+		if(k == jobs) continue;
+		if(read(slot[k].fd, &r, sizeof(r)) != sizeof(r) || !WIFEXITED(status) || WEXITSTATUS(status)){
+			fprintf(stderr, "board %u (%s, seed 0x%08X) crashed\n", slot[k].job, configs[jobcfg[slot[k].job]].name,
+					jobseed[slot[k].job]);
+			memset(&r, 0, sizeof(r));
+			r.config = jobcfg[slot[k].job];
+			r.seed = jobseed[slot[k].job];
+			r.stuck = 1;
+		}
+		results[slot[k].job] = r;
+		close(slot[k].fd);
+		slot[k].pid = 0;
+		running--;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = ts.tv_sec + ts.tv_nsec*1e-9;
+
+	printf("%-7s %6s %7s %7s %5s %7s %6s %8s %5s %9s %10s %6s %7s %6s\n", "config", "boards", "days", "events",
+			"late", "glitch", "slips", "slip deg", "tw", "drift ppm", "cyc/day", "cmdlat", "swaplat", "drops");
+	for(n = 0; n<NCONFIGS; n++){
+		memset(&tot, 0, sizeof(tot));
+		for(k = i = 0; k<njobs; k++){
+			if(jobcfg[k] != n) continue;
+			r = results[k];
+			i++;
+			tot.days += r.days;
+			tot.events += r.events;
+			tot.late += r.late;
+			tot.glitches += r.glitches;
+			tot.slips += r.slips;
+			tot.twerrs += r.twerrs;
+			tot.stuck += r.stuck;
+			tot.drops += r.drops;
+			tot.slipdeg = fmax(tot.slipdeg, r.slipdeg);
+			tot.driftppm = fmax(tot.driftppm, r.driftppm);
+			tot.phasecyc = fmax(tot.phasecyc, fabs(r.phasecyc)/r.days);
+			if(r.cmdlat>tot.cmdlat) tot.cmdlat = r.cmdlat;
+			if(r.swaplat>tot.swaplat) tot.swaplat = r.swaplat;
+			if(Failed(&r)){
+				printf("FAIL %s seed 0x%08X: %u glitches for %u late, %u slips, %u tw, %u stuck\n", configs[n].name,
+						r.seed, r.glitches, r.late, r.slips, r.twerrs, r.stuck);
+				failed++;
+			}
+		}
+		if(!i) continue;
+		simdays += tot.days;
+		printf("%-7s %6d %7.0f %7u %5u %7u %6u %8.2g %5u %9.1f %10.1f %6u %7u %6u\n", configs[n].name, i, tot.days,
+				tot.events, tot.late, tot.glitches, tot.slips, tot.slipdeg, tot.twerrs, tot.driftppm, tot.phasecyc,
+				tot.cmdlat, tot.swaplat, tot.drops);
+	}
+	printf("%.0f board days in %.1fs on %u jobs (%.0fx real time), %s\n", simdays, t1 - t0, jobs,
+			simdays*86400/(t1 - t0), failed ? "FAIL" : "PASS");
+
+	return failed != 0;
+}
@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""
+Build the flash resident ARB sequence (arbseq.s) from WAV files.
+
+Each segment is a 16 bit stereo WAV at the output sample rate. The sample data is pulled
+into the .rodata.arb section with .incbin straight from the WAV file, so nothing is
+converted or duplicated, and the segment table the firmware walks (ArbSeg in arb.h)
+is written alongside it:
+
+    arbpack.py [-o arbseq.s] file.wav[:loops[:next]] ...
+
+loops is the number of passes (default 1, 0 loops forever) and next the index of the
+segment to chain to afterwards (default the following one, "end" after the last). The
+.incbin paths are written relative to the output file's directory, which is where the
+assembler runs from in the CoIDE build.
+
+    arbpack.py --demo arb
+
+writes the two demo WAVs the committed sequence is built from.
+"""
+
+import argparse
+import math
+import os
+import struct
+import sys
+
+FS = 46875
+ARB_MAXFRAMES = 32767
+ARB_MINFRAMES = 64
+ARB_END = 0xFFFF
+
+
+def wav_data(path):
+    """Offset and size of the sample data, checking it is 16 bit stereo PCM"""
+    with open(path, 'rb') as f:
+        riff = f.read(12)
+        if riff[:4] != b'RIFF' or riff[8:12] != b'WAVE':
+            raise SystemExit('%s: not a WAV file' % path)
+        fmt = None
+        while True:
+            hdr = f.read(8)
+            if len(hdr) < 8:
+                raise SystemExit('%s: no data chunk' % path)
+            cid, size = struct.unpack('<4sI', hdr)
+            if cid == b'fmt ':
+                fmt = struct.unpack('<HHIIHH', f.read(16))
+                f.seek(size - 16 + (size & 1), 1)
+            elif cid == b'data':
+                if fmt is None:
+                    raise SystemExit('%s: data before fmt' % path)
+                tag, chans, rate, _, _, bits = fmt
+                if tag != 1 or chans != 2 or bits != 16:
+                    raise SystemExit('%s: need 16 bit stereo PCM' % path)
+                if rate != FS:
+                    print('%s: %d Hz, will play at %d Hz' % (path, rate, FS), file=sys.stderr)
+                return f.tell(), size
+            else:
+                f.seek(size + (size & 1), 1)
+
+
+def write_wav(path, frames):
+    data = b''.join(struct.pack('<hh', l, r) for l, r in frames)
+    with open(path, 'wb') as f:
+        f.write(struct.pack('<4sI4s', b'RIFF', 36 + len(data), b'WAVE'))
+        f.write(struct.pack('<4sIHHIIHH', b'fmt ', 16, 1, 2, FS, FS*4, 4, 16))
+        f.write(struct.pack('<4sI', b'data', len(data)))
+        f.write(data)
+
+
+def demo(outdir):
+    """A linear chirp 1-10kHz on I/Q and a gated two tone burst"""
+    os.makedirs(outdir, exist_ok=True)
+    n = 2048
+    chirp = []
+    for k in range(n):
+        t = k/float(FS)
+        ph = 2*math.pi*(1000*t + 0.5*(9000*FS/n)*t*t)
+        chirp.append((int(round(30000*math.cos(ph))), int(round(30000*math.sin(ph)))))
+    write_wav(os.path.join(outdir, 'chirp.wav'), chirp)
+
+    n = 1024
+    burst = []
+    for k in range(n):
+        env = math.sin(math.pi*k/n)**2
+        v = env*(math.sin(2*math.pi*3000*k/FS) + math.sin(2*math.pi*3500*k/FS))
+        burst.append((int(round(16000*v)), 0))
+    write_wav(os.path.join(outdir, 'burst.wav'), burst)
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Build the flash ARB sequence')
+    ap.add_argument('-o', '--output', default='arbseq.s')
+    ap.add_argument('--demo', metavar='DIR', help='write the demo WAVs and exit')
+    ap.add_argument('segments', nargs='*', metavar='file.wav[:loops[:next]]')
+    args = ap.parse_args()
+
+    if args.demo:
+        demo(args.demo)
+        return
+    if not args.segments:
+        ap.error('no segments')
+
+    base = os.path.dirname(os.path.abspath(args.output))
+    segs = []
+    for i, spec in enumerate(args.segments):
+        parts = spec.split(':')
+        path = parts[0]
+        loops = int(parts[1]) if len(parts) > 1 else 1
+        if len(parts) > 2:
+            nxt = ARB_END if parts[2] == 'end' else int(parts[2])
+        else:
+            nxt = i + 1 if i + 1 < len(args.segments) else ARB_END
+        if nxt != ARB_END and not 0 <= nxt < len(args.segments):
+            raise SystemExit('%s: next segment %d out of range' % (spec, nxt))
+        if not 0 <= loops <= 0xFFFF:
+            raise SystemExit('%s: bad loop count' % spec)
+
+        offset, size = wav_data(path)
+        frames = size//4
+        if not ARB_MINFRAMES <= frames <= ARB_MAXFRAMES:
+            raise SystemExit('%s: %d frames, must be %d to %d' % (path, frames, ARB_MINFRAMES,
+                             ARB_MAXFRAMES))
+        segs.append((os.path.relpath(os.path.abspath(path), base), offset, frames, loops, nxt))
+
+    total = sum(4*s[2] for s in segs)
+    with open(args.output, 'w') as f:
+        f.write('@Generated by tools/arbpack.py, do not edit\n\n')
+        f.write('\t.section .rodata.arb,"a",%progbits\n\n')
+        f.write('@Segment table, see ArbSeg in arb.h\n\t.balign 4\n\t.global arbseg\narbseg:\n')
+        for i, (path, offset, frames, loops, nxt) in enumerate(segs):
+            f.write('\t.word arbdata%d, %d\n\t.hword %d, 0x%04X\t@%s\n' % (i, frames, loops, nxt, path))
+        f.write('\n\t.global arbsegn\narbsegn:\n\t.word %d\n' % len(segs))
+        for i, (path, offset, frames, loops, nxt) in enumerate(segs):
+            f.write('\n\t.balign 4\narbdata%d:\n\t.incbin "%s", %d, %d\n' % (i, path, offset, 4*frames))
+
+    for i, (path, offset, frames, loops, nxt) in enumerate(segs):
+        print('%2d %-24s %5d frames  %6.1fms  loops %-5s next %s' % (i, path, frames, 1000.0*frames/FS,
+              loops or 'inf', 'end' if nxt == ARB_END else nxt))
+    print('%d bytes of flash' % (total + 12*len(segs) + 4))
+
+
+if __name__ == '__main__':
+    main()
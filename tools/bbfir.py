@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""
+Build the polyphase interpolation filter (bbfir.h) for upconversion mode.
+
+The prototype is a Kaiser windowed sinc TAPS input samples long, sampled PHASES times per
+input sample. Phase p holds the taps for a point p/PHASES of the way between the middle
+two samples, and there is one more phase for the whole way, so the generator can
+interpolate between neighbouring phases for any point. Taps are Q15 and each phase sums
+to exactly 1.0, so a constant input comes out unchanged whatever the phase.
+
+    bbfir.py [-o bbfir.h] [--cutoff f] [--beta b]
+
+The cutoff is a fraction of the input (link) rate. The passband droop and the worst
+image left above 0.7 of the input rate are printed before anything is written.
+"""
+
+import argparse
+import math
+
+TAPS = 8
+PHASES = 128
+
+
+def i0(x):
+    """Modified Bessel function of the first kind, order 0, by its series"""
+    s = t = 1.0
+    k = 1
+    while t>1e-12*s:
+        t *= (x/2/k)**2
+        s += t
+        k += 1
+    return s
+
+
+def tap(t, cutoff, beta):
+    """Prototype at t input samples from the interpolation point"""
+    x = 2.0*t/TAPS
+    if abs(x)>=1:
+        return 0.0
+    w = i0(beta*math.sqrt(1 - x*x))/i0(beta)
+    return w*(2*cutoff if t == 0 else math.sin(2*math.pi*cutoff*t)/(math.pi*t))
+
+
+def build(cutoff, beta):
+    table = []
+    for p in range(PHASES + 1):
+        mu = float(p)/PHASES
+        h = [tap(j - (TAPS//2 - 1) - mu, cutoff, beta) for j in range(TAPS)]
+        g = sum(h)
+        q = [int(round(v*32768/g)) for v in h]
+        #The rounding error goes on the largest tap
+        k = max(range(TAPS), key=lambda j: abs(q[j]))
+        q[k] += 32768 - sum(q)
+        if sum(abs(v) for v in q)>=65536:
+            raise SystemExit('phase %d could overflow the accumulator' % p)
+        table.append(q)
+    return table
+
+
+def response(table, f):
+    """Gain at f input rates of the quantised filter run as one long interpolator"""
+    re = im = 0.0
+    for p in range(PHASES):
+        for j in range(TAPS):
+            n = j*PHASES - p
+            re += table[p][j]*math.cos(2*math.pi*f*n/PHASES)
+            im += table[p][j]*math.sin(2*math.pi*f*n/PHASES)
+    return math.hypot(re, im)/(32768.0*PHASES)
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Build the upconversion interpolation filter')
+    ap.add_argument('-o', '--output', default='bbfir.h')
+    ap.add_argument('--cutoff', type=float, default=0.42)
+    ap.add_argument('--beta', type=float, default=7.0)
+    args = ap.parse_args()
+
+    table = build(args.cutoff, args.beta)
+    for f in (0.1, 0.2, 0.25, 0.3):
+        print('passband %.2f  %6.2f dB' % (f, 20*math.log10(response(table, f))))
+    worst = max(response(table, 0.7 + 0.013*n) for n in range(int((PHASES - 1.4)/0.013)))
+    print('stopband      %6.1f dB' % (20*math.log10(worst)))
+
+    with open(args.output, 'w') as f:
+        f.write('//Generated by tools/bbfir.py, do not edit\n\n')
+        f.write('//%d taps, %d phases, Kaiser windowed sinc, cutoff %.3g of the link rate, beta %.3g\n' %
+                (TAPS, PHASES, args.cutoff, args.beta))
+        f.write('static const int16_t bbfir[%d][%d] = {\n' % (PHASES + 1, TAPS))
+        for q in table:
+            f.write('\t{%s},\n' % ', '.join('%d' % v for v in q))
+        f.write('};\n')
+
+
+if __name__ == '__main__':
+    main()
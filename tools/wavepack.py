@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""
+Build the compressed wavetable library (wavelib.c) for the firmware.
+
+Every table is 256 samples, full scale +-32767, and is packed in WP_BLOCK sample blocks
+of second differences as described in wavepack.h. Tables with half wave symmetry (odd
+harmonics only) just store the first half. The built in tables below are always
+included; more can be added from files, either raw little endian int16 or text with one
+value per line:
+
+    wavepack.py [-o wavelib.c] [name=file ...]
+
+The compression ratio of each table and of the library is printed, and every table is
+decoded again and checked before anything is written.
+"""
+
+import argparse
+import math
+import struct
+import sys
+
+N = 256
+WP_BLOCK = 32
+WP_HEADER = 5
+
+
+def wrap16(x):
+    return ((x + 32768) & 0xFFFF) - 32768
+
+
+def normalise(samples):
+    peak = max(abs(s) for s in samples) or 1.0
+    return [int(round(s*32767/peak)) for s in samples]
+
+
+def harmonics(amps):
+    """Sum of sines, amps[k] is the amplitude of harmonic k+1"""
+    return normalise([sum(a*math.sin(2*math.pi*(k+1)*n/N) for k, a in enumerate(amps))
+                      for n in range(N)])
+
+
+def sigma(k, top):
+    """Lanczos sigma factor, tames the Gibbs ripple of a truncated series"""
+    x = math.pi*k/(top + 1)
+    return math.sin(x)/x if k else 1.0
+
+
+BUILTIN = [
+    ('square_bl', harmonics([sigma(k+1, 15)/(k+1) if k % 2 == 0 else 0 for k in range(15)])),
+    ('saw_bl', harmonics([sigma(k+1, 16)*(-1)**k/(k+1) for k in range(16)])),
+    ('organ', harmonics([1, 0.5, 0.6, 0.3, 0, 0.25, 0, 0.15])),
+    ('pulse_bl', harmonics([sigma(k+1, 24)*math.sin(math.pi*(k+1)*0.1)/(k+1) for k in range(24)])),
+]
+
+
+def load(path):
+    with open(path, 'rb') as f:
+        raw = f.read()
+    try:
+        vals = [int(round(float(v))) for v in raw.decode('ascii').split()]
+    except (UnicodeDecodeError, ValueError):
+        vals = list(struct.unpack('<%dh' % (len(raw)//2), raw[:len(raw)//2*2]))
+    if len(vals) != N:
+        raise SystemExit('%s: need %d samples, got %d' % (path, N, len(vals)))
+    return [max(-32768, min(32767, v)) for v in vals]
+
+
+def signed_bits(r):
+    """Two's complement width that holds r, 0 for 0"""
+    if r == 0:
+        return 0
+    return (r if r > 0 else ~r).bit_length() + 1
+
+
+def pack_block(x):
+    d0 = wrap16(x[1] - x[0])
+    res = []
+    d = d0
+    for n in range(2, WP_BLOCK):
+        dn = wrap16(x[n] - x[n-1])
+        res.append(wrap16(dn - d))
+        d = dn
+
+    width = max(signed_bits(r) for r in res)
+
+    out = bytearray(struct.pack('<hhB', x[0], d0, width))
+    acc = nbits = 0
+    for r in res:
+        acc |= (r & ((1 << width) - 1)) << nbits
+        nbits += width
+        while nbits >= 8:
+            out.append(acc & 0xFF)
+            acc >>= 8
+            nbits -= 8
+    if nbits:
+        out.append(acc & 0xFF)
+    return bytes(out)
+
+
+def unpack_block(data):
+    x, d, width = struct.unpack('<hhB', data[:WP_HEADER])
+    out = [x, wrap16(x + d)]
+    x = out[1]
+    pos, acc, nbits = WP_HEADER, 0, 0
+    for n in range(2, WP_BLOCK):
+        while nbits < width:
+            acc |= data[pos] << nbits
+            pos += 1
+            nbits += 8
+        r = acc & ((1 << width) - 1)
+        acc >>= width
+        nbits -= width
+        if width and r >= 1 << (width-1):
+            r -= 1 << width
+        d = wrap16(d + r)
+        x = wrap16(x + d)
+        out.append(x)
+    return out
+
+
+def fnv(samples):
+    h = 2166136261
+    for s in samples:
+        h = ((h ^ (s & 0xFFFF))*16777619) & 0xFFFFFFFF
+    return h
+
+
+def pack(samples):
+    half = all(samples[n + N//2] == -samples[n] for n in range(N//2))
+    blocks = [pack_block(samples[b:b+WP_BLOCK]) for b in range(0, N//2 if half else N, WP_BLOCK)]
+    offsets, pos = [], 0
+    for blk in blocks:
+        offsets.append(pos)
+        pos += len(blk)
+    data = b''.join(blocks)
+
+    decoded = []
+    for off, blk in zip(offsets, blocks):
+        decoded += unpack_block(data[off:off+len(blk)])
+    if half:
+        decoded += [-s for s in decoded]
+    if decoded != samples:
+        raise SystemExit('round trip failed')
+    return offsets, data, half, [blk[4] for blk in blocks]
+
+
+def carray(data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append('\t' + ' '.join('0x%02X,' % b for b in data[i:i+16]))
+    return '\n'.join(lines)
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Build the compressed wavetable library')
+    ap.add_argument('-o', '--output', default='wavelib.c')
+    ap.add_argument('tables', nargs='*', metavar='name=file')
+    args = ap.parse_args()
+
+    tables = list(BUILTIN)
+    for t in args.tables:
+        name, _, path = t.partition('=')
+        if not path or not name.isidentifier():
+            raise SystemExit('tables are given as name=file')
+        tables.append((name, load(path)))
+
+    body, entries = [], []
+    raw = packed = 0
+    for name, samples in tables:
+        offsets, data, half, widths = pack(samples)
+        size = len(data) + 2*len(offsets)
+        raw += 2*N
+        packed += size
+        print('%-12s %4d bytes  %.2f:1  residual bits %s%s' % (name, size, 2.0*N/size,
+              ' '.join(str(w) for w in widths), ', half wave' if half else ''))
+
+        body.append('//%s, %d bytes + %d offset bytes, %.2f:1%s\n' % (name, len(data), 2*len(offsets),
+                    2.0*N/size, ', half wave symmetric' if half else ''))
+        body.append('static const uint16_t %s_off[] = {%s};\n' % (name, ', '.join(str(o) for o in offsets)))
+        body.append('static const uint8_t %s_data[] = {\n%s\n};\n\n' % (name, carray(data)))
+        entries.append('\t{"%s", %s_off, %s_data, sizeof(%s_data), %d, 0x%08XUL},' %
+                       (name, name, name, name, half, fnv(samples)))
+
+    print('library      %4d bytes  %.2f:1 (%d tables, %d bytes raw)' % (packed, float(raw)/packed,
+          len(tables), raw))
+
+    with open(args.output, 'w') as f:
+        f.write('//Generated by tools/wavepack.py, do not edit\n\n#include "wavepack.h"\n\n')
+        f.write(''.join(body))
+        f.write('const PackedWave wavelib[] = {\n%s\n};\n\n' % '\n'.join(entries))
+        f.write('const uint8_t wavelibn = sizeof(wavelib)/sizeof(wavelib[0]);\n')
+
+
+if __name__ == '__main__':
+    main()
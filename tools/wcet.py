@@ -0,0 +1,532 @@
+#!/usr/bin/env python3
+"""
+Static worst-case execution time bound for the DMA refill.
+
+Disassembles the built ELF with arm-none-eabi-objdump, builds the control flow graph
+of DMA1_Channel2_3_IRQHandler and everything it calls, and bounds it with Cortex-M0
+instruction timings plus flash wait states. If the ELF has the refill stage the DMA
+interrupt pends (PendSV_Handler, see irq.h) that is bounded too and the refill is the two
+together, plus --fast cycles for the handlers that can preempt it; the DMA interrupt on
+its own is then the most the refill adds to their latency. Loops need a bound, given in
+the source on the loop's line (or the line above it):
+
+    //WCET-BOUND: DMA_BUFSIZ/2    at most this many iterations per entry to the loop
+    //WCET-TOTAL: DMA_BUFSIZ/2    at most this many iterations per call of the function
+                                  the loop is in, however often the loop is entered
+
+Library routines (libgcc's __aeabi_* division, newlib's memset and memcpy) have no source
+to annotate. A loop in one is reported with the call chain that reaches it; keep such calls
+out of the refill path, or give a bound you have measured with --lib NAME=CYCLES.
+
+Bounds may use any integer #define found in the project's .c/.h files. The result is
+compared with the half buffer period at the configured sample rate, and the exit code
+is non-zero if the margin is below --margin percent, so it can fail the build. With
+--advisory a short margin is only reported; anything the script can't bound (a loop
+without an annotation, a library loop, recursion, an indirect call) still fails.
+
+Timing model (upper bound, Cortex-M0 TRM cycle counts):
+  - 1 cycle data processing and MULS (STM32F0 has the single cycle multiplier)
+  - 2 cycles LDR/STR, 1+N LDM/STM/PUSH/POP, 3+N POP with PC
+  - 3 cycles B, taken conditional branch, BX/BLX, writes to PC; 4 cycles BL
+  - every branch, call, return and PC-relative literal load also pays the flash wait
+    states, straight line code is assumed to be covered by the prefetch buffer
+  - --bus extra cycles on every load/store for peripheral bus and DMA contention
+  - exception entry and return, 16 cycles each plus wait states for the vector fetch
+
+Usage:
+    wcet.py [options] STM32F0-I2ST1.elf
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+ROOT = 'DMA1_Channel2_3_IRQHandler'
+REFILL = 'PendSV_Handler'
+
+COND = {'eq', 'ne', 'cs', 'cc', 'hs', 'lo', 'mi', 'pl', 'vs', 'vc',
+        'hi', 'ls', 'ge', 'lt', 'gt', 'le'}
+
+ONE_CYCLE = {
+    'adcs', 'adds', 'add', 'adr', 'ands', 'asrs', 'bics', 'cmn', 'cmp', 'eors', 'lsls',
+    'lsrs', 'movs', 'mov', 'mvns', 'negs', 'rsbs', 'orrs', 'rors', 'sbcs', 'subs', 'sub',
+    'tst', 'sxtb', 'sxth', 'uxtb', 'uxth', 'rev', 'rev16', 'revsh', 'muls', 'nop',
+    'cpsid', 'cpsie', 'sev', 'yield', 'mrs', 'msr', 'udf', 'bkpt', 'svc', 'wfe'
+}
+LOADSTORE = {'ldr', 'ldrb', 'ldrh', 'ldrsb', 'ldrsh', 'str', 'strb', 'strh'}
+BARRIER = {'dmb', 'dsb', 'isb'}
+
+EXC_ENTRY = 16
+EXC_RETURN = 16
+
+
+class WcetError(Exception):
+    pass
+
+
+class Insn(object):
+    def __init__(self, addr, size, mnem, ops, src):
+        self.addr = addr
+        self.size = size
+        self.mnem = mnem
+        self.ops = ops
+        self.src = src        # (file, line) from objdump -l, or None
+
+
+def disassemble(args):
+    if args.objdump_file:
+        with open(args.objdump_file) as f:
+            return f.read()
+    try:
+        return subprocess.check_output([args.objdump, '-d', '-l', '--no-show-raw-insn', args.elf],
+                                       universal_newlines=True)
+    except OSError:
+        raise WcetError('could not run %s' % args.objdump)
+
+
+FUNC_RE = re.compile(r'^([0-9a-f]+) <([^>]+)>:$')
+LINE_RE = re.compile(r'^(\S.*):(\d+)(?: \(discriminator \d+\))?$')
+INSN_RE = re.compile(r'^\s*([0-9a-f]+):\s+(?:(?:[0-9a-f]{4}\s)+\s*)?([a-z][a-z0-9.]*)\s*(.*)$')
+
+
+def parse(text):
+    """Return {name: [Insn]} and {addr: name} of function entry points."""
+    funcs, entries = {}, {}
+    cur, src = None, None
+    for raw in text.splitlines():
+        line = raw.rstrip()
+        m = FUNC_RE.match(line)
+        if m:
+            cur = m.group(2)
+            funcs[cur] = []
+            entries[int(m.group(1), 16)] = cur
+            src = None
+            continue
+        if cur is None or not line:
+            continue
+        m = LINE_RE.match(line)
+        if m and not line.startswith(' ') and not line.startswith('\t'):
+            src = (m.group(1), int(m.group(2)))
+            continue
+        m = INSN_RE.match(line)
+        if m:
+            ops = m.group(3).split(';')[0].split('@')[0].strip()
+            if ops.startswith('.'):
+                # Literal pool data, shown as its value (which can look like a
+                # mnemonic) followed by .word or .short
+                continue
+            funcs[cur].append(Insn(int(m.group(1), 16), 0, m.group(2), ops, src))
+    for insns in funcs.values():
+        for i, ins in enumerate(insns):
+            nxt = insns[i + 1].addr if i + 1 < len(insns) else ins.addr + 2
+            ins.size = nxt - ins.addr
+    return funcs, entries
+
+
+def reglist(ops):
+    m = re.search(r'\{([^}]*)\}', ops)
+    if not m:
+        raise WcetError('no register list in "%s"' % ops)
+    n = 0
+    for part in m.group(1).split(','):
+        part = part.strip()
+        if '-' in part:
+            a, b = part.split('-')
+            n += int(b.strip()[1:]) - int(a.strip()[1:]) + 1
+        elif part:
+            n += 1
+    return n
+
+
+def branch_target(ops):
+    m = re.match(r'([0-9a-f]+)', ops)
+    if not m:
+        raise WcetError('indirect branch "%s"' % ops)
+    return int(m.group(1), 16)
+
+
+def split_cond(mnem):
+    base = mnem.split('.')[0]
+    if base.startswith('b') and base[1:] in COND:
+        return 'b', True
+    return base, False
+
+
+def cost(ins, ws, bus):
+    """Cycles for one instruction: (not taken / fall through, taken)."""
+    base, cond = split_cond(ins.mnem)
+    ops = ins.ops
+    if base == 'b':
+        if cond:
+            return 1, 3 + ws
+        return 3 + ws, 3 + ws
+    if base == 'bl':
+        return 4 + ws, 4 + ws
+    if base in ('bx', 'blx'):
+        return 3 + ws, 3 + ws
+    if base == 'push':
+        return 1 + reglist(ops) + bus, None
+    if base == 'pop':
+        n = reglist(ops)
+        if 'pc' in ops:
+            return 3 + n + ws + bus, None
+        return 1 + n + bus, None
+    if base in ('ldm', 'ldmia', 'stm', 'stmia'):
+        return 1 + reglist(ops) + bus, None
+    if base in LOADSTORE:
+        c = 2 + bus
+        if '[pc' in ops or re.match(r'r\d+, \[?[0-9a-f]+ <', ops):
+            c += ws
+        return c, None
+    if base in ONE_CYCLE:
+        if base in ('add', 'mov') and ops.startswith('pc'):
+            return 3 + ws, None
+        return 1, None
+    if base in BARRIER:
+        return 4, None
+    if base == 'wfi':
+        raise WcetError('wfi in interrupt path at 0x%x' % ins.addr)
+    raise WcetError('no timing for "%s" at 0x%x' % (ins.mnem, ins.addr))
+
+
+def load_defines(srcdir):
+    """Integer #defines from the project sources (top level only, not the libraries)."""
+    defs = {}
+    for fn in sorted(os.listdir(srcdir)):
+        if not fn.endswith(('.c', '.h')):
+            continue
+        with open(os.path.join(srcdir, fn), errors='replace') as f:
+            for line in f:
+                m = re.match(r'\s*#define\s+([A-Za-z_]\w*)\s+(.+?)\s*(//.*)?$', line)
+                if m:
+                    defs.setdefault(m.group(1), m.group(2))
+    return defs
+
+
+def evaluate(expr, defs, depth=0):
+    if depth > 16:
+        raise WcetError('define recursion in "%s"' % expr)
+    expr = re.sub(r'\b(\d+)[uUlL]+\b', r'\1', expr)
+
+    def sub(m):
+        name = m.group(0)
+        if name not in defs:
+            raise WcetError('unknown define %s in loop bound' % name)
+        return '(%d)' % evaluate(defs[name], defs, depth + 1)
+    expr = re.sub(r'[A-Za-z_]\w*', sub, expr)
+    if not re.match(r'^[\d\s()+\-*/%<>]+$', expr):
+        raise WcetError('bad loop bound "%s"' % expr)
+    return int(eval(expr.replace('/', '//')))
+
+
+class Sources(object):
+    def __init__(self, srcdir):
+        self.srcdir = srcdir
+        self.cache = {}
+
+    def lines(self, path):
+        if path not in self.cache:
+            cand = [path, os.path.join(self.srcdir, os.path.basename(path.replace('\\', '/')))]
+            self.cache[path] = []
+            for c in cand:
+                if os.path.exists(c):
+                    with open(c, errors='replace') as f:
+                        self.cache[path] = f.read().splitlines()
+                    break
+        return self.cache[path]
+
+    def annotation(self, src):
+        """Look for a bound on the given source line or the line above."""
+        if src is None:
+            return None
+        lines = self.lines(src[0])
+        for ln in (src[1], src[1] - 1):
+            if 0 < ln <= len(lines):
+                m = re.search(r'WCET-(BOUND|TOTAL):\s*(.+?)\s*(\*/)?$', lines[ln - 1])
+                if m:
+                    return m.group(1), m.group(2)
+        return None
+
+
+class Analyser(object):
+    def __init__(self, funcs, entries, ws, bus, defs, sources, lib):
+        self.funcs = funcs
+        self.entries = entries
+        self.ws = ws
+        self.bus = bus
+        self.defs = defs
+        self.sources = sources
+        self.lib = lib
+        self.memo = {}
+        self.stack = []
+        self.report = []
+
+    def chain(self):
+        return ' -> '.join(self.stack)
+
+    def func_wcet(self, name):
+        if name in self.memo:
+            return self.memo[name]
+        if name in self.lib:
+            self.memo[name] = self.lib[name]
+            self.report.append((name, self.lib[name]))
+            return self.lib[name]
+        if name in self.stack:
+            raise WcetError('recursion through %s (%s)' % (name, self.chain()))
+        if name not in self.funcs or not self.funcs[name]:
+            raise WcetError('no code for %s, called from %s' % (name, self.chain()))
+        self.stack.append(name)
+        w = self.analyse(name)
+        self.stack.pop()
+        self.memo[name] = w
+        self.report.append((name, w))
+        return w
+
+    def callee(self, addr):
+        if addr not in self.entries:
+            raise WcetError('call into the middle of a function at 0x%x from %s' % (addr, self.chain()))
+        return self.entries[addr]
+
+    def analyse(self, name):
+        insns = self.funcs[name]
+        start, end = insns[0].addr, insns[-1].addr + insns[-1].size
+        byaddr = dict((i.addr, i) for i in insns)
+
+        # Basic block leaders
+        leaders = set([start])
+        for ins in insns:
+            base, cond = split_cond(ins.mnem)
+            if base == 'b':
+                t = branch_target(ins.ops)
+                if start <= t < end:
+                    leaders.add(t)
+                leaders.add(ins.addr + ins.size)
+            elif base in ('bx', 'blx') or (base == 'pop' and 'pc' in ins.ops):
+                leaders.add(ins.addr + ins.size)
+        leaders = sorted(a for a in leaders if a in byaddr)
+
+        # Blocks: leader -> (cost, successor edges [(dst or None for exit, extra cost)])
+        blocks = {}
+        for n, lead in enumerate(leaders):
+            stop = leaders[n + 1] if n + 1 < len(leaders) else end
+            c, succ = 0, []
+            a = lead
+            while a < stop:
+                ins = byaddr[a]
+                base, cond = split_cond(ins.mnem)
+                ft, taken = cost(ins, self.ws, self.bus)
+                last = ins.addr + ins.size >= stop
+                if base == 'b':
+                    t = branch_target(ins.ops)
+                    if start <= t < end:
+                        succ.append((t, taken))
+                    else:
+                        # Tail call
+                        succ.append((None, taken + self.func_wcet(self.callee(t))))
+                    if cond:
+                        succ.append((ins.addr + ins.size, ft))
+                    c_ins = 0
+                elif base == 'bl':
+                    c_ins = ft + self.func_wcet(self.callee(branch_target(ins.ops)))
+                elif base == 'blx':
+                    raise WcetError('indirect call in %s at 0x%x' % (name, ins.addr))
+                elif base == 'bx' or (base == 'pop' and 'pc' in ins.ops):
+                    succ.append((None, ft))
+                    c_ins = 0
+                elif base in ('add', 'mov') and ins.ops.startswith('pc'):
+                    raise WcetError('computed jump in %s at 0x%x' % (name, ins.addr))
+                else:
+                    c_ins = ft
+                c += c_ins
+                if last and not succ and base != 'b':
+                    succ.append((ins.addr + ins.size, 0))
+                a += ins.size
+            blocks[lead] = (c, [(d if d is None or d in byaddr else None, e) for d, e in succ])
+
+        return self.bound(name, start, blocks)
+
+    def bound(self, name, start, blocks):
+        # Back edges from a depth first search, then natural loops keyed by header
+        back, state = set(), {}
+
+        def dfs(b):
+            state[b] = 1
+            for d, _ in blocks[b][1]:
+                if d is None:
+                    continue
+                if state.get(d) == 1:
+                    back.add((b, d))
+                elif d not in state:
+                    dfs(d)
+            state[b] = 2
+        sys.setrecursionlimit(10000)
+        dfs(start)
+
+        preds = dict((b, []) for b in blocks)
+        for b in blocks:
+            for d, _ in blocks[b][1]:
+                if d is not None:
+                    preds[d].append(b)
+        loops, tails = {}, {}
+        for tail, head in back:
+            body = loops.setdefault(head, set([head]))
+            tails.setdefault(head, []).append(tail)
+            work = [tail]
+            while work:
+                x = work.pop()
+                if x not in body:
+                    body.add(x)
+                    work.extend(preds[x])
+
+        # Innermost loops first, each collapsed into a single node at its header with
+        # cost bound*iteration and edges straight to the loop's exits
+        collapsed = {}
+        extra = 0
+        for head in sorted(loops, key=lambda h: len(loops[h])):
+            body = loops[head]
+            kind, expr = self.loop_bound(name, [head] + tails[head], blocks)
+            n = evaluate(expr, self.defs)
+            dist, edges = self.dag(blocks, collapsed, head, body)
+            it = max(dist[b] + e for b, d, e in edges if d == head)
+            exits = [(d, dist[b] + e) for b, d, e in edges if d != head]
+            if kind == 'TOTAL':
+                extra += n * it
+                collapsed[head] = (0, exits)
+            else:
+                collapsed[head] = (n * it, exits)
+
+        dist, edges = self.dag(blocks, collapsed, None, None, start)
+        return max(dist[b] + e for b, d, e in edges if d is None) + extra
+
+    def dag(self, blocks, collapsed, head, body, start=None):
+        """Longest paths from the loop header (or start) through the acyclic graph left
+        once inner loops are collapsed. Returns cost to the end of every block reached and
+        the edges that leave the region or go back to the header."""
+        src = head if head is not None else start
+
+        def node(b):
+            if b in collapsed and b != head:
+                return collapsed[b]
+            return blocks[b]
+
+        def inside(d):
+            return d is not None and d != head and (body is None or d in body)
+
+        order, state = [], {}
+
+        def visit(b):
+            state[b] = 1
+            for d, _ in node(b)[1]:
+                if inside(d):
+                    if state.get(d) == 1:
+                        raise WcetError('irreducible control flow at 0x%x' % d)
+                    if d not in state:
+                        visit(d)
+            state[b] = 2
+            order.append(b)
+        visit(src)
+        order.reverse()
+
+        dist, edges = {src: node(src)[0]}, []
+        for b in order:
+            for d, e in node(b)[1]:
+                if inside(d):
+                    v = dist[b] + e + node(d)[0]
+                    if v > dist.get(d, -1):
+                        dist[d] = v
+                else:
+                    edges.append((b, d, e))
+        return dist, edges
+
+    def loop_bound(self, name, blocks_to_search, blocks):
+        """Annotation on the source line of the loop's header or latch blocks."""
+        insns = self.funcs[name]
+        for i, ins in enumerate(insns):
+            if ins.addr not in blocks_to_search:
+                continue
+            for j in range(i, len(insns)):
+                if j > i and insns[j].addr in blocks:
+                    break
+                a = self.sources.annotation(insns[j].src)
+                if a:
+                    return a
+        if all(i.src is None for i in insns):
+            raise WcetError('%s is a library routine with a loop and no source to bound it, '
+                            'called by %s. Keep it out of the refill path, or give a measured '
+                            'bound with --lib %s=CYCLES' % (name, self.chain(), name))
+        src = [i.src for i in insns if i.src and i.addr >= blocks_to_search[0]] + [None]
+        raise WcetError('no WCET-BOUND for loop at 0x%x in %s (%s), called by %s'
+                        % (blocks_to_search[0], name, '%s:%d' % src[0] if src[0] else 'no line',
+                           self.chain()))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split('\n\n')[0].strip())
+    ap.add_argument('elf')
+    ap.add_argument('--objdump', default='arm-none-eabi-objdump')
+    ap.add_argument('--objdump-file', help='use saved "objdump -d -l" output instead')
+    ap.add_argument('--root', default=ROOT)
+    ap.add_argument('--refill', default=REFILL, help='deferred refill stage, if the ELF has it')
+    ap.add_argument('--fast', type=int, default=0,
+                    help='cycles per half buffer for the handlers between the two stages')
+    ap.add_argument('--src', default=os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+    ap.add_argument('--hclk', type=int, default=48000000)
+    ap.add_argument('--ws', type=int, default=1, help='flash wait states (1 above 24MHz)')
+    ap.add_argument('--bus', type=int, default=1, help='extra cycles per load/store')
+    ap.add_argument('--margin', type=float, default=20.0,
+                    help='minimum margin in percent of the half buffer period')
+    ap.add_argument('--lib', action='append', default=[], metavar='NAME=CYCLES',
+                    help='bound for a library routine that has no source to annotate')
+    ap.add_argument('--advisory', action='store_true',
+                    help='report a margin below --margin without failing')
+    ap.add_argument('-v', '--verbose', action='store_true')
+    args = ap.parse_args()
+
+    lib = {}
+    for spec in args.lib:
+        m = re.match(r'^(\w+)=(\d+)$', spec)
+        if not m:
+            ap.error('bad --lib "%s", expected NAME=CYCLES' % spec)
+        lib[m.group(1)] = int(m.group(2))
+
+    defs = load_defines(args.src)
+    try:
+        funcs, entries = parse(disassemble(args))
+        if args.root not in funcs:
+            raise WcetError('%s not found in %s' % (args.root, args.elf))
+        an = Analyser(funcs, entries, args.ws, args.bus, defs, Sources(args.src), lib)
+        stages = [(args.root, an.func_wcet(args.root))]
+        if args.refill in funcs:
+            stages.append((args.refill, an.func_wcet(args.refill)))
+        fs = evaluate('FS', defs)
+        frames = evaluate('DMA_BUFSIZ', defs) // 2
+    except WcetError as e:
+        print('wcet: error: %s' % e, file=sys.stderr)
+        return 2
+
+    stages = [(name, body + EXC_ENTRY + EXC_RETURN + args.ws) for name, body in stages]
+    wcet = sum(w for _, w in stages) + args.fast
+    period = args.hclk * frames // fs
+    margin = 100.0 * (period - wcet) / period
+
+    if args.verbose:
+        for name, w in an.report:
+            print('  %-32s %8d cycles' % (name, w))
+    if len(stages) > 1:
+        print('%s WCET %d cycles (%.1f us), the most it delays other handlers'
+              % (stages[0][0], stages[0][1], stages[0][1] * 1e6 / args.hclk))
+        print('%s WCET %d cycles, with %d for preempting handlers'
+              % (stages[1][0], stages[1][1], args.fast))
+    print('refill WCET %d cycles (%.1f us), half buffer %d frames = %d cycles, margin %.1f%%'
+          % (wcet, wcet * 1e6 / args.hclk, frames, period, margin))
+
+    if margin < args.margin:
+        print('wcet: margin below %.1f%%' % args.margin, file=sys.stderr)
+        return 0 if args.advisory else 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
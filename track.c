@@ -0,0 +1,245 @@
+#include "track.h"
+#include "adc.h"
+#include "cmd.h"
+
+//Noise bandwidth to natural frequency for zeta 0.707, wn = 2*Bn/(zeta + 1/(4*zeta)) rad/s,
+//per mHz in Q32
+#define TRACK_WN		8098668ULL
+
+//CORDIC iterations, the last step is 0.0001 degrees, and 1/gain in Q30
+#define TRACK_CORDIC	20
+#define TRACK_CORDICK	652032874
+
+//atan(2^-n), 2^32 per cycle
+static const uint32_t trackatan[TRACK_CORDIC] = {
+	0x20000000, 0x12E4051E, 0x09FB385B, 0x051111D4, 0x028B0D43, 0x0145D7E1, 0x00A2F61E, 0x00517C55,
+	0x0028BE53, 0x00145F2F, 0x000A2F98, 0x000517CC, 0x00028BE6, 0x000145F3, 0x0000A2FA, 0x0000517D,
+	0x000028BE, 0x0000145F, 0x00000A30, 0x00000518
+};
+
+volatile uint8_t trackstate = TRACK_OFF;
+int32_t trackerr;
+uint32_t trackampl, tracktw, trackupdates;
+
+//Phase detector, run by the refill interrupt. Sums for the update so far, the output frame
+//that goes with the sample still converting at the interrupt, and the last complete sums
+//handed to the task with a sequence number.
+static volatile uint8_t tracksync = 0;
+static uint8_t trackfirst, trackhalves;
+static int32_t mixi, mixq, lasti, lastq;
+static volatile int32_t tracki, trackq;
+static volatile uint32_t trackseq;
+
+//Loop filter, run by the task
+static uint32_t trackdone, trackkp[2], trackki[2], tracktw0;
+static int64_t trackint, trackpull;
+static int32_t trackavg;
+static uint32_t trackabs;
+
+//Loop gains for a noise bandwidth of bw mHz. wn*T in Q32 for an update every TRACK_FRAMES
+//frames, then for a detector gain of 1 and an oscillator gain of K = 2*TRACK_FRAMES (the
+//accumulator steps twice a frame): kp = 2*zeta*wnT/K, ki = (wnT)^2/K.
+static void TrackGains(uint32_t bw, uint32_t *kp, uint32_t *ki){
+	uint64_t w;
+
+	if(bw>TRACK_MAXBW) bw = TRACK_MAXBW;
+	w = (uint64_t)bw*TRACK_FRAMES*TRACK_WN/genfs;
+	*kp = ((w*46341)>>16)>>TRACK_LOG2FRAMES;
+	*ki = ((w*w)>>32)>>(TRACK_LOG2FRAMES + 1);
+}
+
+//Start tracking a tone near freq Hz with a loop noise bandwidth of bw mHz. Puts the
+//generator in plain quadrature at freq through the command queue and waits for TrackSync()
+//before the detector starts. Returns 0 without starting if the queue hasn't room.
+uint8_t TrackStart(uint32_t freq, uint32_t bw){
+	if(CmdSpace()<5) return 0;
+	TrackStop();
+
+	//Acquire wide, track at the bandwidth asked for
+	TrackGains(bw>TRACK_ACQBW ? bw : TRACK_ACQBW, &trackkp[0], &trackki[0]);
+	TrackGains(bw, &trackkp[1], &trackki[1]);
+
+	tracktw0 = tracktw = twperhz*freq;
+	trackpull = (int64_t)TRACK_PULL*twperhz<<32;
+	trackint = 0;
+	trackavg = 0;
+	trackabs = TRACK_ABSINIT;
+	trackerr = 0;
+	trackampl = 0;
+	trackupdates = 0;
+	trackdone = trackseq;
+
+	CmdSubmit(CMD_HOPSTOP, 0, 0, 0, 0);
+	CmdSubmit(CMD_PULSESTOP, 0, 0, 0, 0);
+	CmdSubmit(CMD_DUAL, 0, 0, 0, 0);
+	CmdSubmit(CMD_SKEW, 0, 0, 0, 0);
+	CmdSubmit(CMD_TUNE, 0, 0, tracktw, 0);
+	trackstate = TRACK_ACQUIRE;
+	return 1;
+}
+
+//Stop tracking, the output stays on the last frequency
+void TrackStop(void){
+	trackstate = TRACK_OFF;
+	tracksync = 0;
+}
+
+//Called by the refill interrupt at the half transfer point, as it starts the ADC: sample n
+//will be taken on frame TRACK_DECIM*(n+1) - 1 of the second half, counting round the
+//whole buffer.
+void TrackSync(void){
+	mixi = mixq = 0;
+	trackhalves = 0;
+	trackfirst = 1;
+	tracksync = 1;
+}
+
+//Phase detector, called by the refill interrupt before the half at pos (in dmabuf) is
+//refilled. Mixes the ADC samples taken while it played with the cosine and sine it held on
+//the same frames, scaled down to 12 bits so an update's sums fit 32 bits.
+void TrackMix(uint32_t pos, const uint16_t *adc){
+	const int16_t *out = &dmabuf[pos];
+	const uint16_t *in = adc + (pos ? 0 : TRACK_PERHALF);
+	int32_t x, i = mixi, q = mixq;
+	uint8_t m;
+
+	if(!tracksync) return;
+
+	//The last sample of the half before was still converting then
+	if(!trackfirst){
+		x = adc[pos ? TRACK_ADCLEN-1 : TRACK_PERHALF-1] - ADC_MID;
+		i += x*lasti;
+		q += x*lastq;
+	}
+	trackfirst = 0;
+
+	//WCET-BOUND: TRACK_PERHALF
+	for(m = 0; m<TRACK_PERHALF-1; m++){
+		x = in[m] - ADC_MID;
+		i += x*(out[2*(TRACK_DECIM*m + TRACK_DECIM-1)]>>4);
+		q += x*(out[2*(TRACK_DECIM*m + TRACK_DECIM-1) + 1]>>4);
+	}
+	lasti = out[DMA_BUFSIZ-2]>>4;
+	lastq = out[DMA_BUFSIZ-1]>>4;
+
+	if(++trackhalves == TRACK_HALVES){
+		tracki = i;
+		trackq = q;
+		trackseq++;
+		i = q = 0;
+		trackhalves = 0;
+	}
+	mixi = i;
+	mixq = q;
+}
+
+//Angle of (x, y), 2^32 per cycle, by CORDIC vectoring. mag gets the length times the
+//CORDIC gain, 1.6468.
+static uint32_t TrackAtan2(int32_t y, int32_t x, uint32_t *mag){
+	uint32_t a = 0;
+	int32_t t;
+	uint8_t n;
+
+	if(x<0){
+		x = -x;
+		y = -y;
+		a = 0x80000000UL;
+	}
+	for(n = 0; n<TRACK_CORDIC; n++){
+		t = x;
+		if(y>0){
+			x += y>>n;
+			y -= t>>n;
+			a += trackatan[n];
+		}
+		else{
+			x -= y>>n;
+			y += t>>n;
+			a -= trackatan[n];
+		}
+	}
+
+	*mag = x;
+	return a;
+}
+
+//Cosine and sine of a (2^32 per cycle, under a quarter cycle) in Q30, by CORDIC rotation
+static void TrackSinCos(uint32_t a, int32_t *c, int32_t *s){
+	int32_t x = TRACK_CORDICK, y = 0, z = a, t;
+	uint8_t n;
+
+	for(n = 0; n<TRACK_CORDIC; n++){
+		t = x;
+		if(z>0){
+			x -= y>>n;
+			y += t>>n;
+			z -= trackatan[n];
+		}
+		else{
+			x += y>>n;
+			y -= t>>n;
+			z += trackatan[n];
+		}
+	}
+
+	*c = x;
+	*s = y;
+}
+
+//Loop filter, for a background task. Returns 1 if there was an update to process.
+uint8_t TrackUpdate(void){
+	int32_t i, q, e, c, sn;
+	uint32_t seq, mag, t, h = tw;
+	uint16_t ampl = amplactive[0];
+	uint8_t g;
+	int64_t d;
+
+	if(trackstate == TRACK_OFF || trackseq == trackdone) return 0;
+	do{
+		seq = trackseq;
+		i = tracki;
+		q = trackq;
+	}while(seq != trackseq);
+	trackdone = seq;
+	trackupdates++;
+
+	//With p the input's phase against the cosine, i goes as cos(p) but the sine goes out
+	//half a frame later, one accumulator step h on, so -q goes as sin(p - h). Then
+	//sin(p) = (-q + i*sin(h))/cos(h). The ADC samples TRACK_LAG into the frame, which also
+	//shows as phase and is taken back off.
+	TrackSinCos(h, &c, &sn);
+	e = TrackAtan2(-q + (int32_t)(((int64_t)i*sn)>>30), ((int64_t)i*c)>>30, &mag) -
+			(uint32_t)(((uint64_t)h*TRACK_LAG)>>7);
+	trackerr = e;
+
+	//Peak input amplitude: the sums are N*A*(ampl/16)/2*cos(h) for N = TRACK_HALVES*
+	//TRACK_PERHALF samples, 0.1518 = 2*16/1.6468/128 for N = 128
+	trackampl = ampl && c>0 ? (((((uint64_t)mag<<30)/c)*9949)>>16)/ampl : 0;
+	if(trackampl<TRACK_MINAMPL){
+		trackstate = TRACK_NOSIGNAL;
+		trackabs = TRACK_ABSINIT;
+		return 1;
+	}
+
+	//The integrator holds the frequency, so changing gains on lock or unlock is smooth
+	g = trackstate == TRACK_LOCKED;
+	trackint += (int64_t)e*trackki[g];
+	if(trackint>trackpull) trackint = trackpull;
+	if(trackint<-trackpull) trackint = -trackpull;
+	d = (trackint + (int64_t)e*trackkp[g])>>32;
+	t = tracktw0 + (int32_t)d;
+
+	//Lock detector. The average error is the standing phase offset, with noise and the
+	//detector's ripple averaged out, but it also averages out a loop that is slipping
+	//cycles, which the average size of the error shows. Once locked, only an average past
+	//twice the tolerance unlocks.
+	trackavg += (e - trackavg)>>TRACK_LOCKSHIFT;
+	trackabs += (int32_t)((e<0 ? -(uint32_t)e : (uint32_t)e) - trackabs)>>TRACK_LOCKSHIFT;
+	if(trackabs>=TRACK_SLIPTOL) trackstate = TRACK_ACQUIRE;
+	else if(trackavg<TRACK_LOCKTOL && trackavg>-TRACK_LOCKTOL) trackstate = TRACK_LOCKED;
+	else if(trackavg>=2*TRACK_LOCKTOL || trackavg<=-2*TRACK_LOCKTOL) trackstate = TRACK_ACQUIRE;
+
+	//If the queue is full it goes with the next update. A trim, left out of the record.
+	if(t != tracktw && CmdSubmit(CMD_TUNE | CMD_TRIM, 0, 0, t, 0)) tracktw = t;
+	return 1;
+}
@@ -0,0 +1,88 @@
+#ifndef TRACK_H
+#define TRACK_H
+
+#include <stdint.h>
+#include "generator.h"
+
+/*
+ * Tracking mode, a software PLL that locks the quadrature output to a tone on ADC_IN3
+ * (PA3). The ADC converts the input every TRACK_DECIM frames, started from the refill
+ * interrupt so every sample falls TRACK_LAG after a known output frame. The phase detector
+ * is in the refill interrupt: TrackMix() multiplies each input sample by the cosine and
+ * sine the generator put out on that frame, straight from dmabuf before the half is
+ * refilled, which costs a few multiplies per block and needs no model of the generator.
+ * Every TRACK_HALVES halves the sums are handed to TrackUpdate() in a background task,
+ * which takes their angle (CORDIC), runs a proportional plus integral loop filter and
+ * steers channel 0's tuning word through CMD_TUNE, submitted as a trim (cmd.h) so its
+ * updates stay out of the session record.
+ *
+ * The loop is second order (zeta 0.707). It acquires at TRACK_ACQBW and narrows to the
+ * noise bandwidth given to TrackStart() once locked, up to TRACK_MAXBW. It settles on
+ * zero phase error between the input at the ADC pin and the cosine output's samples; the
+ * DAC and its filter add their own delay to the analog output after that. Tracking is for
+ * plain quadrature mode with the input below the ADC's Nyquist frequency
+ * (FS/TRACK_DECIM/2). The detector's double frequency product is only averaged out over
+ * an update, so low tones, with few cycles per update, track with more jitter. "sim
+ * track" scripts inputs against the loop for lock time and jitter.
+ */
+
+//Frames per ADC sample and ADC samples per refill half
+#define TRACK_DECIM		2
+#define TRACK_PERHALF	(DMA_BUFSIZ/2/TRACK_DECIM)
+
+//ADC buffer, one sample per TRACK_DECIM frames of the whole DMA buffer so the two stay in
+//step
+#define TRACK_ADCLEN	(2*TRACK_PERHALF)
+
+//Halves per loop update, and the frames that makes (a power of two) and its log2
+#define TRACK_HALVES	16
+#define TRACK_FRAMES	(TRACK_HALVES*DMA_BUFSIZ/2)
+#define TRACK_LOG2FRAMES	8
+
+//The ADC samples this long after its frame starts, 1/256 frame: the trigger latency
+//through the interrupt plus the sampling time
+#define TRACK_LAG		51
+
+//Widest loop noise bandwidth, mHz. Keeps the loop's natural frequency under a quarter of
+//the update rate, where the delay of one update costs little phase margin.
+#define TRACK_MAXBW		24000
+
+//Acquisition bandwidth, mHz, used until lock when the tracking bandwidth is narrower.
+//Pull-in time goes as the inverse cube of the bandwidth.
+#define TRACK_ACQBW		20000
+
+//Largest frequency the integrator may pull from the start frequency, Hz
+#define TRACK_PULL		200
+
+//Locked once the phase error, averaged over about 2^TRACK_LOCKSHIFT updates, is within
+//TRACK_LOCKTOL (2^32 per cycle, 2 degrees), unlocked again at twice that, or whenever the
+//average size of the error reaches TRACK_SLIPTOL (20 degrees). That average starts from
+//TRACK_ABSINIT (90 degrees), which takes a few dozen updates to come down.
+#define TRACK_LOCKTOL	23860929
+#define TRACK_SLIPTOL	238609294
+#define TRACK_ABSINIT	0x40000000UL
+#define TRACK_LOCKSHIFT	4
+
+//Below this input amplitude (ADC counts peak) the loop holds its frequency
+#define TRACK_MINAMPL	16
+
+//Loop states
+#define TRACK_OFF		0
+#define TRACK_ACQUIRE	1
+#define TRACK_LOCKED	2
+#define TRACK_NOSIGNAL	3
+
+//For reading out with the debugger
+extern volatile uint8_t trackstate;
+extern int32_t trackerr;		//Last phase error, 2^32 per cycle, input ahead positive
+extern uint32_t trackampl;		//Input amplitude, ADC counts peak
+extern uint32_t tracktw;		//Tuning word last submitted
+extern uint32_t trackupdates;	//Loop updates since TrackStart()
+
+uint8_t TrackStart(uint32_t freq, uint32_t bw);
+void TrackStop(void);
+void TrackSync(void);
+void TrackMix(uint32_t pos, const uint16_t *adc);
+uint8_t TrackUpdate(void);
+
+#endif
@@ -0,0 +1,91 @@
+//Generated by tools/wavepack.py, do not edit
+
+#include "wavepack.h"
+
+//square_bl, 142 bytes + 8 offset bytes, 3.41:1, half wave symmetric
+static const uint16_t square_bl_off[] = {0, 47, 71, 95};
+static const uint8_t square_bl_data[] = {
+	0x00, 0x00, 0x5F, 0x12, 0x0B, 0x84, 0x87, 0x78, 0xAA, 0xB1, 0xDC, 0xE1, 0xFE, 0xEA, 0xD7, 0xC1,
+	0x37, 0x96, 0x33, 0xAE, 0x07, 0xEE, 0x74, 0xCA, 0x3F, 0xFF, 0xFF, 0x21, 0xA8, 0x01, 0x0F, 0x72,
+	0x10, 0x83, 0x0F, 0x44, 0x00, 0x00, 0xF4, 0x57, 0xBF, 0xF9, 0xCF, 0x9F, 0x7E, 0xF9, 0x03, 0x3E,
+	0x7D, 0xD3, 0xFF, 0x05, 0x48, 0xB9, 0xC6, 0x12, 0x01, 0x5C, 0x67, 0x9C, 0x79, 0x07, 0x62, 0x94,
+	0x41, 0x44, 0x08, 0xFE, 0x7F, 0x0F, 0x3E, 0x1E, 0x7D, 0x00, 0x00, 0x05, 0xE0, 0x03, 0xFF, 0xBF,
+	0x0F, 0x41, 0x90, 0x51, 0x86, 0x00, 0x9D, 0x67, 0x9C, 0x35, 0x07, 0x24, 0xB1, 0xE6, 0x14, 0x3E,
+	0x7D, 0x2C, 0x00, 0x0B, 0xF8, 0x97, 0x7F, 0xFA, 0xCF, 0x6F, 0x7E, 0xF5, 0xD3, 0x1F, 0x00, 0x11,
+	0xF8, 0x40, 0x0C, 0x72, 0xC0, 0x83, 0x1A, 0x84, 0xE0, 0xFF, 0xCF, 0xA7, 0xBC, 0xD3, 0x07, 0x8E,
+	0x6B, 0x39, 0xDF, 0xD8, 0xC1, 0xFA, 0xED, 0x6F, 0x87, 0xB1, 0x9C, 0x6A, 0x88, 0x03,
+};
+
+//saw_bl, 230 bytes + 16 offset bytes, 2.08:1
+static const uint16_t saw_bl_off[] = {0, 20, 40, 68, 115, 162, 190, 210};
+static const uint8_t saw_bl_data[] = {
+	0x00, 0x00, 0x0B, 0x01, 0x04, 0x31, 0x33, 0x14, 0xF1, 0xEE, 0xDC, 0xED, 0x11, 0x23, 0x25, 0x03,
+	0xE0, 0xCD, 0xEC, 0x0E, 0x4A, 0x22, 0x0E, 0x01, 0x04, 0x53, 0x33, 0x10, 0xCD, 0xCC, 0xEC, 0x10,
+	0x44, 0x55, 0x13, 0xD0, 0xBB, 0xAB, 0xFE, 0x33, 0x8E, 0x44, 0x18, 0x01, 0x06, 0x45, 0x31, 0xFC,
+	0x7C, 0x9E, 0xDF, 0x39, 0xFF, 0x0B, 0x47, 0xB2, 0x28, 0x08, 0xF1, 0xE7, 0x77, 0x2C, 0xCF, 0xB7,
+	0x5F, 0x30, 0x52, 0x05, 0xD0, 0x66, 0x48, 0x01, 0x0B, 0x09, 0xF0, 0xFF, 0xFC, 0xD1, 0xFF, 0x7D,
+	0xEE, 0x77, 0x3F, 0xFD, 0xF8, 0x77, 0xC0, 0x08, 0x76, 0x90, 0x84, 0x27, 0x14, 0x41, 0x05, 0xFB,
+	0xD7, 0xBD, 0xD9, 0x15, 0x5E, 0x6A, 0x22, 0xBF, 0xB7, 0xB5, 0x84, 0xFD, 0xAB, 0x67, 0xC1, 0x5B,
+	0x64, 0x64, 0x03, 0x00, 0x00, 0xAD, 0xEB, 0x0B, 0xA1, 0xC0, 0xC9, 0x6E, 0x40, 0x24, 0xA6, 0x40,
+	0xF1, 0x69, 0x4A, 0x11, 0xE2, 0xCD, 0x56, 0xEC, 0xA1, 0x09, 0x23, 0x14, 0xC0, 0xFA, 0xBB, 0x8F,
+	0xFD, 0xED, 0x8B, 0xDF, 0x7D, 0xF9, 0x23, 0xE0, 0x02, 0x23, 0x20, 0x41, 0x08, 0x30, 0xD0, 0x00,
+	0x01, 0x00, 0x30, 0x99, 0x37, 0x01, 0x06, 0xEB, 0xEA, 0xD2, 0xBB, 0x90, 0x34, 0xCE, 0x93, 0x1C,
+	0x01, 0x8F, 0xDB, 0xF5, 0x9D, 0xFB, 0x01, 0x71, 0x24, 0xC7, 0x41, 0x04, 0xFD, 0x0E, 0x72, 0xBB,
+	0x10, 0x01, 0x04, 0xDA, 0x1D, 0x62, 0x55, 0x35, 0xF0, 0xBD, 0xCB, 0xFC, 0x20, 0x44, 0x44, 0xF3,
+	0xD0, 0xBD, 0xB6, 0xDD, 0x0B, 0x01, 0x04, 0x0F, 0x22, 0x44, 0x23, 0x00, 0xED, 0xEB, 0xFD, 0x2F,
+	0x33, 0x24, 0x12, 0xFF, 0xDC, 0xDD,
+};
+
+//organ, 304 bytes + 16 offset bytes, 1.60:1
+static const uint16_t organ_off[] = {0, 43, 78, 113, 152, 191, 226, 261};
+static const uint8_t organ_data[] = {
+	0x00, 0x00, 0xA8, 0x0D, 0x0A, 0xD1, 0x97, 0x8E, 0xB7, 0xD4, 0x2D, 0x47, 0x7C, 0xEF, 0xB9, 0xDB,
+	0x62, 0x8B, 0x2D, 0xB9, 0xF0, 0x12, 0xDC, 0x31, 0xCE, 0x55, 0xD3, 0x5D, 0xB9, 0xEC, 0xD0, 0xAB,
+	0x3F, 0x00, 0x05, 0x26, 0xBC, 0x70, 0x03, 0x0E, 0x36, 0xC0, 0x00, 0x0B, 0x64, 0x0A, 0xFF, 0x08,
+	0x0E, 0xFF, 0xF1, 0xE1, 0xD3, 0xC9, 0xBE, 0xB7, 0xB5, 0xB3, 0xB7, 0xBB, 0xC4, 0xD0, 0xDD, 0xEC,
+	0xFB, 0x0B, 0x1B, 0x2A, 0x37, 0x43, 0x4B, 0x54, 0x56, 0x58, 0x56, 0x53, 0x4D, 0x44, 0xF8, 0x1C,
+	0xE9, 0xFF, 0x08, 0x27, 0x1D, 0x12, 0x0B, 0x04, 0xFF, 0xFC, 0xFC, 0xFD, 0x00, 0x08, 0x0C, 0x16,
+	0x1E, 0x26, 0x2D, 0x35, 0x3A, 0x3C, 0x3C, 0x3A, 0x33, 0x2A, 0x1F, 0x0F, 0xFD, 0xEA, 0xD4, 0xBF,
+	0xA8, 0xD5, 0x3F, 0xBE, 0x00, 0x09, 0x6E, 0xC1, 0x56, 0x85, 0xDA, 0x54, 0x6A, 0xD6, 0xB4, 0x7A,
+	0x25, 0xB3, 0x5E, 0xCE, 0x9E, 0x01, 0x0C, 0x28, 0x6F, 0x1C, 0x95, 0xD2, 0x95, 0x4C, 0x9A, 0xB5,
+	0x69, 0xC8, 0x74, 0x8D, 0x52, 0xA4, 0x66, 0x09, 0x00, 0x00, 0xB5, 0x03, 0x09, 0xDC, 0x6B, 0x5B,
+	0xB6, 0xDB, 0xD5, 0x28, 0xCE, 0x96, 0x2A, 0x5D, 0xDE, 0x34, 0xBA, 0x55, 0x6E, 0x64, 0xD8, 0xD0,
+	0xE9, 0x53, 0xA8, 0x41, 0xC5, 0x8D, 0xA1, 0x4B, 0xA7, 0x5C, 0xCD, 0x82, 0xB5, 0x0A, 0x14, 0x2B,
+	0xC0, 0x3F, 0x01, 0x08, 0x6C, 0x58, 0x41, 0x2C, 0x16, 0x03, 0xF1, 0xE1, 0xD6, 0xCD, 0xC6, 0xC4,
+	0xC4, 0xC6, 0xCB, 0xD3, 0xDA, 0xE2, 0xEA, 0xF4, 0xF8, 0x00, 0x03, 0x04, 0x04, 0x01, 0xFC, 0xF5,
+	0xEE, 0xE3, 0x08, 0xE3, 0xB8, 0xFF, 0x08, 0xC5, 0xBC, 0xB3, 0xAD, 0xAA, 0xA8, 0xAA, 0xAC, 0xB5,
+	0xBD, 0xC9, 0xD6, 0xE5, 0xF5, 0x05, 0x14, 0x23, 0x30, 0x3C, 0x45, 0x49, 0x4D, 0x4B, 0x49, 0x42,
+	0x37, 0x2D, 0x1F, 0x0F, 0x01, 0xF5, 0x9B, 0xEF, 0xFE, 0x0A, 0xD8, 0x43, 0xAF, 0x3C, 0xF2, 0xC9,
+	0x47, 0xAF, 0x3D, 0xFB, 0xFD, 0x5B, 0x00, 0x83, 0x13, 0x6B, 0x30, 0xB2, 0x0A, 0x32, 0xE3, 0xF0,
+	0x03, 0x11, 0x47, 0x28, 0xA1, 0x54, 0x52, 0x46, 0x09, 0xBD, 0x33, 0x8D, 0x2B, 0x88, 0x6C, 0x01,
+};
+
+//pulse_bl, 245 bytes + 16 offset bytes, 1.96:1
+static const uint16_t pulse_bl_off[] = {0, 47, 82, 106, 126, 146, 166, 198};
+static const uint8_t pulse_bl_data[] = {
+	0x00, 0x00, 0xF5, 0x06, 0x0B, 0x8C, 0x10, 0x48, 0x55, 0xE4, 0x22, 0x95, 0x75, 0x24, 0xC1, 0xEE,
+	0x8D, 0x5E, 0x6D, 0x3C, 0xF9, 0x08, 0xC6, 0x51, 0xEA, 0x54, 0xC2, 0x05, 0x97, 0x7F, 0x2E, 0x7C,
+	0xE2, 0x97, 0xBB, 0xE8, 0x64, 0x1C, 0x85, 0xB0, 0x41, 0x01, 0xE4, 0xAF, 0x7F, 0x08, 0x00, 0x06,
+	0x27, 0x5A, 0xFE, 0x08, 0x41, 0x36, 0x26, 0x10, 0xFF, 0xF7, 0xF7, 0x01, 0x0B, 0x18, 0x1A, 0x1B,
+	0x12, 0x09, 0xFF, 0xFA, 0xF9, 0xFC, 0x05, 0x0A, 0x10, 0x0F, 0x0C, 0x06, 0x00, 0xFB, 0xFA, 0xFD,
+	0x00, 0x06, 0x52, 0x0F, 0xA2, 0xFF, 0x05, 0x89, 0x04, 0xCE, 0x37, 0x10, 0x07, 0x99, 0x02, 0x3C,
+	0xE7, 0x3E, 0x94, 0x62, 0x0A, 0xF0, 0x9D, 0x7B, 0x20, 0x0C, 0x4B, 0x06, 0xCF, 0xFF, 0x04, 0xF0,
+	0xDD, 0x1C, 0x31, 0x45, 0xE2, 0xCE, 0xFD, 0x31, 0x44, 0x01, 0xCE, 0xFC, 0x30, 0x43, 0x00, 0x00,
+	0xD6, 0xFF, 0x04, 0xCE, 0xDD, 0x10, 0x44, 0x02, 0xCF, 0xDC, 0x1F, 0x43, 0x22, 0xCE, 0xDB, 0xFF,
+	0x34, 0x13, 0xB5, 0xF9, 0xCA, 0xFF, 0x04, 0xAC, 0x0E, 0x42, 0x23, 0xB0, 0xBA, 0xFB, 0x42, 0x24,
+	0xB0, 0x8A, 0xE9, 0x50, 0x44, 0xCF, 0xAE, 0xF0, 0x97, 0xFF, 0x07, 0x77, 0x3D, 0x60, 0x60, 0x28,
+	0x00, 0xF4, 0xF4, 0x38, 0xDC, 0xBE, 0x27, 0x1C, 0x0C, 0x81, 0xBB, 0xBB, 0x6C, 0x46, 0xD7, 0xFF,
+	0x89, 0x44, 0x00, 0xAE, 0x55, 0x02, 0xFA, 0xD8, 0x20, 0xFE, 0x0B, 0xD6, 0x87, 0xBF, 0x01, 0x1C,
+	0xB0, 0x7F, 0xE5, 0xEF, 0xBD, 0xE3, 0xC6, 0x4E, 0xB4, 0xA0, 0x85, 0x7D, 0x74, 0x07, 0xEC, 0xC3,
+	0x3D, 0xC6, 0xEA, 0x1A, 0xE8, 0x08, 0xF7, 0xB0, 0x2A, 0xCD, 0x45, 0x11, 0xB7, 0xAF, 0xB8, 0xAB,
+	0x1D, 0xBD, 0x6A, 0x7F, 0x03,
+};
+
+const PackedWave wavelib[] = {
+	{"square_bl", square_bl_off, square_bl_data, sizeof(square_bl_data), 1, 0x918DA501UL},
+	{"saw_bl", saw_bl_off, saw_bl_data, sizeof(saw_bl_data), 0, 0x509D0A5BUL},
+	{"organ", organ_off, organ_data, sizeof(organ_data), 0, 0xEB3B2651UL},
+	{"pulse_bl", pulse_bl_off, pulse_bl_data, sizeof(pulse_bl_data), 0, 0x7561A26BUL},
+};
+
+const uint8_t wavelibn = sizeof(wavelib)/sizeof(wavelib[0]);
@@ -0,0 +1,67 @@
+#include "wavepack.h"
+
+//Expand one block of WP_BLOCK samples. x and d are kept unsigned so the 16 bit
+//wraparound the encoder relied on is well defined.
+void WavePackBlock(const PackedWave *w, uint16_t block, int16_t *dst){
+	const uint8_t *p;
+	uint16_t x, d;
+	uint8_t width, nbits = 0, n, neg = 0;
+	uint32_t mask, sign, acc = 0, r;
+
+	//The second half of a symmetric table is the first half negated
+	if(w->halfsym && block>=128/WP_BLOCK){
+		block -= 128/WP_BLOCK;
+		neg = 1;
+	}
+
+	p = w->data + w->offsets[block];
+	x = p[0] | (p[1]<<8);
+	d = p[2] | (p[3]<<8);
+	width = p[4];
+	mask = (1UL<<width) - 1;
+	sign = width ? 1UL<<(width-1) : 0;
+
+	p += WP_HEADER;
+	dst[0] = x;
+	x += d;
+	dst[1] = x;
+
+	for(n = 2; n<WP_BLOCK; n++){
+		//Top up the bit buffer a byte at a time, never more than 23 bits held
+		while(nbits<width){
+			acc |= (uint32_t)*p++<<nbits;
+			nbits += 8;
+		}
+		r = acc & mask;
+		acc >>= width;
+		nbits -= width;
+
+		//Sign extend and integrate twice
+		d += (r ^ sign) - sign;
+		x += d;
+		dst[n] = x;
+	}
+
+	if(neg){
+		for(n = 0; n<WP_BLOCK; n++) dst[n] = -dst[n];
+	}
+}
+
+//Expand a whole 256 entry table
+void WavePackDecode(const PackedWave *w, int16_t *dst){
+	uint16_t b;
+
+	for(b = 0; b<256/WP_BLOCK; b++){
+		WavePackBlock(w, b, &dst[b*WP_BLOCK]);
+	}
+}
+
+//FNV-1a over the samples, matches tools/wavepack.py
+uint32_t WavePackHash(const int16_t *src, uint16_t len){
+	uint32_t h = 2166136261UL;
+
+	while(len--){
+		h = (h ^ (uint16_t)*src++)*16777619UL;
+	}
+	return h;
+}
@@ -0,0 +1,44 @@
+#ifndef WAVEPACK_H
+#define WAVEPACK_H
+
+#include <stdint.h>
+
+/*
+ * Compressed wavetables for the library in flash. Tables are stored as independent
+ * blocks of WP_BLOCK samples so a table can be expanded a block at a time, which is how
+ * the background rebuild in generator.c uses it. Each block is:
+ *
+ *     x0 (int16), d0 = x1-x0 (int16), residual width in bits (uint8, 0-16),
+ *     then WP_BLOCK-2 second differences packed LSB first at that width
+ *
+ * All the arithmetic is modulo 2^16, so no residual needs more than 16 bits. Smooth
+ * waveforms have small second differences; a full scale sine needs 6 bits. Tables with
+ * half wave symmetry (odd harmonics only) store just the first half, the second is the
+ * same blocks negated. The library (wavelib.c) is generated by tools/wavepack.py, which
+ * reports the compression ratio, and "sim pack" checks every table decodes to the hash
+ * the tool recorded and times the decoder.
+ */
+
+//Samples per block, must divide the 256 entry table and REGEN_CHUNK
+#define WP_BLOCK	32
+
+//Bytes of block header
+#define WP_HEADER	5
+
+typedef struct {
+	const char *name;
+	const uint16_t *offsets;	//Byte offset of each block in data
+	const uint8_t *data;
+	uint16_t size;				//Bytes of data
+	uint8_t halfsym;			//Only the first 128 samples are stored
+	uint32_t hash;				//FNV-1a of the decoded samples
+} PackedWave;
+
+extern const PackedWave wavelib[];
+extern const uint8_t wavelibn;
+
+void WavePackBlock(const PackedWave *w, uint16_t block, int16_t *dst);
+void WavePackDecode(const PackedWave *w, int16_t *dst);
+uint32_t WavePackHash(const int16_t *src, uint16_t len);
+
+#endif